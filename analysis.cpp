@@ -0,0 +1,201 @@
+#include "analysis.h"
+#include "oscillometry.h"
+
+volatile int heart_rate;
+// A global variable for storing the heart rate
+volatile int heart_rate_confidence;
+volatile int systolic;
+// A global variable for storing the systolic blood pressure
+volatile int diastolic;
+// A global variable for storing the diastolic blood pressure
+CaptureBuffer capture;
+// Filled by pump_up_to_150 and open_valve, analyzed in place by 
+// calc_inflation_stats and calc_stats
+InflationStats inflation;
+static uint32_t deflate_seconds = 0;
+// The deflation time the capture buffer is sized for
+
+bool set_max_deflate_seconds(uint32_t seconds) {
+  if (!capture.allocate(measurement_arena,
+                        (MAX_CAPTURE_SECONDS + MAX_INFLATE_SECONDS) * SAMPLE_RATE_HZ)
+      || seconds == 0 || seconds > MAX_CAPTURE_SECONDS) {
+    return false;
+  }
+  // The buffer is allocated for the longest inflation and deflation the
+  // first time round; changing the setting later only moves the limit
+  capture.set_inflation_limit(MAX_INFLATE_SECONDS * SAMPLE_RATE_HZ);
+  capture.set_limit(seconds * SAMPLE_RATE_HZ);
+  deflate_seconds = seconds;
+  return true;
+}
+
+uint32_t max_deflate_seconds() {
+  return deflate_seconds;
+}
+
+#ifndef __MBED__
+void DeflationAnalyzer::reset() {
+  detector.reset();
+  count = 0;
+  first_beat_us = 0;
+  last_beat_us = 0;
+  sbp = 0;
+  started = false;
+  prev = 0;
+  curr_inc = 0;
+  max_inc = 0;
+  mean_ap = 0;
+}
+
+void DeflationAnalyzer::update(uint32_t time_us, pressure_t p) {
+  if (detector.update(time_us, p)) {
+    // The previous sample was a heart beat
+    if (count == 0) {
+      first_beat_us = detector.beat_time_us();
+      sbp = detector.beat_pressure();
+      // The pressure at the first beat is the systolic pressure
+    }
+    count++;
+    last_beat_us = detector.beat_time_us();
+  }
+
+  pressure_t osci = started && p < MMHG(150) ? p - prev : 0;
+  // The change since the previous sample; the first sample and the ones
+  // above 150 mmHg are skipped
+  if (osci < 0) {
+    // The pressure wave is dropping, so curr_inc is the cumulative 
+    // increase during the last spike
+    if (curr_inc > max_inc) {
+      max_inc = curr_inc;
+      mean_ap = prev;
+      // The mean arterial pressure is roughly the pressure at the top
+      // of the largest spike
+    }
+    curr_inc = 0;
+  } else {
+    curr_inc += osci;
+  }
+  prev = p;
+  started = true;
+}
+
+void DeflationAnalyzer::finish() const {
+  systolic = pressure_to_mmhg(sbp);
+  diastolic = pressure_to_mmhg((mean_ap * 3 - sbp) / 2);
+  // The formula for calculating the diastolic pressure when given 
+  // the MAP and the systolic pressure
+  // Both are only rounded to whole mmHg here, for display
+  uint32_t elapsed_us = last_beat_us - first_beat_us;
+  // The time between the first and the last heart beat, 
+  // measured by the sampler
+  if (elapsed_us == 0) {
+    // No beat or a single beat was found
+    heart_rate = 0;
+    return;
+  }
+  heart_rate = (int) ((int64_t) count * 60000000 / elapsed_us);
+  // The heart rate in beats by minute equals the number of heart beats 
+  // divided by the time interval in seconds and then multiplied by 60
+}
+#endif
+
+void calc_stats() {
+  const CaptureSample * s = capture.deflation();
+  uint32_t n = capture.deflation_size();
+  // Only the deflation samples actually recorded are analyzed
+  static OscillometricAnalyzer analyzer;
+  // Static: its beats take 2 KB
+  analyzer.reset();
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    analyzer.update(s[i].time_us, s[i].pressure);
+  }
+  analyzer.finish();
+}
+
+static pressure_t per_second(pressure_t change, uint32_t elapsed_us) {
+  // Scales a change over elapsed_us to a change per second
+
+  if (elapsed_us == 0) {
+    return 0;
+  }
+  return (pressure_t) ((int64_t) change * 1000000 / elapsed_us);
+}
+
+static void add_trend(const CaptureSample * s, uint32_t from, uint32_t to,
+                      int64_t & sxy, int64_t & sxx) {
+  // Adds samples from to to (inclusive) to a least-squares slope fit that
+  // gives each stretch its own offset, in 1/256 mmHg per millisecond
+  // A straight line through a whole pause isn't thrown off by a heart
+  // beat at either end of it the way its first and last samples would be
+
+  int64_t n = to - from + 1;
+  int64_t st = 0, sp = 0, stt = 0, stp = 0;
+  uint32_t i;
+  for (i = from; i <= to; i++) {
+    int64_t t = (s[i].time_us - s[from].time_us) / 1000;
+    int64_t p = s[i].pressure;
+    st += t;
+    sp += p;
+    stt += t * t;
+    stp += t * p;
+  }
+  sxy += stp - st * sp / n;
+  sxx += stt - st * st / n;
+}
+
+void calc_inflation_stats() {
+  const CaptureSample * s = capture.inflation();
+  uint32_t n = capture.inflation_size();
+  InflationStats st = {0, 0, 0, 0, 0, 0, 0};
+  if (n < 2) {
+    inflation = st;
+    return;
+  }
+
+  st.start = s[0].pressure;
+  st.end = s[n - 1].pressure;
+  uint32_t elapsed_us = s[n - 1].time_us - s[0].time_us;
+  st.duration_ms = elapsed_us / 1000;
+  st.pump_rate = per_second(st.end - st.start, elapsed_us);
+
+  uint32_t i;
+  for (i = SAMPLE_RATE_HZ; i < n; i++) {
+    pressure_t rate = per_second(s[i].pressure - s[i - SAMPLE_RATE_HZ].pressure,
+                                 s[i].time_us - s[i - SAMPLE_RATE_HZ].time_us);
+    // The rise over the last second, measured rather than assumed
+    if (rate > st.peak_pump_rate) {
+      st.peak_pump_rate = rate;
+    }
+  }
+
+  uint32_t run_start = 0;
+  // The sample the current rise started at
+  bool rising = false;
+  int64_t sxy = 0;
+  int64_t sxx = 0;
+  // The slope fit over the pauses between strokes
+  uint32_t last_peak = 0;
+  // The top of the previous stroke
+  for (i = 1; i <= n; i++) {
+    pressure_t change = i < n ? s[i].pressure - s[i - 1].pressure : -1;
+    // The end of the ramp closes the last rise
+    if (change > 0 && !rising) {
+      run_start = i - 1;
+      rising = true;
+    } else if (change < 0 && rising) {
+      rising = false;
+      if (s[i - 1].pressure - s[run_start].pressure >= STROKE_MIN_RISE) {
+        if (st.strokes > 0 && run_start > last_peak) {
+          add_trend(s, last_peak, run_start, sxy, sxx);
+          // From the top of one stroke to the bottom of the next
+        }
+        st.strokes++;
+        last_peak = i - 1;
+      }
+    }
+  }
+  st.leak_rate = sxx > 0 ? (pressure_t) (-sxy * 1000 / sxx) : 0;
+
+  inflation = st;
+}
@@ -0,0 +1,139 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+#include "sampler.h"
+#include "pressure.h"
+#include "capture.h"
+#include "arena.h"
+
+#define MAX_DEFLATE_SECONDS 90
+// How long the cuff may take to deflate before the program restarts, 
+// unless set_max_deflate_seconds says otherwise
+
+#define STROKE_MIN_RISE MMHG(4)
+// A rise of at least this much while pumping is a squeeze of the bulb;
+// the heart beats only move the pressure by 1 to 3 mmHg
+
+struct InflationStats {
+  uint32_t duration_ms;
+  // From the first inflation sample to the last
+  pressure_t start;
+  pressure_t end;
+  pressure_t pump_rate;
+  // The average rise per second
+  pressure_t peak_pump_rate;
+  // The fastest rise over any one second
+  int strokes;
+  // Squeezes of the bulb
+  pressure_t leak_rate;
+  // How fast the pressure fell, per second, in the pauses between 
+  // strokes; a tight cuff and valve hold it near 0
+};
+
+extern CaptureBuffer capture;
+// The samples read while the cuff is pumped up and while it deflates
+extern InflationStats inflation;
+// Filled in by calc_inflation_stats
+extern volatile int heart_rate;
+// The heart rate in beats per minute
+extern volatile int heart_rate_confidence;
+// How steady the beats it was timed from were, from 0 to 100
+extern volatile int systolic;
+// The systolic blood pressure
+extern volatile int diastolic;
+// The diastolic blood pressure
+
+#ifndef __MBED__
+// Legacy: the beat rule and analyzer the firmware used before the
+// oscillometric engine, which calc_stats uses now. Only built on the host,
+// where tools/oscillometry_corpus compares the two
+
+// Spots heart beats in the deflation as it happens, one sample at a time
+// A beat is a sample where the pressure stops rising and starts to fall;
+// samples at or above 150 mmHg are ignored
+class BeatDetector {
+public:
+  BeatDetector() { reset(); }
+  void reset() {
+    started = false;
+    rising = false;
+  }
+  bool update(uint32_t time_us, pressure_t p) {
+    // Returns true if the sample before this one was a beat
+
+    bool beat = false;
+    if (started && p < MMHG(150)) {
+      pressure_t change = p - prev;
+      beat = rising && change < 0;
+      if (change != 0) {
+        rising = change > 0;
+        // A flat step keeps the direction of the last change
+      }
+    }
+    peak_time = prev_time;
+    peak = prev;
+    prev_time = time_us;
+    prev = p;
+    started = true;
+    return beat;
+  }
+  uint32_t beat_time_us() const { return peak_time; }
+  pressure_t beat_pressure() const { return peak; }
+  // The beat update last returned true for
+
+private:
+  bool started;
+  bool rising;
+  uint32_t prev_time;
+  pressure_t prev;
+  uint32_t peak_time;
+  pressure_t peak;
+};
+
+// Works out the heart rate and blood pressure while the cuff deflates, 
+// one sample at a time, with the rules the firmware used before the
+// oscillometric engine (see oscillometry.h): the first beat below 150 mmHg
+// is the systolic pressure, the top of the largest rise is the mean 
+// arterial pressure, and the heart rate comes from the time between the
+// first and the last beat
+class DeflationAnalyzer {
+public:
+  DeflationAnalyzer() { reset(); }
+  void reset();
+  // Starts a new deflation
+  void update(uint32_t time_us, pressure_t p);
+  // Adds the next deflation sample
+  void finish() const;
+  // Sets heart_rate, systolic and diastolic from the samples so far
+  int beats() const { return count; }
+
+private:
+  BeatDetector detector;
+  int count;
+  // Beats found so far
+  uint32_t first_beat_us;
+  uint32_t last_beat_us;
+  pressure_t sbp;
+  // The pressure at the first beat
+  bool started;
+  pressure_t prev;
+  pressure_t curr_inc;
+  // The rise since the pressure last fell
+  pressure_t max_inc;
+  pressure_t mean_ap;
+  // The pressure at the top of the largest rise so far
+};
+#endif
+
+bool set_max_deflate_seconds(uint32_t seconds);
+// Limits the capture buffer to a deflation of the given number of seconds
+// at SAMPLE_RATE_HZ; call it before a measurement, not during one
+// Returns false if it is more than MAX_CAPTURE_SECONDS
+uint32_t max_deflate_seconds();
+void calc_stats();
+// Analyzes the deflation samples in capture with an OscillometricAnalyzer
+void calc_inflation_stats();
+// Analyzes the inflation samples in capture
+
+#endif
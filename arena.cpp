@@ -0,0 +1,40 @@
+#include "arena.h"
+
+StaticArena<MEASUREMENT_ARENA_BYTES> measurement_arena;
+StaticArena<TEXT_ARENA_BYTES> text_arena;
+
+static text_line_t spare_lines[20];
+// Used only after text_arena has run out
+
+Arena::Arena(uint8_t * memory, uint32_t size)
+    : memory(memory), size(size), used(0), peak(0), failed(0) {}
+
+void * Arena::alloc(uint32_t bytes, uint32_t align) {
+  uint32_t start = (used + align - 1) & ~(align - 1);
+  // align must be a power of two
+  if (start > size || bytes > size - start) {
+    failed++;
+    return NULL;
+  }
+
+  used = start + bytes;
+  if (used > peak) {
+    peak = used;
+  }
+  return memory + start;
+}
+
+void Arena::release(uint32_t mark) {
+  if (mark < used) {
+    used = mark;
+  }
+}
+
+text_line_t * alloc_text_lines(int lines) {
+  text_line_t * p = (text_line_t *) text_arena.alloc(lines * sizeof(text_line_t), 1);
+  if (p == NULL) {
+    return spare_lines;
+    // Sized for the largest screen
+  }
+  return p;
+}
@@ -0,0 +1,87 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sampler.h"
+#include "capture.h"
+
+// Fixed-size memory the firmware hands out instead of using the heap
+// An arena is a block of static memory given out front to back: alloc
+// just moves a pointer, and memory is given back by rewinding to a mark
+// taken earlier, all at once. Each arena keeps its high-water mark and
+// counts the requests it couldn't satisfy, so the worst case RAM use is
+// known and a failure shows up instead of corrupting memory
+class Arena {
+public:
+  Arena(uint8_t * memory, uint32_t size);
+  void * alloc(uint32_t bytes, uint32_t align = 8);
+  // Returns NULL (and counts the failure) if there isn't enough room
+  uint32_t mark() const { return used; }
+  void release(uint32_t mark);
+  // Gives back everything allocated since mark was taken
+  void reset() { release(0); }
+  uint32_t in_use() const { return used; }
+  uint32_t capacity() const { return size; }
+  uint32_t high_water() const { return peak; }
+  // The most that was ever in use at once
+  uint32_t failures() const { return failed; }
+
+private:
+  uint8_t * memory;
+  uint32_t size;
+  uint32_t used;
+  uint32_t peak;
+  uint32_t failed;
+};
+
+template <uint32_t N>
+class StaticArena : public Arena {
+public:
+  StaticArena() : Arena(storage, N) {}
+
+private:
+  alignas(8) uint8_t storage[N];
+};
+
+// Rewinds an arena when it goes out of scope, so a function can take
+// scratch memory without having to give it back on every return path
+class ArenaScope {
+public:
+  explicit ArenaScope(Arena & arena) : arena(arena), start(arena.mark()) {}
+  ~ArenaScope() { arena.release(start); }
+
+private:
+  Arena & arena;
+  uint32_t start;
+};
+
+#define TEXT_LINE_LEN 60
+// The longest line of text a screen formats
+typedef char text_line_t[TEXT_LINE_LEN];
+
+#define MAX_CAPTURE_SECONDS 120
+// The longest deflation set_max_deflate_seconds accepts
+#define MAX_INFLATE_SECONDS 60
+// The longest inflation the capture buffer keeps; pumping up any slower
+// only loses the end of the ramp
+#define MEASUREMENT_ARENA_BYTES \
+  ((MAX_CAPTURE_SECONDS + MAX_INFLATE_SECONDS) * SAMPLE_RATE_HZ * sizeof(CaptureSample))
+// The samples of one measurement, the capture buffer's only use; the
+// analyzers keep their state in static globals
+#define TEXT_ARENA_BYTES (40 * TEXT_LINE_LEN)
+// Lines of text for the screens: the deflation screen (20 lines) with 
+// the debug screen (19 lines) on top of it is the deepest nesting
+
+extern StaticArena<MEASUREMENT_ARENA_BYTES> measurement_arena;
+// Allocated from at startup and never released
+extern StaticArena<TEXT_ARENA_BYTES> text_arena;
+// Scratch lines for the screen functions, released when they return
+
+text_line_t * alloc_text_lines(int lines);
+// Takes lines of text from text_arena; never returns NULL
+// If the arena is exhausted, the failure is counted and a shared spare 
+// buffer is returned instead, so a screen may show garbled text but the
+// firmware keeps running
+
+#endif
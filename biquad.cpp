@@ -0,0 +1,95 @@
+#include <math.h>
+#include "biquad.h"
+
+static BiquadDesign normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+  BiquadDesign d = {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+  return d;
+}
+
+BiquadDesign biquad_lowpass(double cutoff_hz, double rate_hz, double q) {
+  double w = 2 * M_PI * cutoff_hz / rate_hz;
+  double alpha = sin(w) / (2 * q);
+  double c = cos(w);
+  return normalize((1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+BiquadDesign biquad_highpass(double cutoff_hz, double rate_hz, double q) {
+  double w = 2 * M_PI * cutoff_hz / rate_hz;
+  double alpha = sin(w) / (2 * q);
+  double c = cos(w);
+  return normalize((1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+double biquad_dc_gain(const BiquadDesign & d) {
+  return (d.b0 + d.b1 + d.b2) / (1 + d.a1 + d.a2);
+}
+
+static int32_t to_fixed(double x) {
+  return (int32_t) llround(x * (1 << BIQUAD_FRAC_BITS));
+}
+
+void BiquadStage<int32_t>::set(const BiquadDesign & d) {
+  b0 = to_fixed(d.b0);
+  b2 = to_fixed(d.b2);
+  a1 = to_fixed(d.a1);
+  a2 = to_fixed(d.a2);
+  int64_t den = ((int64_t) 1 << BIQUAD_FRAC_BITS) + a1 + a2;
+  b1 = (int32_t) (llround(biquad_dc_gain(d) * den) - b0 - b2);
+  // b0 + b1 + b2 over 1 + a1 + a2 is the DC gain, exactly, once rounded
+  reset();
+}
+
+void BiquadStage<int32_t>::set_identity() {
+  b0 = 1 << BIQUAD_FRAC_BITS;
+  b1 = b2 = a1 = a2 = 0;
+  reset();
+}
+
+void BiquadStage<int32_t>::reset() {
+  x1 = x2 = y1 = y2 = 0;
+  e1 = e2 = 0;
+}
+
+int32_t BiquadStage<int32_t>::prime(int32_t x) {
+  int64_t den = ((int64_t) 1 << BIQUAD_FRAC_BITS) + a1 + a2;
+  int64_t num = ((int64_t) b0 + b1 + b2) * x;
+  int32_t y = den != 0 ? (int32_t) (num / den) : 0;
+  // The steady output, which is a whole number of counts when the gain is
+  // 0 or 1
+  x1 = x2 = x;
+  y1 = y2 = y;
+  e1 = e2 = 0;
+  return y;
+}
+
+int32_t BiquadStage<int32_t>::coefficient(int i) const {
+  const int32_t c[5] = {b0, b1, b2, a1, a2};
+  return c[i];
+}
+
+void BiquadStage<float>::set(const BiquadDesign & d) {
+  b0 = (float) d.b0;
+  b1 = (float) d.b1;
+  b2 = (float) d.b2;
+  a1 = (float) d.a1;
+  a2 = (float) d.a2;
+  reset();
+}
+
+void BiquadStage<float>::set_identity() {
+  b0 = 1;
+  b1 = b2 = a1 = a2 = 0;
+  reset();
+}
+
+void BiquadStage<float>::reset() {
+  s1 = s2 = 0;
+}
+
+float BiquadStage<float>::prime(float x) {
+  float den = 1 + a1 + a2;
+  float y = den != 0 ? (b0 + b1 + b2) * x / den : 0;
+  s1 = y - b0 * x;
+  s2 = b2 * x - a2 * y;
+  return y;
+}
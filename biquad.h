@@ -0,0 +1,171 @@
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+#include <stdint.h>
+
+#define BIQUAD_FRAC_BITS 29
+// The fixed-point coefficients are Q2.29, from -4 to 4, which holds the
+// a1 of any stable stage
+#define BIQUAD_BUTTERWORTH 0.70710678
+// The Q of a second-order Butterworth stage: flat, with no overshoot
+#define CUFF_HIGHPASS_HZ 0.5
+// Below the slowest heart rate (30 bpm); takes out the deflation ramp
+#define CUFF_LOWPASS_HZ 5.0
+// The second harmonic of 150 bpm, which keeps the rise of a beat, and
+// well below half of the slowest sample rate, where the sensor noise is
+// all that is left
+#define CUFF_FILTER_STAGES 2
+
+// A second-order section in floating point, designed for a sample rate:
+//   H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+// BiquadStage rounds it to the type it runs in
+struct BiquadDesign {
+  double b0;
+  double b1;
+  double b2;
+  double a1;
+  double a2;
+};
+
+BiquadDesign biquad_lowpass(double cutoff_hz, double rate_hz, double q);
+BiquadDesign biquad_highpass(double cutoff_hz, double rate_hz, double q);
+// The filters from the Audio EQ Cookbook (bilinear transform with the
+// cutoff prewarped); q is BIQUAD_BUTTERWORTH unless a resonance is wanted
+double biquad_dc_gain(const BiquadDesign & d);
+
+// One second-order section, specialized for each sample type below
+template <typename T>
+class BiquadStage;
+
+// Q24.8 samples (pressure_t) and Q2.29 coefficients, in direct form I
+// The five products are summed in 64 bits, so nothing overflows for
+// samples under 2^23 (32768 mmHg), and the bits the shift drops are fed
+// back into the next two sums (second-order error feedback, 2 e[n-1] -
+// e[n-2]), which puts a double zero at DC in the rounding noise to cancel
+// the poles near z = 1 that a low cutoff has. Without it the noise is
+// amplified by 1 / (1 + a1 + a2), thousands of times at 200 Hz
+// b1 is rounded so the coefficients give the designed DC gain to the
+// last bit, so a low-pass passes a steady pressure through to within a
+// count (1/256 mmHg) and a high-pass takes it out
+// Every step is integer arithmetic with a defined result, so the board
+// and the host give the same output to the bit. It relies on >> of a
+// negative number shifting in ones, which GCC and Clang guarantee
+template <>
+class BiquadStage<int32_t> {
+public:
+  BiquadStage() { set_identity(); }
+  void set(const BiquadDesign & d);
+  void set_identity();
+  // Passes samples through unchanged
+  void reset();
+  // Clears the history, as if the input had been 0 forever
+  int32_t prime(int32_t x);
+  // Sets the history as if the input had been x forever, so a filter
+  // started partway through a measurement doesn't ring; returns the
+  // steady output
+  int32_t push(int32_t x) {
+    int64_t acc = (int64_t) b0 * x + (int64_t) b1 * x1 + (int64_t) b2 * x2
+                  - (int64_t) a1 * y1 - (int64_t) a2 * y2 + 2 * e1 - e2;
+    int32_t y = (int32_t) (acc >> BIQUAD_FRAC_BITS);
+    e2 = e1;
+    e1 = (int32_t) (acc - ((int64_t) y << BIQUAD_FRAC_BITS));
+    // What the shift dropped, from 0 to just under one count
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    return y;
+  }
+  int32_t coefficient(int i) const;
+  // b0, b1, b2, a1 and a2 for i = 0 to 4, as Q2.29
+
+private:
+  int32_t b0, b1, b2, a1, a2;
+  int32_t x1, x2, y1, y2;
+  int32_t e1, e2;
+};
+
+// Single-precision samples and coefficients, in transposed direct form II,
+// which keeps two state variables and rounds less than direct form I in
+// floating point. On the board the FPU does a multiply-add in one step
+template <>
+class BiquadStage<float> {
+public:
+  BiquadStage() { set_identity(); }
+  void set(const BiquadDesign & d);
+  void set_identity();
+  void reset();
+  float prime(float x);
+  float push(float x) {
+    float y = b0 * x + s1;
+    s1 = b1 * x - a1 * y + s2;
+    s2 = b2 * x - a2 * y;
+    return y;
+  }
+
+private:
+  float b0, b1, b2, a1, a2;
+  float s1, s2;
+};
+
+// N second-order sections run one after the other: a high-pass stage
+// followed by a low-pass stage makes a band-pass, two low-pass stages a
+// fourth-order low-pass, and so on
+// Each sample costs N stages of five multiplies; the coefficients are
+// worked out in double once, by set, so designing for another sample
+// rate is a call to set rather than a new table
+template <typename T, int N>
+class BiquadCascade {
+  static_assert(N >= 1 && N <= 8, "N must be 1 to 8");
+
+public:
+  void set(int i, const BiquadDesign & d) { stage[i].set(d); }
+  // Stages not set pass their input through
+  void reset() {
+    int i;
+    for (i = 0; i < N; i++) {
+      stage[i].reset();
+    }
+  }
+  void prime(T x) {
+    // Sets every stage as if the input had been x forever
+    int i;
+    for (i = 0; i < N; i++) {
+      x = stage[i].prime(x);
+    }
+  }
+  T push(T x) {
+    int i;
+    for (i = 0; i < N; i++) {
+      x = stage[i].push(x);
+    }
+    return x;
+  }
+  void run(const T * in, T * out, int n) {
+    // Filters a block; in and out may be the same buffer
+    int i;
+    for (i = 0; i < n; i++) {
+      out[i] = push(in[i]);
+    }
+  }
+  const BiquadStage<T> & at(int i) const { return stage[i]; }
+
+private:
+  BiquadStage<T> stage[N];
+};
+
+template <typename T>
+void design_cuff_filter(BiquadCascade<T, CUFF_FILTER_STAGES> & f, double rate_hz) {
+  // The band the cuff oscillations are in: the deflation ramp and the
+  // drift below CUFF_HIGHPASS_HZ come out, and so does the sensor noise
+  // above CUFF_LOWPASS_HZ. The second-order high-pass has two zeros at
+  // DC, so a steady deflation comes out as 0, not as an offset
+
+  f.set(0, biquad_highpass(CUFF_HIGHPASS_HZ, rate_hz, BIQUAD_BUTTERWORTH));
+  f.set(1, biquad_lowpass(CUFF_LOWPASS_HZ, rate_hz, BIQUAD_BUTTERWORTH));
+}
+
+typedef BiquadCascade<int32_t, CUFF_FILTER_STAGES> CuffFilter;
+// The fixed-point band-pass; pressure_t in, the oscillation out
+
+#endif
@@ -0,0 +1,36 @@
+#include "capture.h"
+#include "arena.h"
+
+bool CaptureBuffer::allocate(Arena & arena, uint32_t capacity) {
+  if (samples != NULL) {
+    return capacity <= cap;
+  }
+
+  samples = (CaptureSample *) arena.alloc(capacity * sizeof(CaptureSample), 4);
+  if (samples == NULL) {
+    return false;
+  }
+  cap = capacity;
+  limit = capacity;
+  inflation_limit = 0;
+  reset();
+  return true;
+}
+
+void CaptureBuffer::set_limit(uint32_t samples) {
+  limit = samples < cap ? samples : cap;
+}
+
+void CaptureBuffer::set_inflation_limit(uint32_t samples) {
+  inflation_limit = samples < cap ? samples : cap;
+}
+
+bool CaptureBuffer::append(uint32_t time_us, pressure_t pressure) {
+  if (full() || len >= cap) {
+    return false;
+  }
+  samples[len].time_us = time_us;
+  samples[len].pressure = pressure;
+  len++;
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include "pressure.h"
+
+class Arena;
+
+struct CaptureSample {
+  uint32_t time_us;
+  // When the reading was taken
+  pressure_t pressure;
+  // The pressure in 1/256 mmHg
+};
+
+// The samples recorded while the cuff is pumped up and then deflates, in
+// the order they were read: the inflation first, then the deflation from
+// deflation_start() on
+// The storage is allocated once, at startup, and reused for every 
+// measurement: main appends each sample straight into it and the
+// analysis reads it where it is, so nothing is ever cleared or copied
+// Only the first size() samples are valid
+class CaptureBuffer {
+public:
+  CaptureBuffer()
+      : samples(NULL), len(0), cap(0), limit(0), inflation_limit(0), split(0), deflating(false) {}
+  bool allocate(Arena & arena, uint32_t capacity);
+  // Takes room for capacity samples from arena; only the first call does
+  // anything. Returns false if the arena doesn't have the room
+  void set_limit(uint32_t samples);
+  // Makes the deflation full after this many samples
+  void set_inflation_limit(uint32_t samples);
+  // Makes the inflation full after this many samples; the two limits
+  // together must not be more than capacity()
+  void reset() {
+    len = 0;
+    split = 0;
+    deflating = false;
+  }
+  // Empties the buffer for the next measurement, which starts with the
+  // inflation
+  void start_deflation() {
+    split = len;
+    deflating = true;
+  }
+  // Ends the inflation; what is appended from now on is the deflation
+  bool append(uint32_t time_us, pressure_t pressure);
+  // Returns false if the current stage is already full
+  bool full() const { return deflating ? len - split >= limit : len >= inflation_limit; }
+  uint32_t size() const { return len; }
+  uint32_t capacity() const { return cap; }
+  const CaptureSample & operator[](uint32_t i) const { return samples[i]; }
+  const CaptureSample * data() const { return samples; }
+  uint32_t deflation_start() const { return deflating ? split : len; }
+  const CaptureSample * deflation() const { return samples + deflation_start(); }
+  uint32_t deflation_size() const { return len - deflation_start(); }
+  const CaptureSample * inflation() const { return samples; }
+  uint32_t inflation_size() const { return deflation_start(); }
+
+private:
+  CaptureSample * samples;
+  uint32_t len;
+  uint32_t cap;
+  uint32_t limit;
+  uint32_t inflation_limit;
+  uint32_t split;
+  // The first deflation sample
+  bool deflating;
+};
+
+#endif
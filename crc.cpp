@@ -0,0 +1,17 @@
+#include "crc.h"
+
+static const uint16_t crc_nibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+// The CRC of every 4-bit value; a 16-entry table is a good trade between
+// flash and speed at serial port rates
+
+uint16_t crc16_ccitt(const uint8_t * data, int len, uint16_t crc) {
+  int i;
+  for (i = 0; i < len; i++) {
+    crc = (uint16_t) ((crc << 4U) ^ crc_nibble[(crc >> 12U) ^ (data[i] >> 4U)]);
+    crc = (uint16_t) ((crc << 4U) ^ crc_nibble[(crc >> 12U) ^ (data[i] & 0x0FU)]);
+  }
+  return crc;
+}
@@ -0,0 +1,11 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+uint16_t crc16_ccitt(const uint8_t * data, int len, uint16_t crc = 0xFFFF);
+// CRC-16/CCITT-FALSE (polynomial 0x1021); pass the result back in as crc
+// to continue over more data
+// Guards the serial export frames and the history records in EEPROM
+
+#endif
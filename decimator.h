@@ -0,0 +1,90 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stdint.h>
+
+// A cascaded integrator-comb (CIC) decimator
+// Takes R input samples for every output sample and averages them through
+// N moving-sum stages, which cancels most of the sensor noise and puts a
+// zero of the response on every multiple of the output rate, so nothing
+// above half the output rate folds back into the passband
+// It takes no multiplies per input sample, only N additions; the N
+// differences and the one multiply that removes the R^N gain happen once
+// per output sample
+// The registers use unsigned arithmetic and are allowed to wrap around:
+// the output is still exact as long as x * R^N fits in 64 bits
+template <uint32_t R, int N>
+class CicDecimator {
+  static_assert(R >= 2, "R must be at least 2");
+  static_assert(N >= 1 && N <= 4, "N must be 1 to 4");
+
+public:
+  static constexpr uint64_t gain() {
+    return N == 1 ? R : N == 2 ? (uint64_t) R * R : N == 3 ? (uint64_t) R * R * R
+                                                           : (uint64_t) R * R * R * R;
+  }
+  static constexpr uint32_t delay() {
+    // The group delay in input samples
+    return (uint32_t) (N * (R - 1) / 2);
+  }
+
+  CicDecimator() { reset(); }
+
+  void reset() {
+    int i;
+    for (i = 0; i < N; i++) {
+      integrators[i] = 0;
+      combs[i] = 0;
+    }
+    phase = 0;
+    warmup = N;
+  }
+
+  bool push(int32_t x, int32_t & out) {
+    // Feeds one input sample; returns true when an output sample is ready
+    // The first N outputs are dropped while the combs fill up
+
+    uint64_t v = (uint64_t) (int64_t) x;
+    int i;
+    for (i = 0; i < N; i++) {
+      integrators[i] += v;
+      v = integrators[i];
+    }
+    if (++phase < R) {
+      return false;
+    }
+    phase = 0;
+
+    for (i = 0; i < N; i++) {
+      uint64_t d = v - combs[i];
+      combs[i] = v;
+      v = d;
+    }
+    if (warmup > 0) {
+      warmup--;
+      return false;
+    }
+
+    int64_t sum = (int64_t) v;
+    // R^N times the average, back in signed form
+    out = (int32_t) ((sum * (int64_t) RECIPROCAL + ((int64_t) 1 << 31)) >> 32);
+    // Divide by R^N with a multiply, rounded to nearest; exact when R is a
+    // power of two, and otherwise off by at most R^N / 512 counts for 
+    // 24-bit input
+    return true;
+  }
+
+private:
+  static constexpr int64_t RECIPROCAL = (int64_t) ((((uint64_t) 1 << 32) + gain() / 2) / gain());
+  // 2^32 / R^N
+
+  uint64_t integrators[N];
+  // Run at the input rate
+  uint64_t combs[N];
+  // The previous integrator output seen by each comb, at the output rate
+  uint32_t phase;
+  // Input samples since the last output
+  int warmup;
+};
+
+#endif
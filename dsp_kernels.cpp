@@ -0,0 +1,299 @@
+#include <string.h>
+#include "dsp_kernels.h"
+#if defined(__ARM_FEATURE_DSP)
+#include "cmsis.h"
+#define DSP_M4 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_SSE2 1
+#endif
+
+static inline int16_t saturate16(int32_t v) {
+  return (int16_t) (v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static inline int16_t envelope_step(int16_t e, int16_t a, int16_t decay) {
+  // a is |x| already
+
+  int32_t fall = (int32_t) e - decay;
+  return fall > a ? (int16_t) fall : a;
+}
+
+static inline int16_t abs16(int16_t v) {
+  return v < 0 ? saturate16(-(int32_t) v) : v;
+}
+
+void dsp_diff16_scalar(const int16_t * x, int16_t * d, int n, int16_t prev) {
+  int i;
+  for (i = 0; i < n; i++) {
+    int16_t v = x[i];
+    d[i] = saturate16((int32_t) v - prev);
+    prev = v;
+  }
+}
+
+int32_t dsp_sum16_scalar(const int16_t * x, int n) {
+  int32_t sum = 0;
+  int i;
+  for (i = 0; i < n; i++) {
+    sum += x[i];
+  }
+  return sum;
+}
+
+void dsp_moving_sum16_scalar(const int16_t * x, int32_t * s, int n, int w) {
+  if (w < 1 || n < w) {
+    return;
+  }
+  int32_t sum = dsp_sum16_scalar(x, w);
+  s[0] = sum;
+  int i;
+  for (i = 1; i <= n - w; i++) {
+    sum += x[i + w - 1] - x[i - 1];
+    s[i] = sum;
+  }
+}
+
+int dsp_peak16_scalar(const int16_t * x, int n) {
+  if (n <= 0) {
+    return -1;
+  }
+  int best = 0;
+  int i;
+  for (i = 1; i < n; i++) {
+    if (x[i] > x[best]) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+int16_t dsp_envelope16_scalar(const int16_t * x, int16_t * env, int n, int16_t e, int16_t decay) {
+  int i;
+  for (i = 0; i < n; i++) {
+    e = envelope_step(e, abs16(x[i]), decay);
+    env[i] = e;
+  }
+  return e;
+}
+
+static int first_equal(const int16_t * x, int16_t v) {
+  // The index of the first sample equal to v, which is known to be there
+
+  int i = 0;
+  while (x[i] != v) {
+    i++;
+  }
+  return i;
+}
+
+#if defined(DSP_M4)
+
+static inline uint32_t load2(const int16_t * p) {
+  // Two samples, x[0] in the low half; the M4 loads a word from any
+  // address, so memcpy compiles to one LDR
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline void store2(int16_t * p, uint32_t v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+const char * dsp_kernel_flavour() {
+  return "Cortex-M4 DSP";
+}
+
+void dsp_diff16(const int16_t * x, int16_t * d, int n, int16_t prev) {
+  uint32_t last = (uint16_t) prev;
+  // The sample before the pair, kept in a register since d may be x
+  int i;
+  for (i = 0; i + 1 < n; i += 2) {
+    uint32_t cur = load2(x + i);
+    uint32_t before = __PKHBT(last, cur, 16);
+    // x[i - 1] and x[i]
+    last = cur >> 16;
+    store2(d + i, __QSUB16(cur, before));
+  }
+  if (i < n) {
+    d[i] = saturate16((int32_t) x[i] - (int16_t) last);
+  }
+}
+
+int32_t dsp_sum16(const int16_t * x, int n) {
+  uint32_t sum = 0;
+  int i;
+  for (i = 0; i + 1 < n; i += 2) {
+    sum = __SMLAD(load2(x + i), 0x00010001U, sum);
+    // Both halves times 1, added in
+  }
+  if (i < n) {
+    sum += (uint32_t) (int32_t) x[i];
+  }
+  return (int32_t) sum;
+}
+
+void dsp_moving_sum16(const int16_t * x, int32_t * s, int n, int w) {
+  if (w < 1 || n < w) {
+    return;
+  }
+  uint32_t sum = (uint32_t) dsp_sum16(x, w);
+  s[0] = (int32_t) sum;
+  int i;
+  for (i = 1; i <= n - w; i++) {
+    uint32_t pair = __PKHBT((uint32_t) (uint16_t) x[i + w - 1], (uint32_t) (uint16_t) x[i - 1], 16);
+    sum = __SMLAD(pair, 0xFFFF0001U, sum);
+    // The sample coming in times 1 and the one going out times -1, in one
+    // instruction
+    s[i] = (int32_t) sum;
+  }
+}
+
+int dsp_peak16(const int16_t * x, int n) {
+  if (n <= 0) {
+    return -1;
+  }
+  if (n == 1) {
+    return 0;
+  }
+  uint32_t best = load2(x);
+  int i;
+  for (i = 2; i + 1 < n; i += 2) {
+    uint32_t v = load2(x + i);
+    __SSUB16(v, best);
+    best = __SEL(v, best);
+    // SSUB16 sets the GE flags of each half where v >= best, and SEL
+    // takes those halves from v
+  }
+  int16_t lo = (int16_t) best;
+  int16_t hi = (int16_t) (best >> 16);
+  int16_t top = lo > hi ? lo : hi;
+  if (i < n && x[i] > top) {
+    top = x[i];
+  }
+  return first_equal(x, top);
+}
+
+int16_t dsp_envelope16(const int16_t * x, int16_t * env, int n, int16_t e, int16_t decay) {
+  int i;
+  for (i = 0; i + 1 < n; i += 2) {
+    uint32_t v = load2(x + i);
+    uint32_t neg = __QSUB16(0, v);
+    __SSUB16(v, neg);
+    uint32_t a = __SEL(v, neg);
+    // |x| of both halves: the larger of x and the saturated -x
+    e = envelope_step(e, (int16_t) a, decay);
+    env[i] = e;
+    e = envelope_step(e, (int16_t) (a >> 16), decay);
+    env[i + 1] = e;
+    // Each sample depends on the one before, so only |x| goes in pairs
+  }
+  if (i < n) {
+    e = envelope_step(e, abs16(x[i]), decay);
+    env[i] = e;
+  }
+  return e;
+}
+
+#elif defined(DSP_SSE2)
+
+const char * dsp_kernel_flavour() {
+  return "SSE2";
+}
+
+void dsp_diff16(const int16_t * x, int16_t * d, int n, int16_t prev) {
+  __m128i last = _mm_cvtsi32_si128((uint16_t) prev);
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i cur = _mm_loadu_si128((const __m128i *) (x + i));
+    __m128i before = _mm_or_si128(_mm_slli_si128(cur, 2), last);
+    // x[i - 1] to x[i + 6], built from registers since d may be x
+    last = _mm_srli_si128(cur, 14);
+    _mm_storeu_si128((__m128i *) (d + i), _mm_subs_epi16(cur, before));
+  }
+  dsp_diff16_scalar(x + i, d + i, n - i, (int16_t) _mm_cvtsi128_si32(last));
+}
+
+int32_t dsp_sum16(const int16_t * x, int n) {
+  __m128i ones = _mm_set1_epi16(1);
+  __m128i acc = _mm_setzero_si128();
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (x + i)), ones));
+    // PMADDWD, the SSE2 counterpart of SMLAD
+  }
+  acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+  acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+  return _mm_cvtsi128_si32(acc) + dsp_sum16_scalar(x + i, n - i);
+}
+
+void dsp_moving_sum16(const int16_t * x, int32_t * s, int n, int w) {
+  dsp_moving_sum16_scalar(x, s, n, w);
+  // Each sum depends on the one before, and the compiler vectorizes the
+  // differences of the plain loop better than hand-written SSE2 did
+}
+
+int dsp_peak16(const int16_t * x, int n) {
+  if (n < 8) {
+    return dsp_peak16_scalar(x, n);
+  }
+  __m128i best = _mm_loadu_si128((const __m128i *) x);
+  int i;
+  for (i = 8; i + 8 <= n; i += 8) {
+    best = _mm_max_epi16(best, _mm_loadu_si128((const __m128i *) (x + i)));
+  }
+  best = _mm_max_epi16(best, _mm_srli_si128(best, 8));
+  best = _mm_max_epi16(best, _mm_srli_si128(best, 4));
+  best = _mm_max_epi16(best, _mm_srli_si128(best, 2));
+  int16_t top = (int16_t) _mm_cvtsi128_si32(best);
+  for (; i < n; i++) {
+    if (x[i] > top) {
+      top = x[i];
+    }
+  }
+  return first_equal(x, top);
+}
+
+int16_t dsp_envelope16(const int16_t * x, int16_t * env, int n, int16_t e, int16_t decay) {
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (x + i));
+    int16_t a[8];
+    _mm_storeu_si128((__m128i *) a, _mm_max_epi16(v, _mm_subs_epi16(_mm_setzero_si128(), v)));
+    int k;
+    for (k = 0; k < 8; k++) {
+      e = envelope_step(e, a[k], decay);
+      env[i + k] = e;
+    }
+  }
+  return dsp_envelope16_scalar(x + i, env + i, n - i, e, decay);
+}
+
+#else
+
+const char * dsp_kernel_flavour() {
+  return "scalar";
+}
+
+void dsp_diff16(const int16_t * x, int16_t * d, int n, int16_t prev) {
+  dsp_diff16_scalar(x, d, n, prev);
+}
+
+int32_t dsp_sum16(const int16_t * x, int n) {
+  return dsp_sum16_scalar(x, n);
+}
+
+void dsp_moving_sum16(const int16_t * x, int32_t * s, int n, int w) {
+  dsp_moving_sum16_scalar(x, s, n, w);
+}
+
+int dsp_peak16(const int16_t * x, int n) {
+  return dsp_peak16_scalar(x, n);
+}
+
+int16_t dsp_envelope16(const int16_t * x, int16_t * env, int n, int16_t e, int16_t decay) {
+  return dsp_envelope16_scalar(x, env, n, e, decay);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <stdint.h>
+
+// Block kernels on 16-bit samples in 1/256 mmHg, which hold +-128 mmHg:
+// an oscillation, or differences of one. The oscillometric engine finds
+// the largest beat of its envelope with dsp_peak16; it works out
+// everything else one sample at a time as the cuff deflates, so the other
+// kernels are there for analysis run over a whole block of samples
+// On the board (__ARM_FEATURE_DSP, the Cortex-M4) each one works on two
+// samples per instruction with the M4's packed halfword instructions:
+// QSUB16 for saturating differences, SMLAD to add or subtract a pair into
+// a 32-bit sum, and SSUB16 with SEL for a compare-and-select of both
+// halves at once. On the host they use SSE2 if the compiler targets it,
+// and plain C otherwise. The _scalar versions are the plain C ones, built
+// everywhere, which the others must match exactly
+// The pointers need no alignment and n may be odd
+
+void dsp_diff16(const int16_t * x, int16_t * d, int n, int16_t prev);
+// d[i] = x[i] - x[i - 1], saturated to -32768..32767, with prev as x[-1]
+// d may be x
+int32_t dsp_sum16(const int16_t * x, int n);
+// The sum of n samples; n up to 65536, so it can't overflow
+void dsp_moving_sum16(const int16_t * x, int32_t * s, int n, int w);
+// The sums of every w samples in a row: s[i] = x[i] + ... + x[i + w - 1]
+// for i from 0 to n - w, so s holds n - w + 1 sums (none if n < w)
+int dsp_peak16(const int16_t * x, int n);
+// The index of the largest sample, the first one if several are equal;
+// -1 if n is 0
+int16_t dsp_envelope16(const int16_t * x, int16_t * env, int n, int16_t e, int16_t decay);
+// Follows the peaks of |x|: e = max(|x[i]|, e - decay), so the envelope
+// jumps up to each peak and falls by decay a sample after it; env[i] is
+// e after sample i, and the last e is returned to pass in with the next
+// block. |-32768| is 32767, and decay must not be negative
+const char * dsp_kernel_flavour();
+// Which version the functions above are: "Cortex-M4 DSP", "SSE2" or
+// "scalar"
+
+void dsp_diff16_scalar(const int16_t * x, int16_t * d, int n, int16_t prev);
+int32_t dsp_sum16_scalar(const int16_t * x, int n);
+void dsp_moving_sum16_scalar(const int16_t * x, int32_t * s, int n, int w);
+int dsp_peak16_scalar(const int16_t * x, int n);
+int16_t dsp_envelope16_scalar(const int16_t * x, int16_t * env, int n, int16_t e, int16_t decay);
+
+#endif
@@ -0,0 +1,235 @@
+#include "eeprom.h"
+
+#ifdef __MBED__
+
+#include "drivers/stm32f429i_discovery_eeprom.h"
+
+bool eeprom_init() {
+  return BSP_EEPROM_Init() == EEPROM_OK;
+}
+
+int eeprom_read(uint16_t addr, uint8_t * data, uint16_t len) {
+  uint16_t n = len;
+  // The driver takes the length by pointer and zeroes it when done
+  return BSP_EEPROM_ReadBuffer(data, addr, &n) == EEPROM_OK ? 0 : -1;
+}
+
+int eeprom_write(uint16_t addr, const uint8_t * data, uint16_t len) {
+  return BSP_EEPROM_WriteBuffer((uint8_t *) data, addr, len) == EEPROM_OK ? 0 : -1;
+}
+
+extern "C" volatile uint16_t EEPROMAddress;
+// Set by BSP_EEPROM_Init to whichever address the chip answered on
+
+uint8_t eeprom_address() {
+  return (uint8_t) EEPROMAddress;
+}
+
+#else
+
+#include <stdio.h>
+#include <string.h>
+#include "platform.h"
+
+static uint8_t memory[EEPROM_BYTES];
+static FILE * file = NULL;
+static uint32_t page_writes[EEPROM_BYTES / EEPROM_PAGE_BYTES];
+static uint32_t reads = 0;
+static int32_t writes_left = -1;
+
+bool eeprom_use_file(const char * path) {
+  if (file != NULL) {
+    fclose(file);
+  }
+  file = fopen(path, "r+b");
+  if (file == NULL) {
+    file = fopen(path, "w+b");
+    if (file == NULL) {
+      return false;
+    }
+    memset(memory, 0xFF, sizeof(memory));
+    fwrite(memory, 1, sizeof(memory), file);
+    fflush(file);
+  }
+  return true;
+}
+
+bool eeprom_init() {
+  memset(memory, 0xFF, sizeof(memory));
+  if (file != NULL) {
+    rewind(file);
+    if (fread(memory, 1, sizeof(memory), file) != sizeof(memory)) {
+      return false;
+    }
+  }
+  memset(page_writes, 0, sizeof(page_writes));
+  reads = 0;
+  writes_left = -1;
+  return true;
+}
+
+void eeprom_host_erase() {
+  memset(memory, 0xFF, sizeof(memory));
+  if (file != NULL) {
+    rewind(file);
+    fwrite(memory, 1, sizeof(memory), file);
+    fflush(file);
+  }
+}
+
+uint8_t eeprom_address() {
+  return 0xA0;
+  // EEPROM_I2C_ADDRESS_A01 in the BSP driver
+}
+
+static void program(uint16_t addr, const uint8_t * data, uint16_t n) {
+  // One write cycle; addr to addr + n stays within a page
+
+  if (writes_left == 0) {
+    return;
+  }
+  memcpy(memory + addr, data, n);
+  if (file != NULL) {
+    fseek(file, addr, SEEK_SET);
+    fwrite(data, 1, n, file);
+  }
+  page_writes[addr / EEPROM_PAGE_BYTES]++;
+  if (writes_left > 0) {
+    writes_left--;
+  }
+}
+
+int eeprom_read(uint16_t addr, uint8_t * data, uint16_t len) {
+  if ((uint32_t) addr + len > EEPROM_BYTES) {
+    return -1;
+  }
+  memcpy(data, memory + addr, len);
+  reads++;
+  return 0;
+}
+
+int eeprom_write(uint16_t addr, const uint8_t * data, uint16_t len) {
+  if ((uint32_t) addr + len > EEPROM_BYTES) {
+    return -1;
+  }
+
+  while (len > 0) {
+    uint16_t n = EEPROM_PAGE_BYTES - addr % EEPROM_PAGE_BYTES;
+    if (n > len) {
+      n = len;
+    }
+    // A write cycle can't cross a page boundary
+    program(addr, data, n);
+    host_clock_advance_us(EEPROM_PAGE_WRITE_US);
+    addr += n;
+    data += n;
+    len -= n;
+  }
+  if (file != NULL) {
+    fflush(file);
+  }
+  return 0;
+}
+
+uint32_t eeprom_host_page_writes(uint32_t page) {
+  return page < EEPROM_BYTES / EEPROM_PAGE_BYTES ? page_writes[page] : 0;
+}
+
+uint32_t eeprom_host_reads() {
+  return reads;
+}
+
+void eeprom_host_fail_after(int32_t pages) {
+  writes_left = pages;
+}
+
+#define EEPROM_BUS_BYTE_US 23
+// A byte plus its ACK bit at 400 kHz
+
+class HostEepromBus : public PressureBus {
+public:
+  HostEepromBus() : pointer(0), busy_until_us(0), cb(NULL), ctx(NULL), result(0) {}
+
+  int write(uint8_t addr, const uint8_t * data, int len) override {
+    if ((addr & ~1U) != eeprom_address() || (addr & 1U) || platform_now_us() < busy_until_us) {
+      return -1;
+      // Nothing answers, or the chip is programming a page
+    }
+    if (len < 2) {
+      return len == 0 ? 0 : -1;
+    }
+    pointer = (uint16_t) (((data[0] << 8U) | data[1]) % EEPROM_BYTES);
+    if (len > 2) {
+      uint8_t page[EEPROM_PAGE_BYTES];
+      uint16_t base = pointer - pointer % EEPROM_PAGE_BYTES;
+      memcpy(page, memory + base, sizeof(page));
+      int i;
+      for (i = 2; i < len; i++) {
+        page[(pointer + i - 2) % EEPROM_PAGE_BYTES] = data[i];
+        // Bytes past the end of the page wrap round to its start
+      }
+      program(base, page, sizeof(page));
+      if (file != NULL) {
+        fflush(file);
+      }
+      busy_until_us = platform_now_us() + EEPROM_PAGE_WRITE_US;
+    }
+    return 0;
+  }
+
+  int read(uint8_t addr, uint8_t * data, int len) override {
+    if ((addr & ~1U) != eeprom_address() || !(addr & 1U) || platform_now_us() < busy_until_us) {
+      return -1;
+    }
+    int i;
+    for (i = 0; i < len; i++) {
+      data[i] = memory[pointer];
+      pointer = (uint16_t) ((pointer + 1) % EEPROM_BYTES);
+    }
+    reads++;
+    return 0;
+  }
+
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override {
+    if (this->cb != NULL) {
+      return -1;
+    }
+    int bytes = 0;
+    result = 0;
+    if (tx_len > 0) {
+      result = write(addr & ~1U, tx, tx_len);
+      bytes += 1 + tx_len;
+    }
+    if (result == 0 && rx_len > 0) {
+      result = read(addr | 1U, rx, rx_len);
+      bytes += 1 + rx_len;
+    }
+    this->cb = cb;
+    this->ctx = ctx;
+    timer.attach_once_us(&HostEepromBus::on_done, this, (bytes ? bytes : 1) * EEPROM_BUS_BYTE_US);
+    return 0;
+  }
+
+private:
+  static void on_done(void * ctx) {
+    HostEepromBus * bus = (HostEepromBus *) ctx;
+    bus_callback_t cb = bus->cb;
+    bus->cb = NULL;
+    cb(bus->ctx, bus->result);
+  }
+
+  uint16_t pointer;
+  uint64_t busy_until_us;
+  PlatformTimer timer;
+  bus_callback_t cb;
+  void * ctx;
+  int result;
+};
+
+PressureBus * eeprom_host_bus() {
+  static HostEepromBus bus;
+  return &bus;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stdint.h>
+#include "pressure_bus.h"
+
+// The M24LR64 I2C EEPROM the BSP driver talks to
+// On the board it hangs off I2C3, the same bus as the pressure sensor, so
+// these functions may not be called while a sensor transfer is in flight
+// (see pause_acquisition in sensor.h); EepromWriter writes through the
+// sensor's SharedBus instead. On the host it is a file, or memory if no
+// file was given
+
+#define EEPROM_BYTES 0x2000
+// EEPROM_MAX_SIZE in the BSP driver (64 kbit)
+#define EEPROM_PAGE_BYTES 4
+// EEPROM_PAGESIZE: one write cycle programs at most one page
+#define EEPROM_PAGE_WRITE_US 5000
+// How long the chip takes to program a page
+
+bool eeprom_init();
+// Finds the chip on the bus; returns false if it doesn't answer
+int eeprom_read(uint16_t addr, uint8_t * data, uint16_t len);
+// Reads len bytes starting at addr; returns 0 on success
+int eeprom_write(uint16_t addr, const uint8_t * data, uint16_t len);
+// Writes len bytes starting at addr, a page at a time, and waits for 
+// every page to be programmed; returns 0 on success
+uint8_t eeprom_address();
+// The chip's 8-bit I2C address, for writing to it over a PressureBus (see
+// EepromWriter); valid after eeprom_init
+
+#ifndef __MBED__
+bool eeprom_use_file(const char * path);
+// Keeps the EEPROM contents in path, creating it erased (all 0xFF) if it
+// doesn't exist; call it before eeprom_init
+void eeprom_host_erase();
+// Sets every byte to 0xFF
+uint32_t eeprom_host_page_writes(uint32_t page);
+// How many times a page has been programmed since eeprom_init
+uint32_t eeprom_host_reads();
+// Read transactions since eeprom_init
+void eeprom_host_fail_after(int32_t pages);
+// Simulates a power cut: after this many more page writes, writes stop
+// taking effect (and report success, as the chip would never answer); 
+// -1 turns it off
+PressureBus * eeprom_host_bus();
+// The chip as a device on an I2C bus, sharing the stand-in's memory: a
+// write sets the address pointer from its first two bytes and programs
+// the rest into that page, wrapping round within it, and the chip then
+// doesn't answer for EEPROM_PAGE_WRITE_US; a read starts at the pointer
+// Transfers complete on the simulated clock like TraceReplayBus's
+#endif
+
+#endif
@@ -0,0 +1,240 @@
+#include <string.h>
+#include "eeprom_writer.h"
+
+EepromWriter::EepromWriter(PressureBus * bus)
+    : bus(bus), chip(0), used_slots(0), page_head(0), page_tail(0), writing(false), polls(0),
+      bus_result(0), submitted(0), completed(0), deepest(0), last_latency(0), worst_latency(0),
+      total_latency(0), pages_written(0), pages_merged(0), failed(0) {}
+
+void EepromWriter::begin(uint8_t addr) {
+  chip = addr;
+}
+
+int EepromWriter::write(uint16_t addr, const uint8_t * data, uint16_t len,
+                        eeprom_callback_t cb, void * ctx) {
+  if (len == 0 || len > EEPROM_REQUEST_BYTES || (uint32_t) addr + len > EEPROM_BYTES) {
+    return -1;
+  }
+
+  Request r;
+  r.addr = addr;
+  r.len = (uint8_t) len;
+  memcpy(r.data, data, len);
+  r.cb = cb;
+  r.ctx = ctx;
+  r.queued_us = (uint32_t) platform_now_us();
+  if (!requests.push(r)) {
+    return -1;
+  }
+  submitted++;
+  if (depth() > deepest) {
+    deepest = depth();
+  }
+  platform_defer(&EepromWriter::pump, this);
+  return 0;
+}
+
+uint32_t EepromWriter::mean_latency_us() const {
+  return completed ? (uint32_t) (total_latency / completed) : 0;
+}
+
+void EepromWriter::pump(void * ctx) {
+  // Takes new writes off the queue and starts the next page write; runs
+  // on the acquisition thread
+
+  EepromWriter * w = (EepromWriter *) ctx;
+  w->admit();
+  w->start_next();
+}
+
+void EepromWriter::admit() {
+  // Splits queued writes into page writes while there is room for them
+
+  while (requests.size() > 0 && used_slots != (1U << EEPROM_REQUEST_QUEUE) - 1
+         && EEPROM_QUEUE_PAGES - (page_tail - page_head) >= EEPROM_REQUEST_BYTES / EEPROM_PAGE_BYTES + 1) {
+    Request r;
+    requests.pop(r);
+    int slot = 0;
+    while (used_slots & (1U << slot)) {
+      slot++;
+    }
+    used_slots |= (uint8_t) (1U << slot);
+    Pending & p = pending[slot];
+    p.cb = r.cb;
+    p.ctx = r.ctx;
+    p.queued_us = r.queued_us;
+    p.pages = 0;
+    p.result = 0;
+
+    uint16_t addr = r.addr;
+    const uint8_t * data = r.data;
+    int left = r.len;
+    while (left > 0) {
+      uint8_t n = (uint8_t) (EEPROM_PAGE_BYTES - addr % EEPROM_PAGE_BYTES);
+      if (n > left) {
+        n = (uint8_t) left;
+      }
+      add_page(slot, addr, data, n);
+      addr += n;
+      data += n;
+      left -= n;
+    }
+  }
+}
+
+void EepromWriter::add_page(int slot, uint16_t addr, const uint8_t * data, uint8_t len) {
+  // Merges the bytes into the newest waiting write to the same page if
+  // the result is still one run of bytes, or queues a new page write
+  // Only the newest: an older one runs before it, so merging there would
+  // let the newest write put back stale bytes where the two overlap
+
+  uint16_t page = addr / EEPROM_PAGE_BYTES;
+  uint32_t first = page_head + (writing ? 1 : 0);
+  // The write in progress can't change any more
+  uint32_t i;
+  for (i = page_tail; i != first; i--) {
+    PageWrite & pw = pages[(i - 1) % EEPROM_QUEUE_PAGES];
+    if (pw.addr / EEPROM_PAGE_BYTES != page) {
+      continue;
+    }
+    if (addr > pw.addr + pw.len || pw.addr > addr + len) {
+      break;
+      // There would be a gap between the two runs
+    }
+    uint16_t start = pw.addr < addr ? pw.addr : addr;
+    uint16_t end = pw.addr + pw.len > addr + len ? pw.addr + pw.len : addr + len;
+    uint8_t merged[EEPROM_PAGE_BYTES];
+    memcpy(merged + (pw.addr - start), pw.data, pw.len);
+    memcpy(merged + (addr - start), data, len);
+    // The newer bytes win where the two overlap
+    memcpy(pw.data, merged, end - start);
+    pw.addr = start;
+    pw.len = (uint8_t) (end - start);
+    if (!(pw.owners & (1U << slot))) {
+      pw.owners |= (uint8_t) (1U << slot);
+      pending[slot].pages++;
+    }
+    pages_merged++;
+    return;
+  }
+
+  PageWrite & pw = pages[page_tail % EEPROM_QUEUE_PAGES];
+  pw.addr = addr;
+  pw.len = len;
+  memcpy(pw.data, data, len);
+  pw.owners = (uint8_t) (1U << slot);
+  pending[slot].pages++;
+  page_tail++;
+}
+
+void EepromWriter::start_next() {
+  if (writing || page_head == page_tail) {
+    return;
+  }
+
+  PageWrite & pw = pages[page_head % EEPROM_QUEUE_PAGES];
+  tx[0] = (uint8_t) (pw.addr >> 8U);
+  tx[1] = (uint8_t) pw.addr;
+  // The memory address goes first, most significant byte first
+  memcpy(tx + 2, pw.data, pw.len);
+  writing = true;
+  polls = 0;
+  if (bus->transfer(chip, tx, 2 + pw.len, NULL, 0, &EepromWriter::on_write_done, this) != 0) {
+    bus_result = -1;
+    timer.attach_once_us(&EepromWriter::on_timer, this, EEPROM_POLL_US);
+    // Fail it from the timer rather than from inside pump
+  }
+}
+
+void EepromWriter::on_write_done(void * ctx, int result) {
+  // Called from the I2C interrupt once the bytes are in the chip
+
+  EepromWriter * w = (EepromWriter *) ctx;
+  w->bus_result = result;
+  if (result != 0) {
+    platform_defer(&EepromWriter::poll, w);
+    return;
+  }
+  w->timer.attach_once_us(&EepromWriter::on_timer, w, EEPROM_PAGE_WRITE_US);
+  // The chip ignores the bus until it has programmed the page
+}
+
+void EepromWriter::on_timer(void * ctx) {
+  platform_defer(&EepromWriter::poll, ctx);
+}
+
+void EepromWriter::poll(void * ctx) {
+  // Asks the chip whether it has finished the page; it only answers its
+  // address once it has
+
+  EepromWriter * w = (EepromWriter *) ctx;
+  if (w->bus_result != 0) {
+    w->page_done(-1);
+    pump(w);
+    return;
+  }
+  if (w->bus->transfer(w->chip, NULL, 0, w->rx, 1, &EepromWriter::on_poll_done, w) != 0) {
+    w->timer.attach_once_us(&EepromWriter::on_timer, w, EEPROM_POLL_US);
+    // The bus queue is full; try again later
+  }
+}
+
+void EepromWriter::on_poll_done(void * ctx, int result) {
+  // Called from the I2C interrupt
+
+  EepromWriter * w = (EepromWriter *) ctx;
+  if (result == 0) {
+    platform_defer(&EepromWriter::on_programmed, w);
+    return;
+  }
+  if (++w->polls >= EEPROM_MAX_POLLS) {
+    w->bus_result = -1;
+    platform_defer(&EepromWriter::poll, w);
+    return;
+  }
+  w->timer.attach_once_us(&EepromWriter::on_timer, w, EEPROM_POLL_US);
+}
+
+void EepromWriter::on_programmed(void * ctx) {
+  EepromWriter * w = (EepromWriter *) ctx;
+  w->page_done(0);
+  pump(w);
+}
+
+void EepromWriter::page_done(int result) {
+  // Retires the page write at page_head and completes every write that
+  // was only waiting for it
+
+  PageWrite & pw = pages[page_head % EEPROM_QUEUE_PAGES];
+  page_head++;
+  writing = false;
+  pages_written++;
+  if (result != 0) {
+    failed++;
+  }
+
+  int slot;
+  for (slot = 0; slot < EEPROM_REQUEST_QUEUE; slot++) {
+    if (!(pw.owners & (1U << slot))) {
+      continue;
+    }
+    Pending & p = pending[slot];
+    if (result != 0) {
+      p.result = result;
+    }
+    if (--p.pages > 0) {
+      continue;
+    }
+    uint32_t latency = (uint32_t) platform_now_us() - p.queued_us;
+    last_latency = latency;
+    if (latency > worst_latency) {
+      worst_latency = latency;
+    }
+    total_latency += latency;
+    used_slots &= (uint8_t) ~(1U << slot);
+    completed++;
+    if (p.cb != NULL) {
+      p.cb(p.ctx, p.result);
+    }
+  }
+}
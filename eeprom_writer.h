@@ -0,0 +1,128 @@
+#ifndef EEPROM_WRITER_H
+#define EEPROM_WRITER_H
+
+#include <stdint.h>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sample_ring.h"
+#include "eeprom.h"
+
+#define EEPROM_REQUEST_BYTES 16
+// The most one write can carry: a history record
+#define EEPROM_REQUEST_QUEUE 8
+// Writes that can be waiting at once
+#define EEPROM_QUEUE_PAGES 16
+// Page writes that can be waiting at once; a 16-byte write that doesn't
+// start on a page boundary spans 5 pages
+#define EEPROM_POLL_US 1000
+// How often to ask the chip whether it is done programming once the 
+// nominal write time has passed
+#define EEPROM_MAX_POLLS 20
+
+typedef void (*eeprom_callback_t)(void * ctx, int result);
+// Called when a write has been programmed; result is 0 on success
+
+// Writes to the EEPROM in the background, through the bus the pressure
+// sensor uses (a SharedBus), so the measurement never waits for it
+// write only copies the bytes into a queue and returns. The acquisition
+// thread splits each write into page writes, sends them one at a time
+// between sensor transfers, and, while the chip programs a page, waits
+// on a timer instead of polling the bus in a loop. Bytes for a page that
+// is still waiting are merged into its page write instead of making
+// another 5 ms write cycle
+class EepromWriter {
+public:
+  explicit EepromWriter(PressureBus * bus);
+  void begin(uint8_t addr);
+  // Sets the chip's 8-bit I2C address (eeprom_address once eeprom_init
+  // has found the chip); call it before the first write
+  int write(uint16_t addr, const uint8_t * data, uint16_t len, eeprom_callback_t cb, void * ctx);
+  // Queues len bytes (at most EEPROM_REQUEST_BYTES) for addr and calls
+  // cb(ctx, result) on the acquisition thread once they are programmed;
+  // cb may be NULL. Called from main only
+  // Returns non-zero if the queue is full
+  uint32_t depth() const { return submitted - completed; }
+  // Writes queued or in progress
+  uint32_t max_depth() const { return deepest; }
+  bool idle() const { return depth() == 0; }
+  uint32_t last_latency_us() const { return last_latency; }
+  uint32_t max_latency_us() const { return worst_latency; }
+  uint32_t mean_latency_us() const;
+  // From write to the callback
+  uint32_t writes() const { return completed; }
+  uint32_t page_writes() const { return pages_written; }
+  uint32_t merged() const { return pages_merged; }
+  // Page writes saved by merging
+  uint32_t errors() const { return failed; }
+
+private:
+  struct Request {
+    uint16_t addr;
+    uint8_t len;
+    uint8_t data[EEPROM_REQUEST_BYTES];
+    eeprom_callback_t cb;
+    void * ctx;
+    uint32_t queued_us;
+  };
+
+  struct Pending {
+    eeprom_callback_t cb;
+    void * ctx;
+    uint32_t queued_us;
+    int pages;
+    // The page writes it is still waiting for
+    int result;
+  };
+
+  struct PageWrite {
+    uint16_t addr;
+    // Where the bytes go; they never cross a page boundary
+    uint8_t len;
+    uint8_t data[EEPROM_PAGE_BYTES];
+    uint8_t owners;
+    // The Pending slots waiting for this page write
+  };
+
+  static void pump(void * ctx);
+  static void on_write_done(void * ctx, int result);
+  static void on_timer(void * ctx);
+  static void poll(void * ctx);
+  static void on_poll_done(void * ctx, int result);
+  static void on_programmed(void * ctx);
+  void admit();
+  void add_page(int slot, uint16_t addr, const uint8_t * data, uint8_t len);
+  void start_next();
+  void page_done(int result);
+
+  PressureBus * bus;
+  uint8_t chip;
+  SpscRing<Request, EEPROM_REQUEST_QUEUE> requests;
+  // From main to the acquisition thread
+  Pending pending[EEPROM_REQUEST_QUEUE];
+  uint8_t used_slots;
+  // A bit per busy Pending slot
+  PageWrite pages[EEPROM_QUEUE_PAGES];
+  uint32_t page_head;
+  uint32_t page_tail;
+  // Waiting page writes, oldest (possibly in progress) at page_head
+  volatile bool writing;
+  // A page write is on the bus or being programmed
+  int polls;
+  PlatformTimer timer;
+  uint8_t tx[2 + EEPROM_PAGE_BYTES];
+  uint8_t rx[1];
+  volatile int bus_result;
+
+  uint32_t submitted;
+  // Written by main only
+  volatile uint32_t completed;
+  uint32_t deepest;
+  volatile uint32_t last_latency;
+  volatile uint32_t worst_latency;
+  uint64_t total_latency;
+  uint32_t pages_written;
+  uint32_t pages_merged;
+  uint32_t failed;
+};
+
+#endif
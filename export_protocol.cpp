@@ -0,0 +1,73 @@
+#include <string.h>
+#include "export_protocol.h"
+
+int build_frame(uint8_t * out, uint8_t type, uint8_t seq, const uint8_t * payload, int len) {
+  out[0] = EXPORT_SYNC_0;
+  out[1] = EXPORT_SYNC_1;
+  out[2] = type;
+  out[3] = seq;
+  put_u16(out + 4, (uint16_t) len);
+  uint8_t * body = out + EXPORT_HEADER_BYTES;
+  int i;
+  if (payload != body) {
+    for (i = 0; i < len; i++) {
+      body[i] = payload[i];
+    }
+  }
+  put_u16(body + len, crc16_ccitt(out + 2, len + EXPORT_HEADER_BYTES - 2));
+  return len + EXPORT_HEADER_BYTES + 2;
+}
+
+FrameParser::FrameParser() : have(0), used(0), bad_crc(0), junk(0) {}
+
+bool FrameParser::feed(uint8_t byte) {
+  if (used > 0) {
+    drop(used);
+    used = 0;
+    // The caller is done with the last frame
+  }
+  frame[have++] = byte;
+  return scan();
+}
+
+bool FrameParser::scan() {
+  // Looks for a whole frame at the start of the bytes kept, and drops
+  // what can't be the start of one
+
+  while (true) {
+    int start = 0;
+    while (start < have && !(frame[start] == EXPORT_SYNC_0 &&
+                             (start + 1 == have || frame[start + 1] == EXPORT_SYNC_1))) {
+      start++;
+    }
+    junk += start;
+    drop(start);
+    if (have < EXPORT_HEADER_BYTES) {
+      return false;
+    }
+
+    int len = length();
+    if (len <= EXPORT_MAX_PAYLOAD) {
+      int size = EXPORT_HEADER_BYTES + len + 2;
+      if (have < size) {
+        return false;
+      }
+      uint16_t crc = crc16_ccitt(frame + 2, len + EXPORT_HEADER_BYTES - 2);
+      if (crc == get_u16(frame + EXPORT_HEADER_BYTES + len)) {
+        used = size;
+        return true;
+        // Any bytes after it are looked at on the next call
+      }
+    }
+    // No frame is that long, or the CRC is wrong: the sync bytes were
+    // part of the data or the frame was damaged, and the next frame may
+    // already be in the bytes received since
+    bad_crc++;
+    drop(2);
+  }
+}
+
+void FrameParser::drop(int n) {
+  have -= n;
+  memmove(frame, frame + n, have);
+}
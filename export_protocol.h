@@ -0,0 +1,109 @@
+#ifndef EXPORT_PROTOCOL_H
+#define EXPORT_PROTOCOL_H
+
+#include <stdint.h>
+#include "sample_codec.h"
+#include "crc.h"
+
+// The binary format sessions are sent to a computer in, over the serial
+// port of the ST-LINK (see session_export.h)
+// Every frame is:
+//   0xA5 0x5A  sync bytes
+//   type       an ExportFrameType
+//   seq        counts up by one per frame sent, so lost frames show
+//   length     payload bytes, 16 bits
+//   payload
+//   crc        CRC-16/CCITT-FALSE of type, seq, length and payload
+// Multi-byte fields are little-endian
+// A receiver that joins in the middle, or sees a bad CRC, looks for the
+// next sync bytes and carries on from there
+
+#define EXPORT_SYNC_0 0xA5
+#define EXPORT_SYNC_1 0x5A
+#define EXPORT_VERSION 1
+#define EXPORT_HEADER_BYTES 6
+#define EXPORT_SAMPLES_PER_FRAME 64
+#define EXPORT_MAX_PAYLOAD (6 + EXPORT_SAMPLES_PER_FRAME * SAMPLE_MAX_ENCODED)
+#define EXPORT_MAX_FRAME (EXPORT_HEADER_BYTES + EXPORT_MAX_PAYLOAD + 2)
+
+enum ExportFrameType {
+  FRAME_SESSION_START = 1,
+  // u8 version, u8 reserved, u16 sample rate in Hz, u32 session number,
+  // u32 samples that follow
+  FRAME_SAMPLES = 2,
+  // u32 index of the first sample, u16 samples, then the samples coded
+  // by a SampleEncoder that starts over in every frame
+  FRAME_RESULTS = 3,
+  // i16 heart rate, i16 systolic, i16 diastolic, u16 flags
+  // (EXPORT_RESULTS_VALID is clear if the measurement timed out)
+  FRAME_SESSION_END = 4,
+  // u32 samples sent, u32 samples the recorder had to drop
+  FRAME_TELEMETRY = 5,
+  // Sent live during a measurement (see telemetry.h), with its own seq:
+  // u32 index of the first sample, u32 frames dropped so far, u8 samples,
+  // u8 beats, then for each beat u32 time and i32 pressure (pressure_t),
+  // then the samples coded like FRAME_SAMPLES
+  FRAME_SET_CLOCK = 6
+  // The other way, from the computer to the board: u32 seconds since
+  // 1970 (UTC), which the board sets its real-time clock to before the
+  // next measurement
+};
+
+#define EXPORT_RESULTS_VALID 1
+
+static inline void put_u16(uint8_t * out, uint16_t v) {
+  out[0] = (uint8_t) v;
+  out[1] = (uint8_t) (v >> 8U);
+}
+
+static inline void put_u32(uint8_t * out, uint32_t v) {
+  put_u16(out, (uint16_t) v);
+  put_u16(out + 2, (uint16_t) (v >> 16U));
+}
+
+static inline uint16_t get_u16(const uint8_t * in) {
+  return (uint16_t) (in[0] | (in[1] << 8U));
+}
+
+static inline uint32_t get_u32(const uint8_t * in) {
+  return get_u16(in) | ((uint32_t) get_u16(in + 2) << 16U);
+}
+
+int build_frame(uint8_t * out, uint8_t type, uint8_t seq, const uint8_t * payload, int len);
+// Wraps len bytes of payload (at most EXPORT_MAX_PAYLOAD) into a frame in
+// out, which needs room for len + 8 bytes; returns the frame size
+// payload may already sit at out + EXPORT_HEADER_BYTES
+
+// Picks frames out of a stream of bytes, one byte at a time
+class FrameParser {
+public:
+  FrameParser();
+  bool feed(uint8_t byte);
+  // Returns true when byte completes a frame with a good CRC; the frame
+  // can then be read until the next call
+  // After a damaged frame it looks again from just past its sync bytes,
+  // so a good frame that started inside it isn't lost
+  uint8_t type() const { return frame[2]; }
+  uint8_t seq() const { return frame[3]; }
+  int length() const { return get_u16(frame + 4); }
+  const uint8_t * payload() const { return frame + EXPORT_HEADER_BYTES; }
+  uint32_t crc_errors() const { return bad_crc; }
+  // Frames thrown away because their CRC didn't match
+  uint32_t skipped() const { return junk; }
+  // Bytes thrown away while looking for the sync bytes
+
+private:
+  bool scan();
+  void drop(int n);
+
+  uint8_t frame[EXPORT_MAX_FRAME];
+  int have;
+  // The bytes received so far from the start of the current frame, which
+  // may run on into the next one
+  int used;
+  // The size of the frame feed last returned, dropped on the next call
+  uint32_t bad_crc;
+  uint32_t junk;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "heart_rate.h"
+
+void HeartRateEstimator::reset() {
+  started = false;
+  last_us = 0;
+  count = 0;
+  head = 0;
+  run = 0;
+  run_min = 0;
+  run_max = 0;
+  history = 0;
+  decisions = 0;
+  good = 0;
+  bad = 0;
+}
+
+bool HeartRateEstimator::beat(uint32_t time_us) {
+  if (!started) {
+    started = true;
+    last_us = time_us;
+    return false;
+  }
+
+  uint32_t interval = time_us - last_us;
+  uint32_t estimate = interval_us();
+  bool checked = count >= 3 && run < HR_RESEED_AFTER;
+  uint32_t tolerance = estimate * HR_TOLERANCE / 256;
+  bool extra = interval < HR_MIN_INTERVAL_US || (checked && interval + tolerance < estimate);
+  bool missed = interval > HR_MAX_INTERVAL_US || (checked && interval > estimate + tolerance);
+  history = (uint16_t) ((history << 1) | (extra || missed ? 1 : 0));
+  if (decisions < 16) {
+    decisions++;
+  }
+  last_us = time_us;
+  if (extra || missed) {
+    bad++;
+    uint32_t low = run > 0 && run_min < interval ? run_min : interval;
+    uint32_t high = run > 0 && run_max > interval ? run_max : interval;
+    if (run > 0 && high - low > high * HR_TOLERANCE / 256) {
+      run = 0;
+      low = high = interval;
+      // Rejects that don't agree with each other are noise, not a new rate
+    }
+    run_min = low;
+    run_max = high;
+    run++;
+    return false;
+  }
+
+  if (run >= HR_RESEED_AFTER) {
+    count = 0;
+    head = 0;
+    // The old intervals no longer describe the rate
+  }
+  run = 0;
+  good++;
+  add(interval);
+  return true;
+}
+
+void HeartRateEstimator::add(uint32_t interval) {
+  int n = count;
+  if (count == HR_WINDOW) {
+    uint32_t old = ring[head];
+    ring[head] = interval;
+    head = (head + 1) % HR_WINDOW;
+    int j = 0;
+    while (sorted[j] != old) {
+      j++;
+    }
+    for (; j < count - 1; j++) {
+      sorted[j] = sorted[j + 1];
+    }
+    n = count - 1;
+    // The oldest interval is out of the sorted copy
+  } else {
+    ring[count] = interval;
+    count++;
+  }
+  int i = n;
+  while (i > 0 && sorted[i - 1] > interval) {
+    sorted[i] = sorted[i - 1];
+    i--;
+  }
+  sorted[i] = interval;
+}
+
+uint32_t HeartRateEstimator::interval_us() const {
+  if (count == 0) {
+    return 0;
+  }
+  int trim = count / 4;
+  uint32_t sum = 0;
+  int i;
+  for (i = trim; i < count - trim; i++) {
+    sum += sorted[i];
+  }
+  int n = count - 2 * trim;
+  return (sum + n / 2) / n;
+}
+
+int HeartRateEstimator::bpm() const {
+  uint32_t estimate = interval_us();
+  if (estimate == 0) {
+    return 0;
+  }
+  return (int) ((60000000U + estimate / 2) / estimate);
+}
+
+int HeartRateEstimator::confidence() const {
+  if (count < 3) {
+    return 0;
+  }
+  uint32_t estimate = interval_us();
+  uint32_t spread = (sorted[count * 3 / 4] - sorted[count / 4]) * 256 / estimate;
+  // The interquartile range in 1/256 of the estimate
+  int c = spread >= HR_TOLERANCE ? 0 : (int) (100 - spread * 100 / HR_TOLERANCE);
+  // 100 for a steady rhythm, 0 once the middle half of the intervals
+  // spreads as wide as the tolerance
+  int rejects = 0;
+  int i;
+  for (i = 0; i < decisions; i++) {
+    rejects += (history >> i) & 1;
+  }
+  return c * (decisions - rejects) / decisions;
+}
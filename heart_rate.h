@@ -0,0 +1,74 @@
+#ifndef HEART_RATE_H
+#define HEART_RATE_H
+
+#include <stdint.h>
+
+#define HR_WINDOW 9
+// The intervals the estimate is taken over: about 7 s at 75 bpm, long
+// enough that one bad interval can't move it, short enough to follow a
+// change in the rate during a deflation
+#define HR_MIN_INTERVAL_US 300000
+#define HR_MAX_INTERVAL_US 2000000
+// 200 and 30 bpm; anything outside isn't one heart beat
+#define HR_TOLERANCE 64
+// How far an interval may be from the estimate and still count, in 1/256
+// of the estimate (25%)
+#define HR_RESEED_AFTER 6
+// This many rejected intervals in a row that agree with each other mean
+// the rate itself has changed; the window starts again from the next
+// interval
+
+// Works out the heart rate from the times of the beats, one beat at a
+// time, in constant memory
+// Each interval between two beats is checked against the estimate from
+// the last HR_WINDOW intervals that counted, and dropped if it is more
+// than HR_TOLERANCE shorter (an extra beat: a movement, or noise at a low
+// pressure) or longer (a missed beat). Until there are 3 intervals, any
+// between 30 and 200 bpm counts
+// The estimate is a trimmed mean: the intervals kept are sorted and the
+// shortest and longest quarter left out, so one outlier can't move it,
+// and the rest are averaged, which gets finer than the sample period the
+// beats are timed to. The rate is 60 s over it, rounded
+// The confidence, from 0 to 100, goes down with the spread of the
+// intervals kept (their interquartile range against the estimate) and
+// with the share of the last 16 intervals that were dropped, and is 0
+// until there are 3 intervals
+// Each beat costs a sorted insert into HR_WINDOW values
+class HeartRateEstimator {
+public:
+  HeartRateEstimator() { reset(); }
+  void reset();
+  bool beat(uint32_t time_us);
+  // Adds a beat; returns true if the interval it ends counted
+  int bpm() const;
+  // 0 until an interval has counted
+  uint32_t interval_us() const;
+  // The estimated interval, 0 until an interval has counted
+  int confidence() const;
+  uint32_t accepted() const { return good; }
+  uint32_t rejected() const { return bad; }
+
+private:
+  void add(uint32_t interval);
+
+  bool started;
+  uint32_t last_us;
+  uint32_t ring[HR_WINDOW];
+  // The intervals kept, oldest at head once full
+  uint32_t sorted[HR_WINDOW];
+  // The same, in order
+  int count;
+  int head;
+  int run;
+  // Rejected intervals in a row, all within HR_TOLERANCE of each other
+  uint32_t run_min;
+  uint32_t run_max;
+  uint16_t history;
+  // One bit an interval, 1 if it was rejected, newest in bit 0
+  int decisions;
+  // Bits of history in use, up to 16
+  uint32_t good;
+  uint32_t bad;
+};
+
+#endif
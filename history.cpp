@@ -0,0 +1,128 @@
+#include "history.h"
+#include "history_index.h"
+#include "crc.h"
+#include "export_protocol.h"
+
+HistoryLog history;
+
+HistoryLog::HistoryLog()
+    : first_seq(0), next_seq(0), boot_reads(0), ready(false), writer(NULL), index(NULL),
+      failed_writes(0) {}
+
+static void encode(const HistoryRecord & r, uint8_t * out) {
+  // Little-endian, with a CRC over the first 14 bytes in the last 2
+
+  put_u32(out, r.seq);
+  put_u32(out + 4, r.time);
+  put_u16(out + 8, r.systolic);
+  put_u16(out + 10, r.diastolic);
+  out[12] = r.heart_rate;
+  out[13] = r.flags;
+  put_u16(out + 14, crc16_ccitt(out, 14));
+}
+
+bool HistoryLog::load_slot(uint32_t slot, HistoryRecord & r) {
+  uint8_t buf[HISTORY_RECORD_BYTES];
+  if (eeprom_read((uint16_t) (slot * HISTORY_RECORD_BYTES), buf, sizeof(buf)) != 0
+      || crc16_ccitt(buf, 14) != get_u16(buf + 14)) {
+    return false;
+    // Never written (erased bytes are 0xFF), or cut off
+  }
+  r.seq = get_u32(buf);
+  r.time = get_u32(buf + 4);
+  r.systolic = get_u16(buf + 8);
+  r.diastolic = get_u16(buf + 10);
+  r.heart_rate = buf[12];
+  r.flags = buf[13];
+  return r.seq % HISTORY_SLOTS == slot;
+}
+
+bool HistoryLog::begin() {
+  ready = false;
+  first_seq = 0;
+  next_seq = 0;
+  boot_reads = 0;
+
+  HistoryRecord r;
+  boot_reads++;
+  if (!load_slot(0, r)) {
+    boot_reads++;
+    if (load_slot(HISTORY_SLOTS - 1, r)) {
+      next_seq = r.seq + 1;
+      // The ring had gone round and the write to slot 0 was cut off, so
+      // the last slot holds the newest record
+    }
+    // Otherwise the log is empty
+  } else {
+    uint32_t lap = r.seq / HISTORY_SLOTS;
+    uint32_t lo = 0;
+    uint32_t hi = HISTORY_SLOTS;
+    // Slot lo holds a record of this lap; slot hi doesn't (or is past the
+    // end)
+    while (hi - lo > 1) {
+      uint32_t mid = (lo + hi) / 2;
+      boot_reads++;
+      if (load_slot(mid, r) && r.seq / HISTORY_SLOTS == lap) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    next_seq = lap * HISTORY_SLOTS + lo + 1;
+  }
+
+  first_seq = next_seq > HISTORY_SLOTS ? next_seq - HISTORY_SLOTS : 0;
+  ready = true;
+  return true;
+}
+
+bool HistoryLog::append(HistoryRecord & r) {
+  if (!ready) {
+    return false;
+  }
+
+  r.seq = next_seq;
+  uint8_t buf[HISTORY_RECORD_BYTES];
+  encode(r, buf);
+  uint16_t addr = (uint16_t) ((r.seq % HISTORY_SLOTS) * HISTORY_RECORD_BYTES);
+  if (writer != NULL) {
+    if (writer->write(addr, buf, sizeof(buf), &HistoryLog::on_written, this) != 0) {
+      return false;
+    }
+    // The writer copied the record; it is programmed in the background
+  } else if (eeprom_write(addr, buf, sizeof(buf)) != 0) {
+    return false;
+  }
+  next_seq++;
+  if (next_seq - first_seq > HISTORY_SLOTS) {
+    first_seq++;
+    // The oldest record was just overwritten
+  }
+  if (index != NULL) {
+    index->add(r);
+  }
+  return true;
+}
+
+void HistoryLog::use_writer(EepromWriter * writer) {
+  this->writer = writer;
+}
+
+void HistoryLog::use_index(HistoryIndex * index) {
+  this->index = index;
+}
+
+void HistoryLog::on_written(void * ctx, int result) {
+  // Called on the acquisition thread once the record is programmed
+
+  if (result != 0) {
+    ((HistoryLog *) ctx)->failed_writes++;
+  }
+}
+
+bool HistoryLog::read(uint32_t seq, HistoryRecord & r) {
+  if (!ready || seq < first_seq || seq >= next_seq) {
+    return false;
+  }
+  return load_slot(seq % HISTORY_SLOTS, r) && r.seq == seq;
+}
@@ -0,0 +1,93 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include "eeprom.h"
+#include "eeprom_writer.h"
+
+class HistoryIndex;
+
+#define HISTORY_RECORD_BYTES 16
+// Four EEPROM pages; records never share a page
+#define HISTORY_SLOTS (EEPROM_BYTES / HISTORY_RECORD_BYTES)
+// 512 measurements
+
+enum HistoryFlags {
+  HISTORY_TIMED_OUT = 1,
+  // The deflation took too long; there are no results
+  HISTORY_CLOCK_SET = 2
+  // time is a calendar time; otherwise it is the time since boot
+};
+
+// The summary of one measurement
+struct HistoryRecord {
+  uint32_t seq;
+  // Numbers the measurements since the log was new; set by append
+  uint32_t time;
+  // Seconds since 1970 (or since boot, see HISTORY_CLOCK_SET)
+  uint16_t systolic;
+  uint16_t diastolic;
+  // In mmHg
+  uint8_t heart_rate;
+  // In beats per minute
+  uint8_t flags;
+  // HistoryFlags
+};
+
+// An append-only log of measurement summaries in the EEPROM
+// Record seq always lives in slot seq % HISTORY_SLOTS and carries its own
+// CRC, so the log needs no header or pointer that would be rewritten on
+// every append: the slots are written in turn, round and round, and each
+// page wears at the same rate. Appending is one record write whatever
+// the log holds, and when the log is full it overwrites the oldest
+// record
+// begin finds the newest record with a binary search over the slots (the
+// slots up to the newest one hold this lap's records, the rest last
+// lap's), so it reads about ten records instead of the whole chip. A
+// write cut off by a power loss only damages the record it was writing,
+// which read then reports as missing
+class HistoryLog {
+public:
+  HistoryLog();
+  bool begin();
+  // Rebuilds the index from the EEPROM; returns false if it can't be read
+  void use_writer(EepromWriter * writer);
+  // Makes append queue its writes on writer instead of waiting for them;
+  // NULL goes back to eeprom_write
+  void use_index(HistoryIndex * index);
+  // Makes append add every record to index as well (see history_index.h)
+  bool append(HistoryRecord & r);
+  // Writes r as the newest record and fills in r.seq; returns false if
+  // the write failed (or, with a writer, couldn't be queued)
+  // With a writer the record reads back as missing until the writer has
+  // programmed it, and a write that fails later is only counted in 
+  // write_errors
+  uint32_t write_errors() const { return failed_writes; }
+  uint32_t size() const { return next_seq - first_seq; }
+  // The records kept, some of which may be damaged
+  uint32_t first() const { return first_seq; }
+  // The seq of the oldest record kept
+  uint32_t next() const { return next_seq; }
+  // The seq the next record will get
+  bool read(uint32_t seq, HistoryRecord & r);
+  // Returns false if record seq isn't kept or is damaged
+  uint32_t scan_reads() const { return boot_reads; }
+  // The records begin had to read
+
+private:
+  bool load_slot(uint32_t slot, HistoryRecord & r);
+  static void on_written(void * ctx, int result);
+
+  uint32_t first_seq;
+  uint32_t next_seq;
+  uint32_t boot_reads;
+  bool ready;
+  EepromWriter * writer;
+  HistoryIndex * index;
+  volatile uint32_t failed_writes;
+};
+
+extern HistoryLog history;
+// The log of past measurements
+
+#endif
@@ -0,0 +1,277 @@
+#include "history_index.h"
+
+HistoryIndex history_index;
+
+HistoryIndex::HistoryIndex() {
+  clear(0);
+}
+
+bool HistoryIndex::counts(const HistoryEntry & e) {
+  return (e.flags & (HISTORY_CLOCK_SET | HISTORY_TIMED_OUT | HISTORY_MISSING)) == HISTORY_CLOCK_SET;
+}
+
+HistoryIndex::Node HistoryIndex::merge(const Node & a, const Node & b) {
+  Node n;
+  n.min_sys = a.min_sys < b.min_sys ? a.min_sys : b.min_sys;
+  n.max_sys = a.max_sys > b.max_sys ? a.max_sys : b.max_sys;
+  n.min_dia = a.min_dia < b.min_dia ? a.min_dia : b.min_dia;
+  n.max_dia = a.max_dia > b.max_dia ? a.max_dia : b.max_dia;
+  n.min_hr = a.min_hr < b.min_hr ? a.min_hr : b.min_hr;
+  n.max_hr = a.max_hr > b.max_hr ? a.max_hr : b.max_hr;
+  n.count = (uint16_t) (a.count + b.count);
+  return n;
+}
+
+static const uint8_t NO_MIN = 0xFF;
+// An empty node's minimum, so merging it changes nothing
+
+void HistoryIndex::clear(uint32_t seq) {
+  first_seq = seq;
+  next_seq = seq;
+  day_head = 0;
+  day_tail = 0;
+  Node empty = {NO_MIN, 0, NO_MIN, 0, NO_MIN, 0, 0};
+  uint32_t i;
+  for (i = 0; i < 2 * HISTORY_SLOTS; i++) {
+    tree[i] = empty;
+  }
+}
+
+static uint8_t cap(uint32_t v) {
+  return (uint8_t) (v > 255 ? 255 : v);
+}
+
+void HistoryIndex::build(HistoryLog & log) {
+  clear(log.first());
+  uint32_t seq;
+  for (seq = log.first(); seq < log.next(); seq++) {
+    HistoryRecord r;
+    if (!log.read(seq, r)) {
+      r.seq = seq;
+      r.time = 0;
+      r.systolic = 0;
+      r.diastolic = 0;
+      r.heart_rate = 0;
+      r.flags = HISTORY_MISSING;
+      // Keep its place so the seqs stay in step with the log
+    }
+    add(r);
+  }
+}
+
+void HistoryIndex::set_leaf(uint32_t slot, const HistoryEntry * e) {
+  // Puts e, or nothing if e is NULL, in the tree and updates the nodes
+  // above it
+
+  Node n = {NO_MIN, 0, NO_MIN, 0, NO_MIN, 0, 0};
+  if (e != NULL) {
+    Node one = {e->systolic, e->systolic, e->diastolic, e->diastolic,
+                e->heart_rate, e->heart_rate, 1};
+    n = one;
+  }
+  uint32_t i = HISTORY_SLOTS + slot;
+  tree[i] = n;
+  for (i /= 2; i > 0; i /= 2) {
+    tree[i] = merge(tree[2 * i], tree[2 * i + 1]);
+  }
+}
+
+void HistoryIndex::evict_oldest() {
+  // Takes the oldest entry out of the day totals before its slot is 
+  // reused
+
+  const HistoryEntry & e = entries[first_seq % HISTORY_SLOTS];
+  if (counts(e) && day_tail != day_head) {
+    Day & d = days[day_head % HISTORY_INDEX_DAYS];
+    if (d.day == e.time / SECONDS_PER_DAY) {
+      d.count--;
+      d.sum_sys -= e.systolic;
+      d.sum_dia -= e.diastolic;
+      d.sum_hr -= e.heart_rate;
+      d.first_seq = first_seq + 1;
+      if (d.count == 0) {
+        day_head++;
+      }
+    }
+    // Otherwise its day had already dropped out of the table
+  }
+  set_leaf(first_seq % HISTORY_SLOTS, NULL);
+  first_seq++;
+}
+
+void HistoryIndex::add(const HistoryRecord & r) {
+  if (r.seq < next_seq) {
+    return;
+  }
+  if (r.seq - next_seq >= HISTORY_SLOTS) {
+    clear(r.seq);
+    // Everything the index held is gone from the log
+  }
+  while (next_seq <= r.seq) {
+    if (next_seq - first_seq == HISTORY_SLOTS) {
+      evict_oldest();
+    }
+
+    uint32_t prev = next_seq != first_seq ? entries[(next_seq - 1) % HISTORY_SLOTS].time : 0;
+    HistoryEntry & e = entries[next_seq % HISTORY_SLOTS];
+    e.seq = next_seq;
+    e.time = prev;
+    e.systolic = 0;
+    e.diastolic = 0;
+    e.heart_rate = 0;
+    e.flags = HISTORY_MISSING;
+    // A seq skipped over (the log never does that) is a missing record
+    if (next_seq == r.seq) {
+      if ((r.flags & HISTORY_CLOCK_SET) && r.time > prev) {
+        e.time = r.time;
+      }
+      e.systolic = cap(r.systolic);
+      e.diastolic = cap(r.diastolic);
+      e.heart_rate = r.heart_rate;
+      e.flags = r.flags;
+    }
+
+    if (counts(e)) {
+      set_leaf(next_seq % HISTORY_SLOTS, &e);
+      uint32_t day = e.time / SECONDS_PER_DAY;
+      if (day_tail == day_head || days[(day_tail - 1) % HISTORY_INDEX_DAYS].day != day) {
+        if (day_tail - day_head == HISTORY_INDEX_DAYS) {
+          day_head++;
+          // Forget the oldest day's totals
+        }
+        Day fresh = {day, next_seq, next_seq, 0, 0, 0, 0};
+        days[day_tail % HISTORY_INDEX_DAYS] = fresh;
+        day_tail++;
+      }
+      Day & d = days[(day_tail - 1) % HISTORY_INDEX_DAYS];
+      d.end_seq = next_seq + 1;
+      d.count++;
+      d.sum_sys += e.systolic;
+      d.sum_dia += e.diastolic;
+      d.sum_hr += e.heart_rate;
+    } else {
+      set_leaf(next_seq % HISTORY_SLOTS, NULL);
+    }
+    next_seq++;
+  }
+}
+
+uint32_t HistoryIndex::last(HistoryEntry * out, uint32_t n) const {
+  uint32_t i;
+  for (i = 0; i < n && i < size(); i++) {
+    out[i] = entries[(next_seq - 1 - i) % HISTORY_SLOTS];
+  }
+  return i;
+}
+
+HistoryIndex::Node HistoryIndex::query(uint32_t from_seq, uint32_t end_seq) const {
+  // Merges the leaves of the records from from_seq up to end_seq, which
+  // may wrap round the end of the slots
+
+  Node n = {NO_MIN, 0, NO_MIN, 0, NO_MIN, 0, 0};
+  if (from_seq < first_seq) {
+    from_seq = first_seq;
+  }
+  if (end_seq > next_seq) {
+    end_seq = next_seq;
+  }
+  if (from_seq >= end_seq) {
+    return n;
+  }
+
+  uint32_t start = from_seq % HISTORY_SLOTS;
+  uint32_t len = end_seq - from_seq;
+  uint32_t ranges[2][2] = {{start, start + len}, {0, 0}};
+  if (start + len > HISTORY_SLOTS) {
+    ranges[0][1] = HISTORY_SLOTS;
+    ranges[1][1] = start + len - HISTORY_SLOTS;
+  }
+  int r;
+  for (r = 0; r < 2; r++) {
+    uint32_t lo = ranges[r][0] + HISTORY_SLOTS;
+    uint32_t hi = ranges[r][1] + HISTORY_SLOTS;
+    while (lo < hi) {
+      if (lo & 1U) {
+        n = merge(n, tree[lo++]);
+      }
+      if (hi & 1U) {
+        n = merge(n, tree[--hi]);
+      }
+      lo /= 2;
+      hi /= 2;
+    }
+  }
+  return n;
+}
+
+uint32_t HistoryIndex::lower_bound(uint32_t time) const {
+  uint32_t lo = first_seq;
+  uint32_t hi = next_seq;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (entries[mid % HISTORY_SLOTS].time < time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void fill_range(HistoryStats & s, uint32_t count, uint8_t min_sys, uint8_t max_sys,
+                       uint8_t min_dia, uint8_t max_dia, uint8_t min_hr, uint8_t max_hr) {
+  s.count = count;
+  s.min_systolic = count ? min_sys : 0;
+  s.max_systolic = max_sys;
+  s.min_diastolic = count ? min_dia : 0;
+  s.max_diastolic = max_dia;
+  s.min_heart_rate = count ? min_hr : 0;
+  s.max_heart_rate = max_hr;
+  s.mean_systolic = 0;
+  s.mean_diastolic = 0;
+  s.mean_heart_rate = 0;
+  s.day = 0;
+}
+
+void HistoryIndex::fill(const Day & d, HistoryStats & s) const {
+  Node n = query(d.first_seq, d.end_seq);
+  fill_range(s, d.count, n.min_sys, n.max_sys, n.min_dia, n.max_dia, n.min_hr, n.max_hr);
+  s.mean_systolic = (uint8_t) ((d.sum_sys + d.count / 2) / d.count);
+  s.mean_diastolic = (uint8_t) ((d.sum_dia + d.count / 2) / d.count);
+  s.mean_heart_rate = (uint8_t) ((d.sum_hr + d.count / 2) / d.count);
+  // Rounded to the nearest
+  s.day = d.day;
+}
+
+bool HistoryIndex::day_stats(uint32_t day, HistoryStats & s) const {
+  uint32_t lo = day_head;
+  uint32_t hi = day_tail;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (days[mid % HISTORY_INDEX_DAYS].day < day) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == day_tail || days[lo % HISTORY_INDEX_DAYS].day != day) {
+    return false;
+  }
+  fill(days[lo % HISTORY_INDEX_DAYS], s);
+  return true;
+}
+
+uint32_t HistoryIndex::recent_days(HistoryStats * out, uint32_t n) const {
+  uint32_t i;
+  for (i = 0; i < n && i < day_tail - day_head; i++) {
+    fill(days[(day_tail - 1 - i) % HISTORY_INDEX_DAYS], out[i]);
+  }
+  return i;
+}
+
+HistoryStats HistoryIndex::range_stats(uint32_t from, uint32_t to) const {
+  HistoryStats s;
+  Node n = query(lower_bound(from), lower_bound(to));
+  fill_range(s, n.count, n.min_sys, n.max_sys, n.min_dia, n.max_dia, n.min_hr, n.max_hr);
+  return s;
+}
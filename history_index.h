@@ -0,0 +1,125 @@
+#ifndef HISTORY_INDEX_H
+#define HISTORY_INDEX_H
+
+#include <stdint.h>
+#include "history.h"
+
+#define HISTORY_INDEX_DAYS 128
+// Days with per-day totals; older days drop out of day_stats first
+#define SECONDS_PER_DAY 86400U
+
+#define HISTORY_MISSING 0x80
+// In HistoryEntry.flags: the record was damaged when the index was built
+
+// A measurement as the index keeps it
+struct HistoryEntry {
+  uint32_t seq;
+  uint32_t time;
+  // Never less than the time of the entry before it (see HistoryIndex)
+  uint8_t systolic;
+  uint8_t diastolic;
+  // In mmHg, capped at 255; the cuff is only pumped up to 150
+  uint8_t heart_rate;
+  uint8_t flags;
+  // HistoryFlags, or HISTORY_MISSING
+};
+
+// The measurements with results (see HistoryIndex) in a day or a range
+struct HistoryStats {
+  uint32_t count;
+  uint8_t min_systolic;
+  uint8_t max_systolic;
+  uint8_t min_diastolic;
+  uint8_t max_diastolic;
+  uint8_t min_heart_rate;
+  uint8_t max_heart_rate;
+  uint8_t mean_systolic;
+  uint8_t mean_diastolic;
+  uint8_t mean_heart_rate;
+  // Only filled in by day_stats and recent_days
+  uint32_t day;
+  // Days since 1970; only filled in by day_stats and recent_days
+};
+
+// A copy of the history log in RAM, ordered by time, for the trend screens
+// build reads the log once at boot; after that HistoryLog::append keeps it
+// up to date, so no query touches the EEPROM
+// Only records with results and a calendar time (HISTORY_CLOCK_SET and not
+// HISTORY_TIMED_OUT) count towards the stats. The times are made
+// non-decreasing, so a record without a calendar time, or taken after the
+// clock went back, gets the time of the record before it, and a query by
+// time is a binary search over the records
+// The per-day totals (count and sums) are updated as each record is
+// appended or pushed out of the log, and a segment tree over the slots
+// gives the minimum and maximum of any run of records in O(log n), so
+// last is O(n) in the records asked for and every other query is
+// O(log n). It takes about 18 KB
+class HistoryIndex {
+public:
+  HistoryIndex();
+  void build(HistoryLog & log);
+  // Reads every record kept in log, a record at a time through the EEPROM
+  // driver; call it after log.begin, and then log.use_index(this) so
+  // appends keep the index up to date
+  void add(const HistoryRecord & r);
+  // Adds the newest record; called by HistoryLog::append
+  uint32_t size() const { return next_seq - first_seq; }
+  uint32_t last(HistoryEntry * out, uint32_t n) const;
+  // Copies the newest n entries (fewer if there aren't that many), newest
+  // first, and returns how many it copied
+  bool day_stats(uint32_t day, HistoryStats & s) const;
+  // Returns false if no measurement with results is kept for day (days
+  // since 1970, the time in the records divided by SECONDS_PER_DAY)
+  uint32_t recent_days(HistoryStats * out, uint32_t n) const;
+  // The newest n days with measurements, newest first
+  HistoryStats range_stats(uint32_t from, uint32_t to) const;
+  // The measurements from time from up to, but not including, time to
+  // The means and day are 0
+
+private:
+  struct Node {
+    uint8_t min_sys;
+    uint8_t max_sys;
+    uint8_t min_dia;
+    uint8_t max_dia;
+    uint8_t min_hr;
+    uint8_t max_hr;
+    uint16_t count;
+  };
+
+  struct Day {
+    uint32_t day;
+    uint32_t first_seq;
+    uint32_t end_seq;
+    // The records from the first to the last one of the day that count
+    uint32_t count;
+    uint32_t sum_sys;
+    uint32_t sum_dia;
+    uint32_t sum_hr;
+  };
+
+  static bool counts(const HistoryEntry & e);
+  static Node merge(const Node & a, const Node & b);
+  void clear(uint32_t seq);
+  void set_leaf(uint32_t slot, const HistoryEntry * e);
+  Node query(uint32_t from_seq, uint32_t end_seq) const;
+  uint32_t lower_bound(uint32_t time) const;
+  // The first seq whose time is at least time
+  void fill(const Day & d, HistoryStats & s) const;
+  void evict_oldest();
+
+  HistoryEntry entries[HISTORY_SLOTS];
+  // Entry seq is at seq % HISTORY_SLOTS, like in the EEPROM
+  Node tree[2 * HISTORY_SLOTS];
+  // tree[1] is the root and tree[HISTORY_SLOTS + slot] the leaves
+  Day days[HISTORY_INDEX_DAYS];
+  uint32_t day_head;
+  uint32_t day_tail;
+  // Oldest day at day_head
+  uint32_t first_seq;
+  uint32_t next_seq;
+};
+
+extern HistoryIndex history_index;
+
+#endif
@@ -2,183 +2,130 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "drivers/LCD_DISCO_F429ZI.h"
 // Import all the functions for working with the display
+#include "sensor.h"
+#include "analysis.h"
+#include "oscillometry.h"
+#include "sampler.h"
+#include "session_recorder.h"
+#include "session_export.h"
+#include "telemetry.h"
+#include "history.h"
+#include "history_index.h"
+#include <time.h>
+#include "arena.h"
+// Import the acquisition and analysis code shared with the host tools
 #define BACKGROUND 1
 // The value that indicates the background layer, to be passed to 
 // the LCD functions
 #define FOREGROUND 0
 // The value that indicates the foreground layer, to be passed to 
 // the LCD functions
-#define SENSOR_ADDR 0b0011000
-// The sensor's 7-bit address
-
-uint8_t OUTPUT_COMMAND[3] = {0xAA, 0x00, 0x00};
-// The output measurement command to be sent to the sensor over I2C
-static constexpr uint8_t read_addr = (SENSOR_ADDR << 1U) | 1U;
-// The sensor' address for reading data
-static constexpr uint8_t write_addr = SENSOR_ADDR << 1U;
-// The sensor's address for writing data
-static uint8_t read_buf[20];
-// A buffer for storing the data received from the sensor over I2C
-volatile uint8_t sensor_status;
-// A global variable for storing the 8-bit sensor status
-volatile uint32_t pressure_reading;
-// A global variable for storing the sensor's 24-bit pressure reading
-volatile int pressure;
-// A global variable for storing the pressure calculated from the reading
+#define SAMPLES_PER_REDRAW (SAMPLE_RATE_HZ / 5)
+// Refresh the screen 5 times a second, not on every sample, so that 
+// drawing text doesn't hold up the sampler
 volatile int restarted_after_timeout = 0;
 // A global variable for tracking whether the program restarted because 
-// deflating the air bag took more than 90 seconds
+// deflating the air bag took longer than max_deflate_seconds()
 volatile int in_debug_mode = 0;
 // A global variable for tracking whether the program is currently 
 // in debug mode. 1 if it is; 0 otherwise.
-volatile int heart_rate;
-// A global variable for storing the heart rate
-volatile int systolic;
-// A global variable for storing the systolic blood pressure
-volatile int diastolic;
-// A global variable for storing the diastolic blood pressure
-int * vals_1d = (int *) malloc(900 * sizeof(int));
-int * osci = (int *) malloc(900 * sizeof(int));
-// Allocate 2 arrays of 900 integers on the heap, which will be 
-// used by calc_stats to analyze the pressure waves
 
 I2C Wire(PC_9, PA_8);
 // Declare an mbed I2C instance
 // Use PC_9 for the SDA line and PA_8 for the SCL line
+MbedI2CBus wire_bus(Wire);
+SharedBus shared_wire(&wire_bus);
+// The acquisition code reaches the sensor through this bus, and the
+// EEPROM writer takes turns with it
+EepromWriter eeprom_writer(&shared_wire);
+// Programs the history records between sensor transfers
+MbedSerialLink usb_serial(USBTX, USBRX, EXPORT_BAUD);
+// The UART wired to the ST-LINK, which shows up on the computer as a
+// virtual COM port
+SessionExporter exporter(&usb_serial);
+// Sends every finished session over the virtual COM port
+FrameParser clock_parser;
+volatile uint32_t clock_request = 0;
+// A FRAME_SET_CLOCK from the computer (tools/set_clock.cpp), in seconds
+// since 1970, until save_to_history sets the clock to it
+#ifdef LIVE_TELEMETRY
+Telemetry telemetry(&usb_serial);
+// Streams the samples and beats over the same port while a measurement
+// runs (build with -DLIVE_TELEMETRY); the beats are the ones the
+// analyzer finds
+#endif
 InterruptIn button_int(USER_BUTTON, PullDown);
 // Create an InterruptIn connected to the user button and 
 // configure the button as pull-down
+#ifdef EOC_PIN
+InterruptIn eoc_int(EOC_PIN, PullDown);
+// Create an InterruptIn connected to the sensor's End-of-Conversion 
+// output when it is wired (build with e.g. -DEOC_PIN=PA_5)
+// Without it the sensor is read after a fixed conversion time
+#endif
+
+OscillometricAnalyzer analyzer;
+// Works out the results from the oscillations as the cuff deflates
 
 LCD_DISCO_F429ZI lcd;
 // Declare an instance for the LCD of the F429 microcontroller
 
 // Below are forward declarations for the functions
-void sleep_and_update_pressure();
-void print_pressure_values(int, int, uint16_t *);
 void timeout_restart();
-void check_release_rate(int, uint16_t *, char *);
-void calc_stats();
-void calc_pressure(int);
-void enter_operating_mode();
-void wait_for_busy_flag();
-void read_pressure();
+void check_release_rate(const CaptureBuffer &, char *);
 void debug_mode();
 void setup_lcd_background();
 void setup_lcd_foreground();
 void pump_up_to_150();
-void sleep_and_update_pressure();
 void open_valve();
 void show_stats();
 void button_isr();
+void eoc_isr();
+void serial_rx_isr(void *, uint8_t);
+bool clock_is_set();
+void sample_and_record(uint8_t);
+void save_to_history(const SessionResults &);
 
-void calc_pressure(int output) {
-  int output_max = 3774873;
-  int output_min = 419430;
-  // According to Transfer Function B, 
-  // the max equals 22.5% * (2 ^ 24), 
-  // and the min. equals 2.5% * (2 ^ 24)
-  int p_max = 300;
-  int p_min = 0;
-  // The pressure range of the sensor is 0 to 300
-
-  pressure = (int) (output - output_min) * (p_max - p_min) / (output_max - output_min) + p_min;
-  // The formula on the data sheet
-}
-
-void enter_operating_mode() {
-  // Send the Output Measurement Command over I2C to make the sensor
-  // exit Standby Mode and enter Operating Mode
+void eoc_isr() {
+  // Called when the sensor raises EOC
+  // The reading is ready, so fetch it right away
 
-  Wire.write(write_addr, (const char *) OUTPUT_COMMAND, 3, false);
-  thread_sleep_for(10);
-  // This function is called repeatedly, and 
-  // at least 10 ms between calls is required 
-  // for the sensor to function
+  sensor.end_of_conversion();
 }
 
-void wait_for_busy_flag() {
-  // To be called after the Output Measurement Command is sent
-  // The pressure reading is not ready until the busy flag clears
-  // This function blocks the read_pressure function from running until 
-  // the busy flag clears
-  // It assumes that the sensor is in Operating Mode before it's called
-
-  Wire.read(read_addr, (char*)&read_buf[0], 1, false);
-  // Read the status byte over I2C
-  sensor_status = read_buf[0];
-  // Update the status byte saved in the global variable
-  uint8_t is_busy = sensor_status & 32U;
-  // Bit 5 is the busy flag
-
-  while (is_busy) {
-    // Stay in this function while the sensor is busy
-    enter_operating_mode();
-    // Make the sensor enter Operating Mode
-    Wire.read(read_addr, (char*)&read_buf[0], 1, false);
-    // Read the status byte again
-    sensor_status = read_buf[0];
-    // Update the status byte saved in the global variable
-    is_busy = sensor_status & 32U;
-    // Update the local busy flag
-  }
-}
+void button_isr() {
+  // Called when a button interrupt occurs
+  // Flips the value of in_debug_mode
 
-void read_pressure() {
-  // Wait for the busy flag to clear and read the current pressure 
-  // over I2C
-
-  enter_operating_mode();
-  // Make the sensor enter Opearating Mode
-  wait_for_busy_flag();
-  // Wait until the data is available
-  enter_operating_mode();
-  // The device entered Standy Mode after the previous transaction, 
-  // so the command needs to be sent again to make it enter 
-  // Operating Mode
-  Wire.read(read_addr, (char*)&read_buf[0], 4, false);
-  // Now the pressure reading is available. Read it and save it in 
-  // the read buffer
-
-  sensor_status = read_buf[0];
-  // The first byte received is the status byte
-  pressure_reading = read_buf[1] << 16U;
-  pressure_reading |= read_buf[2] << 8U;
-  pressure_reading |= read_buf[3];
-  // The pressure reading is 24 bits
-  // The most significant bits come first
-  // Shift the bits accordingly and write them into the 
-  // global variable
-
-  calc_pressure((int) pressure_reading);
-  // Convert the raw data to a value in mmHg
-  // Store it in the global variable
+  in_debug_mode ^= 1U;
 }
 
-void sleep_and_update_pressure() {
-  // A function that changes the sleep duration once and for all so 
-  // that you don't have to change the duration in every function 
-  // that calls read_pressure
+void serial_rx_isr(void *, uint8_t byte) {
+  // Called for every byte that comes in over the virtual COM port
+  // set_time takes a mutex, so the clock is set from the main loop
 
-  thread_sleep_for(100);
-  // Sleep for 100 milliseconds before updating the pressure
-  read_pressure();
-  // Update the pressure
+  if (clock_parser.feed(byte) && clock_parser.type() == FRAME_SET_CLOCK &&
+      clock_parser.length() == 4) {
+    clock_request = get_u32(clock_parser.payload());
+  }
 }
 
-void button_isr() {
-  // Called when a button interrupt occurs
-  // Flips the value of in_debug_mode
-
-  in_debug_mode ^= 1U;
+bool clock_is_set() {
+  return time(NULL) > 1600000000;
+  // The RTC starts at 1970 unless something has set it
 }
 
 void debug_mode() {
   lcd.Clear(LCD_COLOR_BLACK);
-  char buff[20][60];
+  ArenaScope scope(text_arena);
+  text_line_t * buff = alloc_text_lines(19);
+  // Scratch lines from the text arena, given back on return
+  // The screen has room for 19 lines: LINE(20) would start past its
+  // bottom edge, and the LCD driver doesn't clip
   snprintf(buff[0], 60, "DEBUG MODE");
-  snprintf(buff[1], 60, " ");
   snprintf(buff[2], 60, "The sensor is");
   snprintf(buff[4], 60, " ");
   snprintf(buff[5], 60, "Internal math ");
@@ -188,7 +135,6 @@ void debug_mode() {
   snprintf(buff[10], 60, "integrity test");
   snprintf(buff[12], 60, " ");
   snprintf(buff[13], 60, "The device is");
-  snprintf(buff[16], 60, " ");
   snprintf(buff[17], 60, "Press the blue");
   snprintf(buff[18], 60, "button to exit");
 
@@ -232,12 +178,26 @@ void debug_mode() {
       snprintf(buff[15], 60, "is available.");
     }
 
+    snprintf(buff[16], 60, "EE q %u/%u lat %u/%u ms",
+             (unsigned) eeprom_writer.depth(), (unsigned) eeprom_writer.max_depth(),
+             (unsigned) (eeprom_writer.mean_latency_us() / 1000),
+             (unsigned) (eeprom_writer.max_latency_us() / 1000));
+    // The EEPROM writes waiting now and at most, and how long they take
+    // on average and at worst
+
+    snprintf(buff[1], 60, "RAM %u/%u fail %u",
+             (unsigned) (text_arena.high_water() + measurement_arena.high_water()),
+             (unsigned) (text_arena.capacity() + measurement_arena.capacity()),
+             (unsigned) (text_arena.failures() + measurement_arena.failures()));
+    // The most arena memory ever in use, out of the total, and the 
+    // allocations that didn't fit
+
     int i;
-    int arr[5] = {3, 7, 11, 14, 15};
+    int arr[7] = {1, 3, 7, 11, 14, 15, 16};
     // The indices of strings in the buffer that 
     // are constantly updated
 
-    for (i = 0; i < 5; i++) {
+    for (i = 0; i < 7; i++) {
       lcd.ClearStringLine((uint32_t) arr[i] + 1);
     }
     // Clear the lines that will be refreshed to avoid 
@@ -285,23 +245,57 @@ void setup_lcd_foreground() {
   // Set the text color to light green
 }
 
+void sample_and_record(uint8_t phase) {
+  // Wait for the next sample and keep it, at full resolution, in the
+  // session recording in SDRAM
+
+  sleep_and_update_pressure();
+  recorder.record(sample_time_us, pressure_reading, sensor_status, phase);
+#ifdef LIVE_TELEMETRY
+  telemetry.sample(sample_time_us, pressure_reading, sensor_status, phase);
+  // Doesn't wait for the serial port
+#endif
+}
+
+#ifdef LIVE_TELEMETRY
+void send_beat(void *, uint32_t time_us, pressure_t p) {
+  // Called by the analyzer for each beat it finds
+
+  telemetry.beat(time_us, p);
+}
+#endif
+
 void pump_up_to_150() {
   read_pressure();
   // Update the pressure value
-  char buffer[10][60];
+  ArenaScope scope(text_arena);
+  text_line_t * buffer = alloc_text_lines(10);
   // A buffer for storing displayed texts
+  // It comes from the text arena and is given back on return
   lcd.Clear(LCD_COLOR_BLACK);
   // Clear the display to avoid text retention
+  int n = 0;
+  // Counts the samples taken so far
+  capture.reset();
+  // Start a new recording with the inflation ramp; the old samples are
+  // simply overwritten
 
-  while (pressure < 150) {
+  while (pressure < MMHG(150)) {
     if (in_debug_mode) {
       // Call the debug mode function when the 
       // user has pressed the blue button
       debug_mode();
     }
 
+    if (n++ % SAMPLES_PER_REDRAW) {
+      sample_and_record(PHASE_INFLATE);
+      capture.append(sample_time_us, pressure);
+      continue;
+      // Only refresh the screen every few samples
+    }
+
     snprintf(buffer[0], 60, "Current pressure:");
-    snprintf(buffer[1], 60, "%d mmHg", pressure);
+    format_pressure(buffer[1], 60, pressure);
     snprintf(buffer[2], 60, " ");
     // Leave an empty line in between
     snprintf(buffer[3], 60, "Keep pumping until");
@@ -326,7 +320,11 @@ void pump_up_to_150() {
       // using the left mode
     }
 
-    sleep_and_update_pressure();
+    sample_and_record(PHASE_INFLATE);
+    capture.append(sample_time_us, pressure);
+    // Keep the inflation ramp for calc_inflation_stats; once the buffer's
+    // inflation part is full the rest of the ramp is only in the session
+    // recording
   }
 
   lcd.Clear(LCD_COLOR_BLACK);
@@ -336,27 +334,21 @@ void pump_up_to_150() {
 void open_valve() {
   read_pressure();
   // Update the pressure value
-  char buffer[20][60];
+  ArenaScope scope(text_arena);
+  text_line_t * buffer = alloc_text_lines(20);
   // A buffer for storing displayed texts
+  // It comes from the text arena and is given back on return
 
-  uint16_t vals[90][10] = {0};
-  // A 90-by-10 matrix for storing the pressure values read
-  // while the cuff deflates
-  // Initialize the first element as 0, and
-  // all other elements will be automatically initialized as zeros
-  int c_cnt = sizeof(vals[0]) / 2;
-  // The number of columns in the matrix
-  int r_cnt = sizeof(vals) / 2 / c_cnt;
-  // The number of rows in the matrix
-  int r = 0;
-  // Stores the current row number
-  int c = 0;
-  // Stores the current column number
+  capture.start_deflation();
+  analyzer.reset();
+  // The samples from here on are the deflation
+  uint32_t c = 0;
+  // Stores the number of samples recorded
   int i = 0;
   // Initialize the index to be used in for loops
 
   snprintf(buffer[0], 60, "Current pressure:");
-  snprintf(buffer[1], 60, "%d mmHg", pressure);
+  format_pressure(buffer[1], 60, pressure);
   snprintf(buffer[2], 60, " ");
   // Leave an empty line in between
   snprintf(buffer[3], 60, "Slightly open valve");
@@ -367,7 +359,7 @@ void open_valve() {
   // Store the texts as a C-strings in the display buffer in 
   // order to display them on the LCD
 
-  while (pressure > 30 && (!restarted_after_timeout)) {
+  while (pressure > MMHG(30) && (!restarted_after_timeout)) {
     // Keep displaying the following text while the pressure is above 
     // 30 mmHg and the program hasn't restarted because of a timeout
 
@@ -377,217 +369,95 @@ void open_valve() {
       debug_mode();
     }
 
-    lcd.SelectLayer(FOREGROUND);
-    // Use the foregound layer to display the text
-    lcd.ClearStringLine(2);
-    lcd.ClearStringLine(8);
-    lcd.ClearStringLine(9);
-    // Clear Lines 2, 8 and 9 before refreshing the texts to 
-    // avoid text retention
-    snprintf(buffer[1], 60, "%d mmHg", pressure);
-    // Update the pressure value in the buffer
-
-    for (i = 0; i < 9; i++) {
-      if (r < 2 && (i == 7 || i == 8)) {
-        // If the release rate hasn't been determined, 
-        // do not display the 7th & 8th strings in the buffer, 
-        // which are about the release rate
-        // Move on to the next iteration
-        continue;
+    if (c % SAMPLES_PER_REDRAW == 0) {
+      // Only refresh the screen every few samples
+      lcd.SelectLayer(FOREGROUND);
+      // Use the foregound layer to display the text
+      lcd.ClearStringLine(2);
+      lcd.ClearStringLine(8);
+      lcd.ClearStringLine(9);
+      // Clear Lines 2, 8 and 9 before refreshing the texts to 
+      // avoid text retention
+      format_pressure(buffer[1], 60, pressure);
+      // Update the pressure value in the buffer
+
+      for (i = 0; i < 9; i++) {
+        if (c < 2 * SAMPLE_RATE_HZ && (i == 7 || i == 8)) {
+          // If the release rate hasn't been determined, 
+          // do not display the 7th & 8th strings in the buffer, 
+          // which are about the release rate
+          // Move on to the next iteration
+          continue;
+        }
+
+        lcd.DisplayStringAt(3, LINE(i + 1), (uint8_t *)buffer[i], LEFT_MODE);
+        // Display each text in the buffer at the coordinate (0, LINE(i + 1)), 
+        // using the left mode
       }
-
-      lcd.DisplayStringAt(3, LINE(i + 1), (uint8_t *)buffer[i], LEFT_MODE);
-      // Display each text in the buffer at the coordinate (0, LINE(i + 1)), 
-      // using the left mode
     }
 
-    sleep_and_update_pressure();
-    vals[r][c] = pressure;
-    // Store the current pressure in the array
-    if (r > 0 && c == 0) {
-      check_release_rate(r, vals[0], buffer[0]);
+    sample_and_record(PHASE_DEFLATE);
+    capture.append(sample_time_us, pressure);
+    // Store the current pressure and its timestamp for the release rate
+    // check and the session export
+    analyzer.update(sample_time_us, pressure);
+    // The results are worked out as the samples arrive
+    c++;
+    if (c > SAMPLE_RATE_HZ && c % SAMPLE_RATE_HZ == 1) {
+      check_release_rate(capture, buffer[0]);
       // Check if the release is too fast or too slow and 
       // update the text in the buffer accordingly
-      // Only call the function when c == 0, which happens
-      // once every second
+      // Only call the function once every second
     }
 
-    c++;
-    // Increment the column index
-    if (c >= 10) {
-      r++;
-      c = 0;
-      // If the column pointer is at the end of the row, 
-      // increment the row index and reset the column 
-      // index to 0
-    }
-
-    if (r >= r_cnt) {
-      // Means deflation took more than 90 seconds
+    if (capture.full()) {
+      // Means deflation took more than max_deflate_seconds()
       restarted_after_timeout = 1;
       // Set this to 1 so that timeout_restart will be 
       // called later
     }
   }
 
-  for (i = 0; i < 900; i++) {
-    vals_1d[i] = 0;
-  }
-  // Clear the integer array on the heap
-
-  i = 0;
-  for (r = 0; r < r_cnt; r++) {
-    for (c = 0; c < c_cnt; c++) {
-      vals_1d[i] = (int) vals[r][c];
-      i++;
-    }
-  }
-  // Copy everything in the 2D array into the 1D array
-
   lcd.Clear(LCD_COLOR_BLACK);
   // Clear the LCD before the function returns
 
   if (restarted_after_timeout) {
     // Call timeout_restart if deflation took 
-    // more than 90 seconds
+    // more than max_deflate_seconds()
     timeout_restart();
   }
 }
 
-void calc_stats() {
-  int t1 = 0;
-  // Stores the index of the pressure read when the first 
-  // heart beat was detected
-  int t2 = 0;
-  // Stores the index of the pressure read when the last
-  // heart beat was detected. Since the time interval between 
-  int mean_ap = 0;
-  // Stores the mean arterial pressure (MAP)
-  int cnt = 0;
-  // Stores the total number of heart beats detected, which will be 
-  // used to calculate the heart rate
-  int i;
-
-  for (i = 0; i < 900; i++) {
-    osci[i] = 0;
-  }
-  // Clear the values in the array on the heap
-
-  int last_inc = 0;
-  // 1 if the last change in pressure reading was 
-  // positive and 0 if negative
-  // If the last change was 0, this variable stays
-  // unchanged
+void check_release_rate(const CaptureBuffer & cap, char * buffer) {
+  // Compare the current pressure value to the one read a second 
+  // earlier to see if the release rate is too high or too low
 
-  for (i = 1; i < 900; i++) {
-    if (vals_1d[i] >= 150) {
-      continue;
-      // Skip the pressure values above 150 mmHg
-    }
-
-    osci[i] = (int) vals_1d[i] - vals_1d[i - 1];
-    // The difference between two successive pressure values
-    if (last_inc == 1 && osci[i] < 0) {
-      // If the last change in reading was positive and 
-      // the current change is negative, that indicates 
-      // a heart beat
-      if (cnt == 0) {
-        // Means this is the first heart beat
-        t1 = i - 1;
-        // Write the index of the previous reading into t1
-        systolic = vals_1d[i - 1];
-        // The pressure value at the previous index is the 
-        // systolic pressure
-      }
-      cnt++;
-      // Increment the total number of heart beats detected
-      t2 = i - 1;
-      // Update the index of the reading when the most recent
-      // heart beat was detected
-    }
-
-    if (osci[i] > 0) {
-      last_inc = 1;
-      // Change last_inc to 1 if the current change in 
-      // pressure is positive
-    } else if (osci[i] < 0) {
-      last_inc = 0;
-      // Change it to 0 if the current change is negative
-    }
-    // Note that last_inc stays unchanged if the current 
-    // change is 0
-  }
-
-  int max_inc = 0;
-  // Stores the maximum increase in pressure
-  int curr_inc = 0;
-  // Stores the cumulative increase in pressure since 
-  // the last drop
-
-  for (i = 0; i < 900; i++) {
-    if (osci[i] < 0) {
-      // If the current change in pressure is negative, 
-      // the pressure wave is dropping, so curr_inc is 
-      // the cumulative increase in pressure during the 
-      // last spike
-      if (curr_inc > max_inc) {
-        // If the current increase is larger than the 
-        // maximum, update the maximum
-        max_inc = curr_inc;
-        mean_ap = vals_1d[i - 1];
-        // The mean arterial pressure is roughly equal to 
-        // the pressure read at the maximum spike, so 
-        // it should be updated with the last pressure 
-        // reading whenever a greater spike is found
-      }
-      curr_inc = 0;
-      // The current change in pressure is negative, 
-      // so the cumulative increase should be reset to 0
-    } else {
-      curr_inc += osci[i];
-      // If the current change in pressure is non-negative, 
-      // add it to the cumulative increase
-    }
-  }
-
-  diastolic = (mean_ap * 3 - systolic) / 2;
-  // The formula for calculating the diastolic pressure when given 
-  // the MAP and the systolic pressure
-  heart_rate = cnt * 60 / ((t2 - t1) * 120 / 1000);
-  // The heart rate in beats by minute equals the number of heart beats 
-  // divided by the time interval in seconds and then multiplied by 60
-  // The pressure is supposed to be read every 1/10 of a second, 
-  // but every call to enter_operating_mode comes with a 10-ms delay
-  // read_pressure makes at least 2 calls to enter_operating_mode, 
-  // so the interval between 2 pressure readings is 120 ms, to be exact
-}
-
-void check_release_rate(int r, uint16_t * matrix, char * buffer) {
-  // Compare the current pressure value to the previous one 
-  // to see if the release rate is too high or too low
-
-  // r is the row number in the matrix where the last pressure value 
-  // was written
-
-  if (r == 0) {
+  const CaptureSample * s = cap.deflation();
+  uint32_t n = cap.deflation_size();
+  // Only the deflation counts
+  if (n <= SAMPLE_RATE_HZ) {
     // If it's only been less than a second, 
     // there's no comparison that can be made, so the function 
     // should return
     return;
   }
 
-  int curr = *(matrix + r * 10);
+  const CaptureSample & curr = s[n - 1];
   // The most recent pressure value read
-  int prev = *(matrix + (r - 1) * 10);
-  // The pressure value read a second ago
-
-  if (prev - curr > 6) {
+  const CaptureSample & prev = s[n - 1 - SAMPLE_RATE_HZ];
+  // The pressure value read about a second ago
+  int64_t drop = (int64_t) (prev.pressure - curr.pressure) * 1000000;
+  uint32_t elapsed = curr.time_us - prev.time_us;
+  // The drop and the time it took in microseconds, measured rather 
+  // than assumed to be a second
+
+  if (drop > (int64_t) MMHG(6) * elapsed) {
     // If the pressure value dropped by more than 
     // 6 mmHg in a second, the deflation is too fast
     snprintf(buffer + 7 * 60, 60, "Deflation is");
     snprintf(buffer + 8 * 60, 60, "TOO FAST.");
     // Update the text in the buffer accordingly
-  } else if ((prev - curr > 0) && (prev - curr < 4)) {
+  } else if ((drop > 0) && (drop < (int64_t) MMHG(4) * elapsed)) {
     // If the pressure value dropped by less than
     // 4 mmHg in a second, the deflation is too slow.
     snprintf(buffer + 7 * 60, 60, "Deflation is");
@@ -603,12 +473,14 @@ void check_release_rate(int r, uint16_t * matrix, char * buffer) {
 
 void timeout_restart() {
   // Restart the program when the pressure wasn't lowered to 30 mmHg 
-  // within 90 seconds. The array in open_valve can only keep storing 
-  // pressure values for 90 seconds, so the program will have to 
-  // restart when the array runs out of space
+  // within max_deflate_seconds(). The capture buffer only has room 
+  // for that long, so the program will have to restart when it runs 
+  // out of space
 
-  char buffer[10][60];
+  ArenaScope scope(text_arena);
+  text_line_t * buffer = alloc_text_lines(10);
   // A buffer for storing texts to be displayed
+  // It comes from the text arena and is given back on return
   int countdown = 30;
   // Stores the number of seconds left before the 
   // program restarts
@@ -655,21 +527,48 @@ void timeout_restart() {
 void show_stats() {
   // Display the heart rate, systolic value and diastolic value on the LCD
 
-  char buffer[10][60];
+  ArenaScope scope(text_arena);
+  text_line_t * buffer = alloc_text_lines(10);
   // A buffer for storing displayed texts
+  // It comes from the text arena and is given back on return
 
   int countdown = 30;
   // For tracking the number of seconds left to count
 
-  snprintf(buffer[0], 60, "Heart rate: %d bpm", heart_rate);
+  snprintf(buffer[0], 60, "Heart rate: %d bpm (%d%%)", heart_rate, heart_rate_confidence);
   snprintf(buffer[1], 60, "Systolic: %d mmHg", systolic);
   snprintf(buffer[2], 60, "Diastolic: %d mmHg", diastolic);
   // heart_rate, systolic and diastolic are global variables, 
-  // and their values have been updated by the calc_stats function
-  snprintf(buffer[3], 60, " ");
+  // and their values have been updated by the deflation analyzer
+  text_line_t * rate = alloc_text_lines(1);
+  // Scratch for a formatted rate, from the same scope
+  format_pressure(rate[0], 60, inflation.pump_rate);
+  snprintf(buffer[3], 60, "Pumped %s/s", rate[0]);
+  format_pressure(rate[0], 60, inflation.leak_rate);
+  snprintf(buffer[4], 60, "Leak %s/s", rate[0]);
+  // From calc_inflation_stats
+  HistoryStats today;
+  uint32_t now = (uint32_t) time(NULL);
+  if (history_index.day_stats(now / SECONDS_PER_DAY, today)) {
+    snprintf(buffer[5], 60, "Today %u/%u x%u", (unsigned) today.mean_systolic,
+             (unsigned) today.mean_diastolic, (unsigned) today.count);
+    // The day's average and how many measurements it is over
+    HistoryStats week = history_index.range_stats(now - 7 * SECONDS_PER_DAY, now + 1);
+    snprintf(buffer[6], 60, "Week sys %u-%u", (unsigned) week.min_systolic,
+             (unsigned) week.max_systolic);
+  } else if (!clock_is_set()) {
+    snprintf(buffer[5], 60, "Set the clock to");
+    snprintf(buffer[6], 60, "keep the trends");
+    // Measurements taken before it is set stay out of them
+  } else {
+    snprintf(buffer[5], 60, " ");
+    snprintf(buffer[6], 60, " ");
+    // No results today
+  }
+  snprintf(buffer[7], 60, " ");
   // Leave an empty line in between
-  snprintf(buffer[4], 60, "Program will start ");
-  snprintf(buffer[5], 60, "over in %d seconds", countdown);
+  snprintf(buffer[8], 60, "Program will start ");
+  snprintf(buffer[9], 60, "over in %d seconds", countdown);
 
   lcd.SelectLayer(FOREGROUND);
   // Use the foregound layer to display the text
@@ -678,7 +577,7 @@ void show_stats() {
 
   while (countdown) {
     int i;
-    for (i = 0; i < 6; i++) {
+    for (i = 0; i < 10; i++) {
       lcd.DisplayStringAt(3, LINE(i + 1), (uint8_t *)buffer[i], LEFT_MODE);
       // Display each text in the buffer at the coordinate (0, LINE(i + 1)), 
       // using the left mode
@@ -688,10 +587,10 @@ void show_stats() {
     // Sleep for a second and then decrement the countdown
     countdown--;
     // Decrement the countdown value
-    snprintf(buffer[5], 60, "over in %d seconds", countdown);
+    snprintf(buffer[9], 60, "over in %d seconds", countdown);
     // Update the countdown value in the buffer
-    lcd.ClearStringLine(6);
-    // Clear Line 6 before refreshing the countdown value
+    lcd.ClearStringLine(10);
+    // Clear Line 10 before refreshing the countdown value
     // to avoid text retention
   }
 
@@ -699,29 +598,129 @@ void show_stats() {
   // Clear the LCD before the function returns
 }
 
+void save_to_history(const SessionResults & results) {
+  // Appends the measurement's summary to the log in the EEPROM
+
+  if (clock_request != 0) {
+    set_time((time_t) clock_request);
+    clock_request = 0;
+    // Sent while the cuff was going up or down; this one already counts
+  }
+  HistoryRecord rec;
+  time_t now = time(NULL);
+  rec.time = (uint32_t) now;
+  rec.flags = clock_is_set() ? HISTORY_CLOCK_SET : 0;
+  if (!results.valid) {
+    rec.flags |= HISTORY_TIMED_OUT;
+  }
+  rec.systolic = (uint16_t) results.systolic;
+  rec.diastolic = (uint16_t) results.diastolic;
+  rec.heart_rate = (uint8_t) (results.heart_rate > 255 ? 255 : results.heart_rate);
+
+  history.append(rec);
+  // Queued on eeprom_writer, which programs the four pages in the 
+  // background while the sampler keeps going
+}
+
 int main() {
   setup_lcd_background();
   setup_lcd_foreground();
   // Prepare the LCD for displaying texts
 
+  platform_init();
+  // Start the thread that talks to the sensor
+  if (eeprom_init()) {
+    history.begin();
+    // Find the newest measurement in the log
+    history_index.build(history);
+    history.use_index(&history_index);
+    // Read the whole log once for the trend lines; appends keep it
+    // up to date after that
+    eeprom_writer.begin(eeprom_address());
+    history.use_writer(&eeprom_writer);
+  }
+  // The EEPROM driver sets the I2C peripheral up for itself, so this 
+  // comes before the bus speed is set for the sensor
+  Wire.frequency(400000);
+  // The sensor supports fast mode, which cuts the bus time per sample
+  setup_sensor(&shared_wire);
+  // Talk to the sensor over the I2C peripheral
+  set_max_deflate_seconds(MAX_DEFLATE_SECONDS);
+  // Allocate the capture buffer once, up front
+  sdram_init();
+  recorder.begin(SESSION_MAX_MINUTES * 60 * MAX_SAMPLE_RATE_HZ);
+  // Keep whole sessions in the SDRAM the LCD doesn't use
+#ifdef OVERSAMPLE
+  start_oversampled_acquisition(SAMPLE_RATE_HZ);
+  // Sample at 7x the rate and decimate for a quieter signal 
+  // (build with -DOVERSAMPLE)
+#else
+  start_acquisition(SAMPLE_RATE_HZ);
+  // Take samples at a fixed rate paced by a timer interrupt
+#endif
+
+#ifdef EOC_PIN
+  eoc_int.rise(&eoc_isr);
+  sensor.use_eoc(true);
+  // Read each sample as soon as EOC goes high
+#endif
+
   button_int.rise(&button_isr);
   // If a button interrupt occurs, call the button ISR
+  usb_serial.on_receive(serial_rx_isr, NULL);
+  // The computer can set the clock over the virtual COM port
+#ifdef LIVE_TELEMETRY
+  analyzer.on_beat(send_beat, NULL);
+  // Stream the beats the results come from
+#endif
 
   while(1) {
     restarted_after_timeout = 0;
     // Reset this to 0 at the beginning of every iteration
+    while (exporter.busy()) {
+      thread_sleep_for(10);
+      // The last session is still being sent, and the new one would 
+      // overwrite it; this only waits after very long sessions
+    }
+    recorder.start();
+    // Start a new session recording
     pump_up_to_150();
     // Ask the user to keep pumping until the 
     // pressure reaches 150 mmHg
     open_valve();
     // Ask the user to open the valve
+    recorder.finish();
+    // Flush the rest of the session to SDRAM
+    analyzer.end_deflation();
+    // The last beat counts for the heart rate, and goes out with the
+    // telemetry before that is flushed
+#ifdef LIVE_TELEMETRY
+    telemetry.flush();
+    while (usb_serial.busy()) {
+      thread_sleep_for(1);
+      // Let the last frame out before the export takes the port
+    }
+#endif
 
+    SessionResults results = {0, 0, 0, false};
     if (!restarted_after_timeout) {
       // Only call these functions if the program didn't restart 
       // because of a timeout
-      calc_stats();
-      // Calculate the heart rate, the systolic pressure and 
-      // the diastolic pressure
+      analyzer.finish();
+      // Set the heart rate, the systolic pressure and the diastolic 
+      // pressure, already worked out during the deflation
+      calc_inflation_stats();
+      // And how the cuff was pumped up
+      results.heart_rate = heart_rate;
+      results.systolic = systolic;
+      results.diastolic = diastolic;
+      results.valid = true;
+    }
+    save_to_history(results);
+    // Keep the results once the screen has moved on
+    exporter.start(recorder, results);
+    // Send the session to the computer in the background, results or not
+    if (!restarted_after_timeout) {
       show_stats();
       // Display the stats on the LCD
     }
@@ -0,0 +1,254 @@
+#include "oscillometry.h"
+#include "analysis.h"
+#include "dsp_kernels.h"
+
+static_assert(OSC_MAX_AMPLITUDE <= 32767, "the envelope is searched as 16-bit samples");
+
+OscillometricAnalyzer::OscillometricAnalyzer(uint32_t rate_hz) : beat_cb(NULL), beat_ctx(NULL) {
+  set_sample_rate(rate_hz);
+}
+
+void OscillometricAnalyzer::set_sample_rate(uint32_t rate_hz) {
+  design_cuff_filter(band, rate_hz);
+  reset();
+}
+
+void OscillometricAnalyzer::reset() {
+  started = false;
+  last_us = 0;
+  filtered = 0;
+  deflating = false;
+  falling_us = 0;
+  top = 0;
+  rate = 0;
+  rising = false;
+  have_trough = false;
+  have_peak = false;
+  count = 0;
+  settled = 0;
+  pulse.reset();
+}
+
+void OscillometricAnalyzer::on_beat(beat_callback_t cb, void * ctx) {
+  beat_cb = cb;
+  beat_ctx = ctx;
+}
+
+void OscillometricAnalyzer::update(uint32_t time_us, pressure_t p) {
+  bool first = !started;
+  if (first) {
+    filtered = p;
+    band.prime(p);
+    top = p;
+    started = true;
+  } else {
+    uint32_t dt = time_us - last_us;
+    pressure_t change = (pressure_t) ((int64_t) (p - filtered) * dt / (OSC_SMOOTHING_US + dt));
+    filtered += change;
+    // A first-order low-pass whose time constant doesn't depend on the
+    // sample rate
+    if (dt > 0) {
+      int32_t slope = (int32_t) ((int64_t) change * 1000000 / dt);
+      rate += (int32_t) ((int64_t) (slope - rate) * dt / (OSC_RAMP_US + dt));
+      // The beats average out over a few of them, leaving the ramp
+    }
+    if (deflating && filtered > top + OSC_MAX_AMPLITUDE) {
+      deflating = false;
+      count = 0;
+      settled = 0;
+      pulse.reset();
+      // Squeezed again, higher than a pulse could take it: the beats so
+      // far were the squeezes
+    }
+    if (!deflating) {
+      top = filtered > top ? filtered : top;
+      falling_us = rate < -OSC_SETTLE_RATE && filtered < top ? falling_us + dt : 0;
+      // A squeeze of the bulb starts the wait again
+      if (falling_us >= OSC_SETTLE_US) {
+        deflating = true;
+        top = filtered;
+        rising = false;
+        have_trough = false;
+        have_peak = false;
+      }
+    }
+  }
+  last_us = time_us;
+  Point now = {time_us, filtered, first ? 0 : band.push(p)};
+  if (!deflating) {
+    extreme = now;
+    return;
+  }
+
+  if (rising) {
+    if (now.d > extreme.d) {
+      extreme = now;
+    } else if (extreme.d - now.d >= OSC_HYSTERESIS) {
+      peak = extreme;
+      have_peak = have_trough;
+      // A peak only makes a beat with a trough before it
+      rising = false;
+      extreme = now;
+    }
+  } else {
+    if (now.d < extreme.d) {
+      extreme = now;
+    } else if (now.d - extreme.d >= OSC_HYSTERESIS) {
+      on_trough(extreme);
+      rising = true;
+      extreme = now;
+    }
+  }
+}
+
+void OscillometricAnalyzer::on_trough(const Point & t) {
+  // Closes the beat between the previous trough and t
+
+  if (have_peak && t.time_us != trough.time_us
+      && t.time_us - trough.time_us <= OSC_MAX_BEAT_US) {
+    int64_t along = peak.time_us - trough.time_us;
+    int64_t span = t.time_us - trough.time_us;
+    pressure_t base = trough.d + (pressure_t) ((t.d - trough.d) * along / span);
+    // The baseline under the peak, on the line between the troughs
+    pressure_t cuff = trough.p + (pressure_t) ((t.p - trough.p) * along / span);
+    // The cuff pressure there, ramp and all
+    Beat b = {peak.time_us, cuff, peak.d - base};
+    if (b.amplitude > 0 && b.amplitude <= OSC_MAX_AMPLITUDE) {
+      if (count > 0 && peak.time_us - beat[count - 1].time_us < OSC_MIN_BEAT_US) {
+        if (b.amplitude > beat[count - 1].amplitude) {
+          beat[count - 1] = b;
+          // A notch split the beat in two; keep the larger part
+        }
+      } else {
+        settle();
+        // No notch can replace the last beat now
+        if (count < OSC_MAX_BEATS) {
+          beat[count++] = b;
+        }
+      }
+    }
+  }
+  trough = t;
+  have_trough = true;
+  have_peak = false;
+}
+
+void OscillometricAnalyzer::settle() {
+  // Passes the last beat on, once
+
+  if (settled < count) {
+    pulse.beat(beat[count - 1].time_us);
+    if (beat_cb != NULL) {
+      beat_cb(beat_ctx, beat[count - 1].time_us, beat[count - 1].pressure);
+    }
+    settled = count;
+  }
+}
+
+void OscillometricAnalyzer::end_deflation() {
+  settle();
+}
+
+static pressure_t crossing(pressure_t p0, pressure_t a0, pressure_t p1, pressure_t a1,
+                           pressure_t level) {
+  // The pressure between two beats where the envelope crosses level,
+  // with a0 below level and a1 at or above it
+
+  if (a1 == a0) {
+    return p1;
+  }
+  return p0 + (pressure_t) ((int64_t) (p1 - p0) * (level - a0) / (a1 - a0));
+}
+
+static pressure_t median3(pressure_t a, pressure_t b, pressure_t c) {
+  if (a > b) {
+    pressure_t t = a;
+    a = b;
+    b = t;
+  }
+  return c < a ? a : (c > b ? b : c);
+}
+
+pressure_t OscillometricAnalyzer::median_at(int i) const {
+  // The median of beat i's amplitude and its neighbours', so a lone beat
+  // spoiled by a movement can't become the peak
+
+  if (i == 0 || i == count - 1) {
+    return beat[i].amplitude;
+  }
+  return median3(beat[i - 1].amplitude, beat[i].amplitude, beat[i + 1].amplitude);
+}
+
+OscillometryResult OscillometricAnalyzer::result() const {
+  OscillometryResult r = {0, 0, 0, 0, count, 0, 0, 0};
+  if (count < 5) {
+    r.flags = OSC_TOO_FEW_BEATS;
+    return r;
+  }
+
+  int16_t env[OSC_MAX_BEATS];
+  // No beat is larger than OSC_MAX_AMPLITUDE, so 16 bits hold them
+  int i;
+  for (i = 0; i < count; i++) {
+    pressure_t before = median_at(i > 0 ? i - 1 : i);
+    pressure_t here = median_at(i);
+    pressure_t after = median_at(i < count - 1 ? i + 1 : i);
+    env[i] = (int16_t) ((before + 2 * here + after + 2) / 4);
+  }
+
+  int m = dsp_peak16(env, count);
+  // The first of the largest, two beats an instruction on the board
+  r.max_amplitude = env[m];
+  r.mean_arterial = beat[m].pressure;
+  if (m > 0 && m < count - 1) {
+    int64_t curve = (int64_t) env[m - 1] - 2 * env[m] + env[m + 1];
+    if (curve < 0) {
+      int64_t offset = ((int64_t) env[m - 1] - env[m + 1]) * 128 / curve;
+      // Where a parabola through the three beats peaks, in 1/256 of a
+      // beat from m, between -128 and 128
+      r.mean_arterial += (pressure_t) (offset * (beat[m + 1].pressure - beat[m - 1].pressure) / 512);
+    }
+  }
+
+  pressure_t level = (pressure_t) ((int64_t) env[m] * SYSTOLIC_RATIO / 256);
+  r.systolic = beat[0].pressure;
+  r.flags |= OSC_NO_SYSTOLIC_EDGE;
+  for (i = m - 1; i >= 0; i--) {
+    if (env[i] < level) {
+      r.systolic = crossing(beat[i].pressure, env[i], beat[i + 1].pressure, env[i + 1], level);
+      r.flags &= (uint8_t) ~OSC_NO_SYSTOLIC_EDGE;
+      break;
+    }
+  }
+  // The beats before the peak are at higher pressures
+
+  level = (pressure_t) ((int64_t) env[m] * DIASTOLIC_RATIO / 256);
+  r.diastolic = beat[count - 1].pressure;
+  r.flags |= OSC_NO_DIASTOLIC_EDGE;
+  for (i = m + 1; i < count; i++) {
+    if (env[i] < level) {
+      r.diastolic = crossing(beat[i].pressure, env[i], beat[i - 1].pressure, env[i - 1], level);
+      r.flags &= (uint8_t) ~OSC_NO_DIASTOLIC_EDGE;
+      break;
+    }
+  }
+
+  HeartRateEstimator all = pulse;
+  if (settled < count) {
+    all.beat(beat[count - 1].time_us);
+    // A copy with the last beat in too, so result can be asked for
+    // mid-way
+  }
+  r.heart_rate = all.bpm();
+  r.heart_rate_confidence = all.confidence();
+  return r;
+}
+
+void OscillometricAnalyzer::finish() {
+  end_deflation();
+  OscillometryResult r = result();
+  systolic = pressure_to_mmhg(r.systolic);
+  diastolic = pressure_to_mmhg(r.diastolic);
+  heart_rate = r.heart_rate;
+  heart_rate_confidence = r.heart_rate_confidence;
+}
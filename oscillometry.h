@@ -0,0 +1,171 @@
+#ifndef OSCILLOMETRY_H
+#define OSCILLOMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pressure.h"
+#include "heart_rate.h"
+#include "biquad.h"
+#include "sampler.h"
+
+#define OSC_MAX_BEATS 160
+// Beats kept per deflation: 120 s at 80 bpm
+#define OSC_SMOOTHING_US 20000
+// The time constant of the low-pass filter the cuff pressure goes through
+#define OSC_RAMP_US 1500000
+// The time constant the deflation rate is averaged over, several beats
+#define OSC_HYSTERESIS MMHG(0.25)
+// How far the oscillation has to turn before a peak or a trough
+// counts; more than the sensor noise, less than the smallest oscillation
+// the envelope is read at
+#define OSC_MIN_BEAT_US 300000
+// Peaks closer than this (200 bpm) are the same beat; the larger is kept
+#define OSC_MAX_BEAT_US 2000000
+// Troughs further apart than this (30 bpm) aren't a beat
+#define OSC_SETTLE_US 1000000
+#define OSC_SETTLE_RATE MMHG(0.5)
+// The beats are only looked for once the filtered pressure has been
+// below its last peak and falling faster than this (per second) for
+// OSC_SETTLE_US: before that the cuff is still being pumped, or squeezed
+// again after 150 mmHg, and every squeeze would look like a beat
+#define OSC_MAX_AMPLITUDE MMHG(10)
+// A pulse makes oscillations of a few mmHg; anything larger is a
+// movement or a squeeze of the bulb, not a beat. A rise this far above
+// where the deflation seemed to start means the bulb was squeezed again,
+// and the beats start over
+#define SYSTOLIC_RATIO 141
+#define DIASTOLIC_RATIO 192
+// The characteristic ratios, in 1/256 of the largest oscillation: the
+// systolic pressure is where the envelope has fallen to 0.55 of its peak
+// on the high-pressure side, the diastolic where it has fallen to 0.75
+// on the low-pressure side
+
+enum OscillometryFlags {
+  OSC_NO_SYSTOLIC_EDGE = 1,
+  // The envelope never fell to SYSTOLIC_RATIO above the peak: the cuff
+  // wasn't pumped high enough, and systolic is the highest beat's pressure
+  OSC_NO_DIASTOLIC_EDGE = 2,
+  // The same below the peak: the deflation stopped too early
+  OSC_TOO_FEW_BEATS = 4
+  // Fewer than 5 beats; there are no results
+};
+
+struct OscillometryResult {
+  pressure_t systolic;
+  pressure_t diastolic;
+  pressure_t mean_arterial;
+  // The cuff pressure where the oscillations are largest
+  pressure_t max_amplitude;
+  int beats;
+  int heart_rate;
+  // In beats per minute, 0 if unknown
+  int heart_rate_confidence;
+  // From 0 to 100 (see HeartRateEstimator)
+  uint8_t flags;
+  // OscillometryFlags
+};
+
+typedef void (*beat_callback_t)(void * ctx, uint32_t time_us, pressure_t p);
+
+// Finds the blood pressure from the envelope of the oscillations the
+// pulse makes in the cuff pressure as it deflates, one sample at a time
+// Nothing counts until the pressure is falling steadily below its last
+// peak, so squeezing the bulb after the cuff is up makes no beats
+// Each sample goes through the band-pass CuffFilter (see biquad.h),
+// designed for the sample rate, which takes out the ramp and the sensor
+// noise and leaves the oscillation; a trough of it followed by a peak
+// and the next trough make a beat. The cuff pressure at the beat comes
+// from a separate low-pass filter, which also tells when the deflation
+// has started. The baseline under the peak is the straight line between
+// the two troughs, which takes out what is left of the ramp, and the
+// beat's amplitude is the peak's height above it
+// result smooths the amplitudes (a median of 3, then a 1-2-1 average),
+// takes the mean arterial pressure at the largest one, and interpolates
+// between the beats on either side where the envelope crosses the
+// characteristic ratios. The heart rate comes from a HeartRateEstimator
+// fed with every beat, which drops the extra and missed ones at the
+// low-amplitude ends of the deflation
+// Everything is fixed point (1/256 mmHg) and update is the two filter
+// stages, a few compares and two divisions
+class OscillometricAnalyzer {
+public:
+  explicit OscillometricAnalyzer(uint32_t rate_hz = SAMPLE_RATE_HZ);
+  void set_sample_rate(uint32_t rate_hz);
+  // The rate the samples come at, which the band-pass filter is designed
+  // for; then reset
+  void reset();
+  // Starts a new deflation
+  void update(uint32_t time_us, pressure_t p);
+  // Adds the next deflation sample
+  void end_deflation();
+  // The deflation is over: passes the last beat on to the heart rate and
+  // the on_beat callback, since no notch can replace it now
+  OscillometryResult result() const;
+  void finish();
+  // Calls end_deflation, then sets heart_rate, heart_rate_confidence,
+  // systolic and diastolic (see analysis.h) from result(), or to 0 if
+  // there are too few beats
+  int beats() const { return count; }
+  pressure_t beat_pressure(int i) const { return beat[i].pressure; }
+  pressure_t beat_amplitude(int i) const { return beat[i].amplitude; }
+  // The envelope, beat by beat, before smoothing
+  void on_beat(beat_callback_t cb, void * ctx);
+  // Calls cb(ctx, time_us, pressure) for each beat once it is final,
+  // which is when the next one is found (a notch may still replace the
+  // last), or from end_deflation for the last; reset doesn't clear it
+
+private:
+  struct Beat {
+    uint32_t time_us;
+    // The peak
+    pressure_t pressure;
+    // The baseline under the peak
+    pressure_t amplitude;
+  };
+
+  struct Point {
+    uint32_t time_us;
+    pressure_t p;
+    // The filtered pressure
+    pressure_t d;
+    // The same with the ramp taken out, which the beats are found in
+  };
+
+  void on_trough(const Point & t);
+  void settle();
+  pressure_t median_at(int i) const;
+
+  bool started;
+  uint32_t last_us;
+  pressure_t filtered;
+  bool deflating;
+  // The valve is letting the air out; until then no beats are looked for
+  uint32_t falling_us;
+  // How long the pressure has been falling steadily
+  pressure_t top;
+  // The highest filtered pressure before deflating
+  int32_t rate;
+  // The average change of the filtered pressure, in 1/256 mmHg a second
+  CuffFilter band;
+  // Takes the ramp out, and the sensor noise
+  bool rising;
+  // Looking for a peak; otherwise for a trough
+  Point extreme;
+  // The highest (or lowest) point since the last turn
+  bool have_trough;
+  Point trough;
+  bool have_peak;
+  Point peak;
+  // The peak after trough, waiting for the next trough
+  Beat beat[OSC_MAX_BEATS];
+  int count;
+  int settled;
+  // The beats passed on to pulse and the callback
+  HeartRateEstimator pulse;
+  // Has every beat but the last until end_deflation, since a notch may
+  // still replace it
+  beat_callback_t beat_cb;
+  void * beat_ctx;
+};
+
+#endif
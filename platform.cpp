@@ -0,0 +1,204 @@
+#include "platform.h"
+
+#ifdef __MBED__
+
+static EventFlags wake_flags;
+// Set by platform_wake, waited on by platform_wait_for_event
+#define ACQUISITION_QUEUE_BYTES (32 * EVENTS_EVENT_SIZE)
+#define ACQUISITION_STACK_BYTES 4096
+// The mbed default thread stack size
+static unsigned char queue_memory[ACQUISITION_QUEUE_BYTES];
+MBED_ALIGN(8) static unsigned char stack_memory[ACQUISITION_STACK_BYTES];
+// Both live in static memory so that nothing is taken from the heap
+static EventQueue acquisition_queue(ACQUISITION_QUEUE_BYTES, queue_memory);
+// Work handed over by interrupts
+static Thread acquisition_thread(osPriorityAboveNormal, ACQUISITION_STACK_BYTES, stack_memory);
+// Runs the queued work ahead of the UI in main
+
+void platform_init() {
+  acquisition_thread.start(callback(&acquisition_queue, &EventQueue::dispatch_forever));
+}
+
+void platform_defer(platform_callback_t cb, void * ctx) {
+  acquisition_queue.call(cb, ctx);
+}
+
+uint64_t platform_now_us() {
+  return ticker_read_us(get_us_ticker_data());
+  // The microsecond ticker keeps running while the thread sleeps
+}
+
+void platform_sleep_ms(uint32_t ms) {
+  thread_sleep_for(ms);
+}
+
+void platform_wait_for_event() {
+  wake_flags.wait_any(1U);
+  // The thread sleeps until an interrupt sets the flag
+}
+
+void platform_wake() {
+  wake_flags.set(1U);
+}
+
+PlatformTimer::PlatformTimer() : period_us(0), one_shot(false), cb(NULL), ctx(NULL) {}
+
+PlatformTimer::~PlatformTimer() {
+  detach();
+}
+
+void PlatformTimer::attach_us(platform_callback_t cb, void * ctx, uint32_t period_us) {
+  this->cb = cb;
+  this->ctx = ctx;
+  this->period_us = period_us;
+  one_shot = false;
+  ticker.attach(callback(this, &PlatformTimer::fire), std::chrono::microseconds(period_us));
+}
+
+void PlatformTimer::attach_once_us(platform_callback_t cb, void * ctx, uint32_t delay_us) {
+  attach_us(cb, ctx, delay_us);
+  one_shot = true;
+  // fire detaches the ticker before running the callback
+}
+
+void PlatformTimer::detach() {
+  ticker.detach();
+  period_us = 0;
+}
+
+#else
+
+#define MAX_HOST_TIMERS 32
+// The number of simulated timers that can be attached at the same time
+
+static uint64_t sim_now_us = 0;
+// The simulated clock used on the host
+static PlatformTimer * host_timers[MAX_HOST_TIMERS];
+// The attached simulated timers
+
+void platform_init() {
+}
+
+void platform_defer(platform_callback_t cb, void * ctx) {
+  cb(ctx);
+  // Simulated interrupts already run in the thread that advances the clock
+}
+
+uint64_t platform_now_us() {
+  return sim_now_us;
+}
+
+void platform_sleep_ms(uint32_t ms) {
+  host_clock_advance_us((uint64_t) ms * 1000U);
+  // Sleeping costs nothing on the host; only the simulated time moves
+}
+
+static PlatformTimer * next_timer() {
+  // Returns the attached timer that fires first, or NULL
+
+  PlatformTimer * next = NULL;
+  int i;
+  for (i = 0; i < MAX_HOST_TIMERS; i++) {
+    PlatformTimer * t = host_timers[i];
+    if (t != NULL && (next == NULL || t->next_us < next->next_us)) {
+      next = t;
+    }
+  }
+  return next;
+}
+
+void platform_wait_for_event() {
+  PlatformTimer * t = next_timer();
+  if (t == NULL) {
+    host_clock_advance_us(1000);
+    // Nothing will ever wake us up; let a millisecond pass instead
+    return;
+  }
+  host_clock_advance_us(t->next_us > sim_now_us ? t->next_us - sim_now_us : 0);
+}
+
+void platform_wake() {
+  // platform_wait_for_event returns after every timer event on the host
+}
+
+void host_clock_reset() {
+  sim_now_us = 0;
+  int i;
+  for (i = 0; i < MAX_HOST_TIMERS; i++) {
+    if (host_timers[i] != NULL) {
+      host_timers[i]->next_us = host_timers[i]->period_us;
+    }
+  }
+  // Attached timers restart along with the clock
+}
+
+void host_clock_advance_us(uint64_t us) {
+  uint64_t target = sim_now_us + us;
+  PlatformTimer * t = next_timer();
+  while (t != NULL && t->next_us <= target) {
+    // Fire every timer that falls due, in time order
+    if (t->next_us > sim_now_us) {
+      sim_now_us = t->next_us;
+    }
+    t->next_us += t->period_us;
+    if (t->one_shot) {
+      t->detach();
+    }
+    t->fire();
+    // The callback may attach the timer again
+    t = next_timer();
+  }
+  sim_now_us = target;
+}
+
+PlatformTimer::PlatformTimer() : next_us(0), period_us(0), one_shot(false), cb(NULL), ctx(NULL) {}
+
+PlatformTimer::~PlatformTimer() {
+  detach();
+}
+
+void PlatformTimer::attach_us(platform_callback_t cb, void * ctx, uint32_t period_us) {
+  detach();
+  this->cb = cb;
+  this->ctx = ctx;
+  this->period_us = period_us;
+  one_shot = false;
+  next_us = sim_now_us + period_us;
+
+  int i;
+  for (i = 0; i < MAX_HOST_TIMERS; i++) {
+    if (host_timers[i] == NULL) {
+      host_timers[i] = this;
+      return;
+    }
+  }
+}
+
+void PlatformTimer::attach_once_us(platform_callback_t cb, void * ctx, uint32_t delay_us) {
+  attach_us(cb, ctx, delay_us);
+  one_shot = true;
+}
+
+void PlatformTimer::detach() {
+  int i;
+  for (i = 0; i < MAX_HOST_TIMERS; i++) {
+    if (host_timers[i] == this) {
+      host_timers[i] = NULL;
+    }
+  }
+  period_us = 0;
+}
+
+#endif
+
+void PlatformTimer::fire() {
+#ifdef __MBED__
+  if (one_shot) {
+    ticker.detach();
+    period_us = 0;
+  }
+#endif
+  if (cb != NULL) {
+    cb(ctx);
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Time helpers shared by the firmware and the Linux build of the core logic.
+// On the board (__MBED__ defined) they map onto mbed OS. On the host they
+// drive a simulated clock, so a recorded session can be replayed as fast as
+// the CPU allows instead of in real time.
+
+typedef void (*platform_callback_t)(void *);
+// Callbacks take a context pointer so the same code runs with and without mbed
+
+uint64_t platform_now_us();
+// Returns the time since boot (or since the simulated clock was reset) in
+// microseconds
+void platform_sleep_ms(uint32_t ms);
+// Sleeps for the given number of milliseconds
+// On the host this only advances the simulated clock
+void platform_wait_for_event();
+// Blocks until platform_wake is called from an interrupt
+// On the host this jumps the simulated clock to the next timer event
+void platform_wake();
+// Wakes up platform_wait_for_event; safe to call from interrupts
+
+void platform_init();
+// Starts the acquisition thread; called once at the top of main
+void platform_defer(platform_callback_t cb, void * ctx);
+// Runs cb(ctx) on the acquisition thread; safe to call from interrupts
+// Work that needs the I2C driver can't run in an interrupt, so interrupt 
+// handlers hand it over with this function
+// On the host it runs cb(ctx) right away
+
+#ifdef __MBED__
+#include <mbed.h>
+#endif
+
+// A timer interrupt, either periodic or one-shot
+// On the board it is backed by an mbed Ticker, which runs off the
+// microsecond timer (a LowPowerTicker would only give millisecond resolution)
+class PlatformTimer {
+public:
+  PlatformTimer();
+  ~PlatformTimer();
+  void attach_us(platform_callback_t cb, void * ctx, uint32_t period_us);
+  // Calls cb(ctx) every period_us microseconds until detached
+  void attach_once_us(platform_callback_t cb, void * ctx, uint32_t delay_us);
+  // Calls cb(ctx) once, delay_us microseconds from now
+  void detach();
+  void fire();
+  // Runs the callback; called by the timer interrupt
+
+#ifndef __MBED__
+  uint64_t next_us;
+  // When the simulated timer fires next
+#endif
+  uint32_t period_us;
+  // The period or the delay; 0 while detached
+  bool one_shot;
+
+private:
+  platform_callback_t cb;
+  void * ctx;
+#ifdef __MBED__
+  Ticker ticker;
+#endif
+};
+
+#ifndef __MBED__
+void host_clock_reset();
+// Rewinds the simulated clock to 0, called before replaying a new session
+void host_clock_advance_us(uint64_t us);
+// Moves the simulated clock forward by the given number of microseconds,
+// firing every timer that falls due on the way
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Pressures are kept in fixed point, in 1/256 mmHg, from the moment a
+// reading is converted to the moment it is displayed
+// Whole mmHg would throw away most of the 1-3 mmHg oscillations the
+// blood pressure is measured from
+
+typedef int32_t pressure_t;
+// A pressure in 1/256 mmHg (Q24.8), good for +/- 8 million mmHg
+#define PRESSURE_FRAC_BITS 8
+#define MMHG(x) ((pressure_t) ((x) * (1 << PRESSURE_FRAC_BITS)))
+// Converts a constant in mmHg at compile time, e.g. MMHG(150)
+
+static inline int pressure_to_mmhg(pressure_t p) {
+  // Rounds to whole mmHg
+
+  return (p + (1 << (PRESSURE_FRAC_BITS - 1))) >> PRESSURE_FRAC_BITS;
+}
+
+static inline void format_pressure(char * buf, int len, pressure_t p) {
+  // Writes the pressure with one decimal, e.g. "123.4 mmHg"
+
+  int64_t t = (int64_t) p * 10;
+  int tenths = (int) ((t + (t < 0 ? -128 : 128)) / (1 << PRESSURE_FRAC_BITS));
+  // Round half away from zero
+  const char * sign = tenths < 0 ? "-" : "";
+  if (tenths < 0) {
+    tenths = -tenths;
+  }
+  snprintf(buf, len, "%s%d.%d mmHg", sign, tenths / 10, tenths % 10);
+}
+
+#endif
@@ -0,0 +1,259 @@
+#include "pressure_bus.h"
+#include "platform.h"
+
+int PressureBus::transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+                          uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) {
+  int result = 0;
+  if (tx_len > 0) {
+    result = write(addr & ~1U, tx, tx_len);
+  }
+  if (result == 0 && rx_len > 0) {
+    result = read(addr | 1U, rx, rx_len);
+  }
+  cb(ctx, result);
+  return 0;
+}
+
+SharedBus::SharedBus(PressureBus * bus)
+    : bus(bus), head(0), tail(0), in_flight(false), queued(0) {}
+
+int SharedBus::write(uint8_t addr, const uint8_t * data, int len) {
+  return bus->write(addr, data, len);
+}
+
+int SharedBus::read(uint8_t addr, uint8_t * data, int len) {
+  return bus->read(addr, data, len);
+}
+
+int SharedBus::transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+                        uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) {
+  if (tail - head == SHARED_BUS_QUEUE_LEN) {
+    return -1;
+  }
+
+  Transfer t = {addr, tx, tx_len, rx, rx_len, cb, ctx};
+  if (in_flight || tail != head) {
+    queued++;
+  }
+  pending[tail % SHARED_BUS_QUEUE_LEN] = t;
+  tail++;
+  pump(this);
+  return 0;
+}
+
+void SharedBus::on_done(void * ctx, int result) {
+  // Called from the I2C interrupt when the transfer in flight ends
+
+  SharedBus * b = (SharedBus *) ctx;
+  Transfer t = b->current;
+  b->in_flight = false;
+  t.cb(t.ctx, result);
+  platform_defer(&SharedBus::pump, b);
+  // The next transfer can't be started from the interrupt
+}
+
+void SharedBus::pump(void * ctx) {
+  // Starts the oldest waiting transfer if the bus is free; runs on the
+  // acquisition thread
+
+  SharedBus * b = (SharedBus *) ctx;
+  while (!b->in_flight && b->tail != b->head) {
+    b->current = b->pending[b->head % SHARED_BUS_QUEUE_LEN];
+    b->head++;
+    b->in_flight = true;
+    Transfer & t = b->current;
+    if (b->bus->transfer(t.addr, t.tx, t.tx_len, t.rx, t.rx_len, &SharedBus::on_done, b) != 0) {
+      b->in_flight = false;
+      t.cb(t.ctx, -1);
+      // Report the failure the way a failed transfer would be reported
+    }
+  }
+}
+
+#ifdef __MBED__
+
+int MbedI2CBus::write(uint8_t addr, const uint8_t * data, int len) {
+  return i2c.write(addr, (const char *) data, len, false);
+}
+
+int MbedI2CBus::read(uint8_t addr, uint8_t * data, int len) {
+  return i2c.read(addr, (char *) data, len, false);
+}
+
+int MbedI2CBus::transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+                         uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) {
+  this->cb = cb;
+  this->ctx = ctx;
+  return i2c.transfer(addr, (const char *) tx, tx_len, (char *) rx, rx_len,
+                      callback(this, &MbedI2CBus::on_event), I2C_EVENT_ALL);
+  // mbed sets the R/W bit itself for each phase of the transfer
+}
+
+void MbedI2CBus::on_event(int event) {
+  // Called from the I2C interrupt
+
+  cb(ctx, (event & I2C_EVENT_TRANSFER_COMPLETE) ? 0 : -1);
+}
+
+#else
+
+#include <stdio.h>
+
+#define BUS_BYTE_US 23
+// A byte plus its ACK bit takes 22.5 us at 400 kHz
+
+TraceReplayBus::TraceReplayBus(uint8_t addr_7bit, uint32_t conversion_us)
+    : addr_7bit(addr_7bit), conversion_us(conversion_us),
+      transfer_cb(NULL), transfer_ctx(NULL), transfer_result(0),
+      eoc_cb(NULL), eoc_ctx(NULL) {
+  clear();
+}
+
+void TraceReplayBus::clear() {
+  entries.clear();
+  busy_until_us = 0;
+  cursor = 0;
+  pending = 0;
+}
+
+void TraceReplayBus::add(uint32_t time_us, uint8_t status, uint32_t counts) {
+  Entry e = {time_us, status, counts & 0xFFFFFFU};
+  // The sensor only reports 24 bits
+  entries.push_back(e);
+}
+
+bool TraceReplayBus::load(const char * path) {
+  FILE * f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+
+  clear();
+  char line[128];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long t;
+    unsigned int status;
+    unsigned long counts;
+    if (line[0] == '#') {
+      continue;
+      // Skip comments
+    }
+    if (sscanf(line, "%lu %u %lu", &t, &status, &counts) == 3) {
+      add((uint32_t) t, (uint8_t) status, (uint32_t) counts);
+    }
+  }
+
+  fclose(f);
+  return !entries.empty();
+}
+
+bool TraceReplayBus::finished() const {
+  return entries.empty() || platform_now_us() > entries.back().time_us;
+}
+
+int TraceReplayBus::write(uint8_t addr, const uint8_t * data, int len) {
+  if ((addr >> 1U) != addr_7bit || (addr & 1U)) {
+    return -1;
+    // No device answers on this address
+  }
+
+  if (len == 3 && data[0] == 0xAA) {
+    // The Output Measurement Command starts a new conversion
+    uint64_t now = platform_now_us();
+    int i = pending;
+    while (i + 1 < (int) entries.size() && entries[i + 1].time_us <= now) {
+      i++;
+    }
+    // Find the latest entry recorded at or before now
+    if (now >= busy_until_us) {
+      cursor = pending;
+      // The previous conversion had completed before this command
+    }
+    pending = i;
+    busy_until_us = now + conversion_us;
+    if (eoc_cb != NULL) {
+      eoc_timer.attach_once_us(&TraceReplayBus::on_conversion_done, this, conversion_us);
+      // EOC goes high when the conversion completes
+    }
+  }
+
+  return 0;
+}
+
+int TraceReplayBus::read(uint8_t addr, uint8_t * data, int len) {
+  if ((addr >> 1U) != addr_7bit || !(addr & 1U)) {
+    return -1;
+  }
+
+  uint8_t busy = platform_now_us() < busy_until_us;
+  if (!busy) {
+    cursor = pending;
+    // The conversion in progress has completed
+  }
+
+  Entry e = {0, 0x40, 0};
+  if (!entries.empty()) {
+    e = entries[cursor];
+  }
+
+  uint8_t bytes[4];
+  bytes[0] = (uint8_t) ((e.status & ~32U) | (busy ? 32U : 0U));
+  // Bit 5 is the busy flag; the rest comes from the trace
+  bytes[1] = (uint8_t) (e.counts >> 16U);
+  bytes[2] = (uint8_t) (e.counts >> 8U);
+  bytes[3] = (uint8_t) e.counts;
+
+  int i;
+  for (i = 0; i < len; i++) {
+    data[i] = i < 4 ? bytes[i] : 0;
+  }
+
+  return 0;
+}
+
+int TraceReplayBus::transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+                             uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) {
+  if (transfer_cb != NULL) {
+    return -1;
+    // A transfer is already in flight
+  }
+
+  int result = 0;
+  int bytes = 0;
+  if (tx_len > 0) {
+    result = write(addr & ~1U, tx, tx_len);
+    bytes += 1 + tx_len;
+  }
+  if (result == 0 && rx_len > 0) {
+    result = read(addr | 1U, rx, rx_len);
+    bytes += 1 + rx_len;
+  }
+  // The data moves right away; only the completion is delayed
+  // The address byte is counted once per phase
+
+  transfer_cb = cb;
+  transfer_ctx = ctx;
+  transfer_result = result;
+  transfer_timer.attach_once_us(&TraceReplayBus::on_transfer_done, this, bytes * BUS_BYTE_US);
+  return 0;
+}
+
+void TraceReplayBus::on_eoc(platform_callback_t cb, void * ctx) {
+  eoc_cb = cb;
+  eoc_ctx = ctx;
+}
+
+void TraceReplayBus::on_conversion_done(void * ctx) {
+  TraceReplayBus * bus = (TraceReplayBus *) ctx;
+  bus->eoc_cb(bus->eoc_ctx);
+}
+
+void TraceReplayBus::on_transfer_done(void * ctx) {
+  TraceReplayBus * bus = (TraceReplayBus *) ctx;
+  bus_callback_t cb = bus->transfer_cb;
+  bus->transfer_cb = NULL;
+  // Clear it first so the callback can start the next transfer
+  cb(bus->transfer_ctx, bus->transfer_result);
+}
+
+#endif
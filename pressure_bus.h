@@ -0,0 +1,169 @@
+#ifndef PRESSURE_BUS_H
+#define PRESSURE_BUS_H
+
+#include <stdint.h>
+#include "platform.h"
+
+typedef void (*bus_callback_t)(void * ctx, int result);
+// Called when an asynchronous transfer ends; result is 0 on success
+
+// The bus the pressure sensor is attached to
+// The acquisition code only talks to this interface, so the same code can
+// drive the real I2C peripheral on the board or a recorded trace on the host
+// Addresses are 8-bit (the 7-bit address shifted left, R/W bit included),
+// and both functions return 0 on success, just like mbed's I2C class
+class PressureBus {
+public:
+  virtual ~PressureBus() {}
+  virtual int write(uint8_t addr, const uint8_t * data, int len) = 0;
+  // Writes len bytes to the device at addr
+  virtual int read(uint8_t addr, uint8_t * data, int len) = 0;
+  // Reads len bytes from the device at addr
+  virtual int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+                       uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx);
+  // Writes tx_len bytes and then reads rx_len bytes (either may be 0)
+  // without waiting for the bus, and calls cb(ctx, result) from an
+  // interrupt when the transfer ends
+  // Returns non-zero if the transfer could not be started
+  // This default implementation blocks and calls cb before returning
+};
+
+#define SHARED_BUS_QUEUE_LEN 8
+// Transfers that can wait for a shared bus (two per sensor is plenty)
+
+// Lets several sensors use one bus at the same time
+// Each sensor only needs the bus for a few hundred microseconds per sample
+// and spends the rest of it converting, so transfers that arrive while
+// another one is in flight are queued and started, in order, as soon as
+// the bus is free. Every sensor keeps its own conversion going meanwhile
+// transfer must be called from the acquisition thread
+class SharedBus : public PressureBus {
+public:
+  explicit SharedBus(PressureBus * bus);
+  int write(uint8_t addr, const uint8_t * data, int len) override;
+  int read(uint8_t addr, uint8_t * data, int len) override;
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override;
+  // Returns non-zero only if the queue is full
+  uint32_t waits() const { return queued; }
+  // Transfers that had to wait for another one to finish
+
+private:
+  static void on_done(void * ctx, int result);
+  static void pump(void * ctx);
+
+  struct Transfer {
+    uint8_t addr;
+    const uint8_t * tx;
+    int tx_len;
+    uint8_t * rx;
+    int rx_len;
+    bus_callback_t cb;
+    void * ctx;
+  };
+
+  PressureBus * bus;
+  Transfer pending[SHARED_BUS_QUEUE_LEN];
+  // Waiting transfers, oldest at head
+  uint32_t head;
+  uint32_t tail;
+  volatile bool in_flight;
+  Transfer current;
+  // The transfer on the bus
+  uint32_t queued;
+};
+
+#ifdef __MBED__
+
+#include <mbed.h>
+
+// Forwards every transaction to an mbed I2C instance
+// Asynchronous transfers use the I2C interrupts (DEVICE_I2C_ASYNCH)
+class MbedI2CBus : public PressureBus {
+public:
+  explicit MbedI2CBus(I2C & i2c) : i2c(i2c), cb(NULL), ctx(NULL) {}
+  int write(uint8_t addr, const uint8_t * data, int len) override;
+  int read(uint8_t addr, uint8_t * data, int len) override;
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override;
+
+private:
+  void on_event(int event);
+
+  I2C & i2c;
+  bus_callback_t cb;
+  void * ctx;
+};
+
+#else
+
+#include <vector>
+
+// Emulates a Honeywell MPR sensor by replaying a recorded cuff session
+// against the simulated clock in platform.h
+// Each trace entry holds the raw 24-bit reading captured at a given time
+// after the session started. A conversion started at time t returns the
+// latest entry recorded at or before t, and the busy flag stays set for
+// conversion_us after the Output Measurement Command
+// Asynchronous transfers complete after the time the bytes would take on
+// a 400 kHz bus, on the simulated clock
+class TraceReplayBus : public PressureBus {
+public:
+  explicit TraceReplayBus(uint8_t addr_7bit, uint32_t conversion_us = 5000);
+
+  bool load(const char * path);
+  // Loads a trace file with one "<time_us> <status> <counts>" entry per line
+  // Blank lines and lines starting with '#' are ignored
+  // Returns false if the file can't be opened or holds no entries
+  void clear();
+  // Drops every entry
+  void add(uint32_t time_us, uint8_t status, uint32_t counts);
+  // Appends an entry; entries must be added in time order
+  bool finished() const;
+  // True once the simulated clock has moved past the last entry
+  int size() const { return (int) entries.size(); }
+  void on_eoc(platform_callback_t cb, void * ctx);
+  // Simulates the sensor's EOC output: calls cb(ctx) from a simulated
+  // interrupt whenever a conversion completes
+
+  int write(uint8_t addr, const uint8_t * data, int len) override;
+  int read(uint8_t addr, uint8_t * data, int len) override;
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override;
+
+private:
+  static void on_transfer_done(void * ctx);
+  static void on_conversion_done(void * ctx);
+
+  struct Entry {
+    uint32_t time_us;
+    uint8_t status;
+    uint32_t counts;
+  };
+
+  std::vector<Entry> entries;
+  // The recorded session
+  uint8_t addr_7bit;
+  // The address the emulated sensor answers on
+  uint32_t conversion_us;
+  // How long the busy flag stays set after a command
+  uint64_t busy_until_us;
+  // When the conversion in progress completes
+  int cursor;
+  // The entry returned by the last completed conversion
+  int pending;
+  // The entry the conversion in progress will return
+  PlatformTimer transfer_timer;
+  // Completes the asynchronous transfer in flight
+  bus_callback_t transfer_cb;
+  void * transfer_ctx;
+  int transfer_result;
+  PlatformTimer eoc_timer;
+  // Raises the simulated EOC edge
+  platform_callback_t eoc_cb;
+  void * eoc_ctx;
+};
+
+#endif
+
+#endif
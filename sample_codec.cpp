@@ -0,0 +1,85 @@
+#include "sample_codec.h"
+
+void SampleEncoder::reset() {
+  prev_time = 0;
+  prev_interval = 0;
+  prev_counts = 0;
+  prev_delta = 0;
+  prev_status = 0;
+  prev_phase = 0;
+  first = true;
+}
+
+int SampleEncoder::encode(const RecordedSample & s, uint8_t * out) {
+  uint32_t interval = s.time_us - prev_time;
+  int32_t jitter = (int32_t) (interval - prev_interval);
+  // All in wrapping 32-bit arithmetic, which the decoder undoes exactly
+  uint32_t counts = s.counts & 0xFFFFFFU;
+  uint32_t delta = counts - prev_counts;
+  int32_t residual = (int32_t) (delta - prev_delta);
+  // The reading is predicted to change as much as it did last time
+  bool changed = s.status != prev_status || s.phase != prev_phase;
+
+  int n = put_varint(out, zigzag(jitter));
+  n += put_varint(out + n, (zigzag(residual) << 1U) | (changed ? 1U : 0U));
+  if (changed) {
+    out[n++] = s.status;
+    out[n++] = s.phase;
+  }
+
+  prev_time = s.time_us;
+  prev_interval = first ? 0 : interval;
+  prev_counts = counts;
+  prev_delta = first ? 0 : delta;
+  // The first sample is absolute; it says nothing about the rate
+  prev_status = s.status;
+  prev_phase = s.phase;
+  first = false;
+  return n;
+}
+
+void SampleDecoder::reset() {
+  prev_time = 0;
+  prev_interval = 0;
+  prev_counts = 0;
+  prev_delta = 0;
+  prev_status = 0;
+  prev_phase = 0;
+  first = true;
+}
+
+int SampleDecoder::decode(const uint8_t * in, const uint8_t * end, RecordedSample & s) {
+  uint32_t jitter;
+  uint32_t residual;
+  int n = get_varint(in, end, jitter);
+  if (n == 0) {
+    return 0;
+  }
+  int m = get_varint(in + n, end, residual);
+  if (m == 0) {
+    return 0;
+  }
+  n += m;
+
+  if (residual & 1U) {
+    if (in + n + 2 > end) {
+      return 0;
+    }
+    prev_status = in[n++];
+    prev_phase = in[n++];
+  }
+  uint32_t interval = prev_interval + (uint32_t) unzigzag(jitter);
+  uint32_t delta = prev_delta + (uint32_t) unzigzag(residual >> 1U);
+  prev_time += interval;
+  prev_counts += delta;
+  prev_interval = first ? 0 : interval;
+  prev_delta = first ? 0 : delta;
+  first = false;
+
+  s.time_us = prev_time;
+  s.counts = prev_counts & 0xFFFFFFU;
+  s.status = prev_status;
+  s.phase = prev_phase;
+  s.reserved = 0;
+  return n;
+}
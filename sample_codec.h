@@ -0,0 +1,122 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stdint.h>
+
+enum SessionPhase {
+  PHASE_INFLATE = 1,
+  // The cuff is being pumped up
+  PHASE_DEFLATE = 2
+  // The valve is open and the cuff deflates
+};
+
+struct RecordedSample {
+  uint32_t time_us;
+  // When the reading was taken
+  uint32_t counts;
+  // The raw 24-bit reading
+  uint8_t status;
+  // The sensor status byte
+  uint8_t phase;
+  // The SessionPhase the reading was taken in
+  uint16_t reserved;
+};
+
+// Packs a stream of samples into a few bytes each
+// Samples arrive at a steady rate and the cuff pressure ramps up or down
+// smoothly, so each sample is stored as the difference between its 
+// sample interval and the previous one, and between the change in its
+// reading and the previous change (the reading is predicted to keep
+// moving at the same speed). Both are zigzag-mapped (small negative 
+// numbers become small positive ones) and written as varints of 7 bits 
+// per byte. The status byte and the phase are only written when they 
+// change. A steady inflation or deflation takes 2 bytes per sample 
+// instead of 12
+// Per sample:
+//   varint  zigzag(interval - previous interval)
+//   varint  zigzag(change - previous change) << 1 | status changed
+//   [status byte, phase byte]  only if the flag is set
+// Readings are 24 bits, so the residual always has a bit to spare for 
+// the flag
+// The first sample after reset is coded against zero and the second one
+// against the first, so a stream can be decoded from any reset point on
+// its own
+
+#define SAMPLE_MAX_ENCODED 11
+// The most bytes one sample can take: a 5-byte varint for the interval,
+// a 4-byte one for the reading and 2 bytes for the status and phase
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t) v << 1U) ^ (uint32_t) (v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t) (v >> 1U) ^ -(int32_t) (v & 1U);
+}
+
+static inline int put_varint(uint8_t * out, uint32_t v) {
+  // Writes v 7 bits at a time, lowest first; returns the bytes written
+
+  int n = 0;
+  while (v >= 0x80U) {
+    out[n++] = (uint8_t) (v | 0x80U);
+    v >>= 7U;
+  }
+  out[n++] = (uint8_t) v;
+  return n;
+}
+
+static inline int get_varint(const uint8_t * in, const uint8_t * end, uint32_t & v) {
+  // Returns the bytes read, or 0 if the varint is cut off or too long
+
+  uint32_t result = 0;
+  int shift = 0;
+  int n = 0;
+  while (in + n < end && shift < 35) {
+    uint8_t b = in[n++];
+    result |= (uint32_t) (b & 0x7FU) << shift;
+    if (!(b & 0x80U)) {
+      v = result;
+      return n;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+class SampleEncoder {
+public:
+  SampleEncoder() { reset(); }
+  void reset();
+  int encode(const RecordedSample & s, uint8_t * out);
+  // Writes the sample to out (room for SAMPLE_MAX_ENCODED bytes) and 
+  // returns the bytes written
+
+private:
+  uint32_t prev_time;
+  uint32_t prev_interval;
+  uint32_t prev_counts;
+  uint32_t prev_delta;
+  uint8_t prev_status;
+  uint8_t prev_phase;
+  bool first;
+};
+
+class SampleDecoder {
+public:
+  SampleDecoder() { reset(); }
+  void reset();
+  int decode(const uint8_t * in, const uint8_t * end, RecordedSample & s);
+  // Returns the bytes read, or 0 if the data is cut off or malformed
+
+private:
+  uint32_t prev_time;
+  uint32_t prev_interval;
+  uint32_t prev_counts;
+  uint32_t prev_delta;
+  uint8_t prev_status;
+  uint8_t prev_phase;
+  bool first;
+};
+
+#endif
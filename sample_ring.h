@@ -0,0 +1,79 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+struct PressureSample {
+  uint32_t time_us;
+  // When the reading arrived
+  uint32_t counts;
+  // The raw 24-bit reading
+  uint8_t status;
+  // The sensor status byte that came with it
+};
+
+// A lock-free ring for one producer and one consumer
+// The producer only writes tail and the consumer only writes head, so
+// neither side ever waits for the other or disables interrupts. When the
+// ring is full, push drops the new item and counts it instead of
+// overwriting one the consumer may be reading
+// N must be a power of two
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  SpscRing() : head(0), tail(0), dropped(0) {}
+
+  bool push(const T & item) {
+    // Called by the producer only
+
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    items[t & (N - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    // Publish the item only after it has been written
+    return true;
+  }
+
+  bool pop(T & item) {
+    // Called by the consumer only
+
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[h & (N - 1)];
+    head.store(h + 1, std::memory_order_release);
+    // Hand the slot back only after it has been read
+    return true;
+  }
+
+  uint32_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  uint32_t overflows() const {
+    // The number of items dropped because the ring was full
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+  void clear() {
+    // Called by the consumer only; drops everything queued so far
+    head.store(tail.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+private:
+  T items[N];
+  std::atomic<uint32_t> head;
+  // The number of items popped; free-running, wraps at 2^32
+  std::atomic<uint32_t> tail;
+  // The number of items pushed
+  std::atomic<uint32_t> dropped;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "sampler.h"
+
+FixedRateSampler sampler;
+
+FixedRateSampler::FixedRateSampler()
+    : tick_cb(NULL), tick_ctx(NULL), period(0), last_stamp_us(0), samples(0),
+      missed_ticks(0), max_jitter_us(0), total_jitter_us(0) {}
+
+bool FixedRateSampler::start(uint32_t rate_hz) {
+  if (rate_hz < MIN_SAMPLE_RATE_HZ || rate_hz > MAX_SAMPLE_RATE_HZ) {
+    return false;
+  }
+
+  stop();
+  period = 1000000U / rate_hz;
+  samples = 0;
+  missed_ticks = 0;
+  max_jitter_us = 0;
+  total_jitter_us = 0;
+  ticker.attach_us(&FixedRateSampler::on_tick, this, period);
+  return true;
+}
+
+void FixedRateSampler::stop() {
+  ticker.detach();
+  period = 0;
+}
+
+void FixedRateSampler::on_tick(void * ctx) {
+  // Called from the timer interrupt
+
+  FixedRateSampler * s = (FixedRateSampler *) ctx;
+  if (s->tick_cb != NULL) {
+    s->tick_cb(s->tick_ctx);
+  }
+  platform_wake();
+}
+
+void FixedRateSampler::on_tick_call(platform_callback_t cb, void * ctx) {
+  tick_cb = cb;
+  tick_ctx = ctx;
+}
+
+void FixedRateSampler::tick_missed() {
+  missed_ticks++;
+}
+
+void FixedRateSampler::stamp(uint32_t time_us) {
+  if (samples > 0) {
+    uint32_t interval = time_us - last_stamp_us;
+    // Unsigned arithmetic handles the 32-bit wrap of the timestamps
+    uint32_t jitter = interval > period ? interval - period : period - interval;
+    if (jitter > max_jitter_us) {
+      max_jitter_us = jitter;
+    }
+    total_jitter_us += jitter;
+  }
+
+  last_stamp_us = time_us;
+  samples++;
+}
+
+SamplerStats FixedRateSampler::stats() const {
+  SamplerStats s;
+  s.samples = samples;
+  s.missed_ticks = missed_ticks;
+  s.max_jitter_us = max_jitter_us;
+  s.mean_jitter_us = samples > 1 ? (uint32_t) (total_jitter_us / (samples - 1)) : 0;
+  return s;
+}
@@ -0,0 +1,64 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include "platform.h"
+
+#define SAMPLE_RATE_HZ 25
+// The rate the pressure is sampled at while the cuff is in use
+// It sizes the capture arrays, so it is fixed at compile time
+#define MIN_SAMPLE_RATE_HZ 25
+#define MAX_SAMPLE_RATE_HZ 200
+// The range of rates the sampler accepts
+
+struct SamplerStats {
+  uint32_t samples;
+  // The number of samples taken since the sampler was started
+  uint32_t missed_ticks;
+  // Ticks that passed while the previous sample was still being taken
+  uint32_t max_jitter_us;
+  // The largest deviation of a sample interval from the period
+  uint32_t mean_jitter_us;
+  // The mean deviation of the sample intervals from the period
+};
+
+// Paces the acquisition with a hardware timer instead of sleeps
+// The timer interrupt calls the tick callback, which starts the sample;
+// the sample is stamped with the microsecond clock when it arrives, so the
+// analysis works with the real time between samples instead of an assumed
+// period
+class FixedRateSampler {
+public:
+  FixedRateSampler();
+  bool start(uint32_t rate_hz);
+  // Starts ticking at rate_hz; returns false if the rate is out of range
+  void stop();
+  bool running() const { return period != 0; }
+  uint32_t period_us() const { return period; }
+  void on_tick_call(platform_callback_t cb, void * ctx);
+  // Calls cb(ctx) from the timer interrupt on every tick
+  void tick_missed();
+  // Records a tick that couldn't be served by the tick callback
+  void stamp(uint32_t time_us);
+  // Records the time a sample was taken and updates the jitter statistics
+  SamplerStats stats() const;
+
+private:
+  static void on_tick(void * ctx);
+
+  PlatformTimer ticker;
+  platform_callback_t tick_cb;
+  void * tick_ctx;
+  uint32_t period;
+  // The tick period in microseconds, 0 while stopped
+  uint32_t last_stamp_us;
+  uint32_t samples;
+  uint32_t missed_ticks;
+  uint32_t max_jitter_us;
+  uint64_t total_jitter_us;
+};
+
+extern FixedRateSampler sampler;
+// The sampler that paces read_pressure
+
+#endif
@@ -0,0 +1,210 @@
+#include <string.h>
+#include "sdram.h"
+
+static SdramRegion holes[SDRAM_MAX_HOLES];
+// The free spans, sorted by address
+static int hole_count = 0;
+static volatile bool dma_busy = false;
+static platform_callback_t dma_cb = NULL;
+static void * dma_ctx = NULL;
+
+static void add_hole(uint32_t offset, uint32_t end) {
+  holes[hole_count].addr = SDRAM_ADDR + offset;
+  holes[hole_count].size = end - offset;
+  hole_count++;
+}
+
+static void init_holes() {
+  hole_count = 0;
+  add_hole(LCD_LAYER1_OFFSET + LCD_LAYER_BYTES + LCD_GUARD_BYTES, LCD_LAYER0_OFFSET);
+  add_hole(LCD_LAYER0_OFFSET + LCD_LAYER_BYTES + LCD_GUARD_BYTES, SDRAM_BYTES);
+  // Layer 1 sits at the start of the SDRAM and layer 0 right after the
+  // first gap
+}
+
+SdramRegion sdram_alloc(uint32_t size) {
+  SdramRegion r = {0, 0};
+  size = (size + SDRAM_ALIGN - 1) & ~(SDRAM_ALIGN - 1);
+  if (size == 0) {
+    return r;
+  }
+
+  int i;
+  for (i = 0; i < hole_count; i++) {
+    if (holes[i].size >= size) {
+      r.addr = holes[i].addr;
+      r.size = size;
+      holes[i].addr += size;
+      holes[i].size -= size;
+      if (holes[i].size == 0) {
+        memmove(&holes[i], &holes[i + 1], (hole_count - i - 1) * sizeof(SdramRegion));
+        hole_count--;
+      }
+      return r;
+    }
+  }
+  return r;
+}
+
+void sdram_free(SdramRegion region) {
+  if (region.size == 0) {
+    return;
+  }
+
+  int i = 0;
+  while (i < hole_count && holes[i].addr < region.addr) {
+    i++;
+  }
+  // The region goes back in before hole i
+
+  bool joins_prev = i > 0 && holes[i - 1].addr + holes[i - 1].size == region.addr;
+  bool joins_next = i < hole_count && region.addr + region.size == holes[i].addr;
+  if (joins_prev && joins_next) {
+    holes[i - 1].size += region.size + holes[i].size;
+    memmove(&holes[i], &holes[i + 1], (hole_count - i - 1) * sizeof(SdramRegion));
+    hole_count--;
+  } else if (joins_prev) {
+    holes[i - 1].size += region.size;
+  } else if (joins_next) {
+    holes[i].addr = region.addr;
+    holes[i].size += region.size;
+  } else if (hole_count < SDRAM_MAX_HOLES) {
+    memmove(&holes[i + 1], &holes[i], (hole_count - i) * sizeof(SdramRegion));
+    holes[i] = region;
+    hole_count++;
+  }
+  // With the free list full the region is lost until the next 
+  // sdram_init; regions are few and long-lived, so this doesn't happen 
+  // in practice
+}
+
+uint32_t sdram_free_bytes() {
+  uint32_t total = 0;
+  int i;
+  for (i = 0; i < hole_count; i++) {
+    total += holes[i].size;
+  }
+  return total;
+}
+
+uint32_t sdram_largest_free() {
+  uint32_t largest = 0;
+  int i;
+  for (i = 0; i < hole_count; i++) {
+    if (holes[i].size > largest) {
+      largest = holes[i].size;
+    }
+  }
+  return largest;
+}
+
+bool sdram_busy() {
+  return dma_busy;
+}
+
+static void dma_done() {
+  // Called from the DMA interrupt
+
+  dma_busy = false;
+  if (dma_cb != NULL) {
+    dma_cb(dma_ctx);
+  }
+}
+
+#ifdef __MBED__
+
+#include "drivers/stm32f429i_discovery_sdram.h"
+
+static void dma_isr() {
+  BSP_SDRAM_DMA_IRQHandler();
+}
+
+extern "C" void HAL_SDRAM_DMA_XferCpltCallback(DMA_HandleTypeDef * hdma) {
+  // Overrides the empty HAL default, which the DMA interrupt ends up in
+
+  (void) hdma;
+  dma_done();
+}
+
+bool sdram_init() {
+  init_holes();
+  NVIC_SetVector(SDRAM_DMAx_IRQn, (uint32_t) (uintptr_t) &dma_isr);
+  // BSP_SDRAM_MspInit enables the interrupt but nothing services it
+  return true;
+}
+
+int sdram_write_async(uint32_t addr, const uint32_t * words, uint32_t count,
+                      platform_callback_t cb, void * ctx) {
+  if (dma_busy) {
+    return -1;
+  }
+
+  dma_cb = cb;
+  dma_ctx = ctx;
+  dma_busy = true;
+  if (BSP_SDRAM_WriteData_DMA(addr, (uint32_t *) words, count) != SDRAM_OK) {
+    dma_busy = false;
+    return -1;
+  }
+  return 0;
+}
+
+int sdram_read(uint32_t addr, uint32_t * words, uint32_t count) {
+  return BSP_SDRAM_ReadData(addr, words, count) == SDRAM_OK ? 0 : -1;
+}
+
+#else
+
+#include <stdlib.h>
+
+#define SDRAM_WORDS_PER_US 32
+// The DMA moves a word in about 30 ns on the 16-bit SDRAM bus
+
+static uint32_t * memory = NULL;
+// Stands in for the SDRAM
+static PlatformTimer dma_timer;
+
+static void on_dma_timer(void * ctx) {
+  (void) ctx;
+  dma_done();
+}
+
+static bool in_sdram(uint32_t addr, uint32_t count) {
+  return addr >= SDRAM_ADDR && (addr & 3U) == 0 && addr - SDRAM_ADDR <= SDRAM_BYTES
+         && count <= (SDRAM_BYTES - (addr - SDRAM_ADDR)) / 4;
+}
+
+bool sdram_init() {
+  if (memory == NULL) {
+    memory = (uint32_t *) calloc(SDRAM_BYTES / 4, sizeof(uint32_t));
+  }
+  init_holes();
+  dma_timer.detach();
+  dma_busy = false;
+  return memory != NULL;
+}
+
+int sdram_write_async(uint32_t addr, const uint32_t * words, uint32_t count,
+                      platform_callback_t cb, void * ctx) {
+  if (dma_busy || memory == NULL || !in_sdram(addr, count)) {
+    return -1;
+  }
+
+  memcpy(memory + (addr - SDRAM_ADDR) / 4, words, count * 4);
+  // The data moves right away; only the completion is delayed
+  dma_cb = cb;
+  dma_ctx = ctx;
+  dma_busy = true;
+  dma_timer.attach_once_us(&on_dma_timer, NULL, count / SDRAM_WORDS_PER_US + 1);
+  return 0;
+}
+
+int sdram_read(uint32_t addr, uint32_t * words, uint32_t count) {
+  if (memory == NULL || !in_sdram(addr, count)) {
+    return -1;
+  }
+  memcpy(words, memory + (addr - SDRAM_ADDR) / 4, count * 4);
+  return 0;
+}
+
+#endif
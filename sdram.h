@@ -0,0 +1,63 @@
+#ifndef SDRAM_H
+#define SDRAM_H
+
+#include <stdint.h>
+#include "platform.h"
+
+// The 8 MB SDRAM on the board, minus the memory the LCD uses
+// Memory is handed out in regions: large, long-lived blocks carved out of
+// the free space first fit, and given back whole. The frame buffers of the
+// two LCD layers are never handed out (LCD_DISCO_F429ZI puts them at the
+// start of the SDRAM and 0x130000 into it; the converted frame buffer at
+// 0x260000 is never used)
+// Data moves in and out with the SDRAM DMA stream on the board. On the
+// host the SDRAM is a block of ordinary memory and DMA completes on the
+// simulated clock, so the same code can be run and checked on Linux
+
+#define SDRAM_ADDR 0xD0000000U
+// SDRAM_DEVICE_ADDR in the BSP
+#define SDRAM_BYTES 0x800000U
+// SDRAM_DEVICE_SIZE in the BSP
+#define LCD_LAYER_BYTES (240U * 320U * 4U)
+// One ARGB8888 layer
+#define LCD_LAYER1_OFFSET 0x000000U
+#define LCD_LAYER0_OFFSET 0x130000U
+#define LCD_GUARD_BYTES (240U * 24U * 4U)
+// Left free after each layer: the BSP's drawing functions don't clip, so
+// a line of text drawn past the bottom of the screen (24 pixel rows in
+// the largest font) lands here instead of in a region
+#define SDRAM_MAX_HOLES 8
+// The free list can describe this many separate free spans
+#define SDRAM_ALIGN 32U
+// Regions start and end on a 32-byte boundary, which keeps DMA bursts 
+// from crossing into a neighbour
+
+struct SdramRegion {
+  uint32_t addr;
+  // The bus address of the first byte, SDRAM_ADDR and up
+  uint32_t size;
+  // The size in bytes; 0 if the allocation failed
+};
+
+bool sdram_init();
+// Sets up the free list and the DMA interrupt; the LCD driver has already
+// initialized the SDRAM controller by the time main runs
+SdramRegion sdram_alloc(uint32_t size);
+// Returns a region of at least size bytes, or one of size 0 if no free 
+// span is large enough
+void sdram_free(SdramRegion region);
+// Gives a region back and merges it with its free neighbours
+uint32_t sdram_free_bytes();
+uint32_t sdram_largest_free();
+
+int sdram_write_async(uint32_t addr, const uint32_t * words, uint32_t count,
+                      platform_callback_t cb, void * ctx);
+// Copies count words from SRAM to addr with DMA and calls cb(ctx) from the
+// DMA interrupt when done; words must stay untouched until then
+// Returns non-zero if the DMA stream is still busy with another copy
+bool sdram_busy();
+int sdram_read(uint32_t addr, uint32_t * words, uint32_t count);
+// Copies count words from addr to SRAM and waits for it; returns 0 on 
+// success
+
+#endif
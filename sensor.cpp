@@ -0,0 +1,388 @@
+#include "sensor.h"
+#include "platform.h"
+#include "sampler.h"
+
+static const uint8_t OUTPUT_COMMAND[3] = {0xAA, 0x00, 0x00};
+// The output measurement command to be sent to the sensor over I2C
+PressureSensor sensor(CuffSensor::address);
+// The sensor on the cuff
+SpscRing<PressureSample, SAMPLE_RING_LEN> sample_ring;
+// Filled by the acquisition thread, emptied by main
+volatile uint8_t sensor_status;
+// A global variable for storing the 8-bit sensor status
+volatile uint32_t pressure_reading;
+// A global variable for storing the sensor's 24-bit pressure reading
+volatile pressure_t pressure;
+// A global variable for storing the pressure calculated from the reading
+volatile uint32_t sample_time_us;
+// A global variable for storing the time the reading was taken
+static bool oversampling = false;
+// Whether raw readings go through the decimator before the ring
+static PressureDecimator decimator;
+static uint32_t last_counts;
+// The latest good raw reading, repeated if a conversion fails so the
+// decimator keeps its time base
+
+void calc_pressure(uint32_t output) {
+  pressure = counts_to_pressure(output);
+  // The formula on the data sheet, in fixed point (see pressure.h)
+}
+
+PressureSensor::PressureSensor(uint8_t addr_7bit)
+    : completed(0), status(0), reading(0), time_us(0), failed(false), errors(0),
+      busy_polls(0), eoc_timeouts(0), bus(NULL), addr_7bit(addr_7bit), state(SENSOR_IDLE),
+      last_result(0), mode(ACQ_COMBINED), eoc_enabled(false), eoc_wait(false), transfer_start_us(0),
+      command_done_us(0),
+      reading_cb(NULL), reading_ctx(NULL) {
+  int i;
+  for (i = 0; i < 3; i++) {
+    command[i] = OUTPUT_COMMAND[i];
+  }
+  reset_cost();
+}
+
+void PressureSensor::begin(PressureBus * bus) {
+  this->bus = bus;
+}
+
+void PressureSensor::on_reading(platform_callback_t cb, void * ctx) {
+  reading_cb = cb;
+  reading_ctx = ctx;
+}
+
+void PressureSensor::reset_cost() {
+  bus_cost.samples = 0;
+  bus_cost.transactions = 0;
+  bus_cost.bytes = 0;
+  bus_cost.bus_us = 0;
+  bus_cost.wait_us = 0;
+}
+
+bool PressureSensor::request() {
+  if (state != SENSOR_IDLE || bus == NULL) {
+    return false;
+  }
+
+  state = SENSOR_START;
+  platform_defer(&PressureSensor::step, this);
+  // The I2C driver can't be used from an interrupt, so the command is
+  // sent from the acquisition thread
+  return true;
+}
+
+void PressureSensor::on_transfer(void * ctx, int result) {
+  // Called from the I2C interrupt when a transfer ends
+
+  PressureSensor * s = (PressureSensor *) ctx;
+  s->last_result = result;
+  platform_defer(&PressureSensor::step, s);
+}
+
+void PressureSensor::on_timer(void * ctx) {
+  // Called from the timer interrupt once the conversion should be done
+
+  PressureSensor * s = (PressureSensor *) ctx;
+  if (s->eoc_wait) {
+    s->eoc_timeouts++;
+    // The EOC edge didn't come in time; read the status byte instead
+  }
+  platform_defer(&PressureSensor::wait_done, s);
+}
+
+void PressureSensor::end_of_conversion() {
+  // Called from the EOC interrupt
+
+  platform_defer(&PressureSensor::wait_done, this);
+}
+
+void PressureSensor::wait_done(void * ctx) {
+  // Runs on the acquisition thread when the conversion time is up or 
+  // the EOC edge arrived, whichever comes first
+
+  PressureSensor * s = (PressureSensor *) ctx;
+  if (s->state != SENSOR_CONVERTING) {
+    return;
+    // The other one already started the read
+  }
+  s->timer.detach();
+  s->eoc_wait = false;
+  step(s);
+}
+
+int PressureSensor::start_transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+                                   uint8_t * rx, int rx_len) {
+  // Starts a transfer and charges it to the bus cost
+
+  bus_cost.transactions++;
+  bus_cost.bytes += 1 + tx_len + rx_len;
+  // One address byte per transfer
+  transfer_start_us = platform_now_us();
+  return bus->transfer(addr, tx, tx_len, rx, rx_len, &PressureSensor::on_transfer, this);
+}
+
+void PressureSensor::step(void * ctx) {
+  // Moves the state machine along; runs on the acquisition thread
+
+  PressureSensor * s = (PressureSensor *) ctx;
+  uint8_t write_addr = s->addr_7bit << 1U;
+  uint8_t read_addr = write_addr | 1U;
+  uint64_t now = platform_now_us();
+  int result = 0;
+
+  if (s->state == SENSOR_COMMAND || s->state == SENSOR_STATUS || s->state == SENSOR_DATA) {
+    s->bus_cost.bus_us += now - s->transfer_start_us;
+    // A transfer just ended
+  }
+
+  switch (s->state) {
+    case SENSOR_START:
+      s->state = SENSOR_COMMAND;
+      result = s->start_transfer(write_addr, s->command, 3, NULL, 0);
+      // Make the sensor exit Standby Mode and start a conversion
+      break;
+
+    case SENSOR_COMMAND:
+      if (s->last_result != 0) {
+        s->finish(s->last_result);
+        return;
+      }
+      s->command_done_us = now;
+      s->state = SENSOR_CONVERTING;
+      if (s->eoc_enabled) {
+        s->eoc_wait = true;
+        s->timer.attach_once_us(&PressureSensor::on_timer, s, EOC_TIMEOUT_US);
+        // The EOC edge starts the read as soon as the data is ready; 
+        // the timer is only there in case the edge is lost
+      } else {
+        s->timer.attach_once_us(&PressureSensor::on_timer, s, CONVERSION_TIME_US);
+        // Nothing needs to happen on the bus until the conversion is done
+      }
+      break;
+
+    case SENSOR_CONVERTING:
+      if (s->mode == ACQ_COMBINED) {
+        s->state = SENSOR_DATA;
+        result = s->start_transfer(read_addr, NULL, 0, s->buf, 4);
+        // Read the status byte and the 24 bits in one go; the busy
+        // flag in the status byte tells whether the bits are fresh
+      } else {
+        s->state = SENSOR_STATUS;
+        result = s->start_transfer(read_addr, NULL, 0, s->buf, 1);
+        // Read the status byte to check the busy flag
+      }
+      break;
+
+    case SENSOR_STATUS:
+      if (s->last_result != 0) {
+        s->finish(s->last_result);
+        return;
+      }
+      s->status = s->buf[0];
+      if (s->buf[0] & 32U) {
+        // Bit 5 is the busy flag; the conversion took longer than
+        // expected, so check again a little later without resending
+        // the command
+        s->busy_polls++;
+        s->state = SENSOR_CONVERTING;
+        s->timer.attach_once_us(&PressureSensor::on_timer, s, STATUS_RETRY_US);
+        break;
+      }
+      s->state = SENSOR_DATA;
+      result = s->start_transfer(read_addr, NULL, 0, s->buf, 4);
+      // The reading is ready; read the status byte and the 24 bits
+      break;
+
+    case SENSOR_DATA:
+      if (s->last_result == 0 && (s->buf[0] & 32U)) {
+        // Only possible in ACQ_COMBINED: the sensor was still busy, 
+        // so the bits belong to the previous conversion
+        s->busy_polls++;
+        s->state = SENSOR_CONVERTING;
+        s->timer.attach_once_us(&PressureSensor::on_timer, s, STATUS_RETRY_US);
+        break;
+      }
+      s->finish(s->last_result);
+      return;
+
+    default:
+      return;
+  }
+
+  if (result != 0) {
+    s->finish(result);
+    // The transfer could not be started
+  }
+}
+
+void PressureSensor::finish(int result) {
+  // Publishes the reading (or the failure) and makes the sensor
+  // available for the next conversion
+
+  if (result == 0) {
+    bus_cost.samples++;
+    bus_cost.wait_us += transfer_start_us - command_done_us;
+    // The time between the command and the read that returned the data
+    status = buf[0];
+    // The first byte received is the status byte
+    reading = ((uint32_t) buf[1] << 16U) | ((uint32_t) buf[2] << 8U) | buf[3];
+    // The pressure reading is 24 bits
+    // The most significant bits come first
+    time_us = (uint32_t) platform_now_us();
+  } else {
+    errors++;
+  }
+  failed = result != 0;
+
+  state = SENSOR_IDLE;
+  completed++;
+  if (reading_cb != NULL) {
+    reading_cb(reading_ctx);
+  }
+  platform_wake();
+  // Wake up whoever is waiting for the reading
+}
+
+uint32_t max_sample_rate_hz(const BusCost & cost) {
+  if (cost.samples == 0) {
+    return 0;
+  }
+
+  uint64_t per_sample_us = (cost.bus_us + cost.wait_us) / cost.samples;
+  // The bus time and the conversion wait of an average sample
+  return per_sample_us ? (uint32_t) (1000000U / per_sample_us) : 0;
+}
+
+static void acquire_on_tick(void * ctx) {
+  // Called from the sampler's timer interrupt
+
+  (void) ctx;
+  if (!sensor.request()) {
+    sampler.tick_missed();
+    // The previous conversion is still in progress
+  }
+}
+
+static void publish_reading(void * ctx) {
+  // Called on the acquisition thread after every conversion
+
+  (void) ctx;
+  if (sampler.running() && !sensor.failed) {
+    sampler.stamp(sensor.time_us);
+    // Let the sampler measure the jitter of the sample intervals
+  }
+
+  PressureSample s;
+  s.time_us = sensor.time_us;
+  s.counts = sensor.reading;
+  s.status = sensor.status;
+
+  if (oversampling) {
+    if (!sensor.failed) {
+      last_counts = sensor.reading;
+    }
+    int32_t out;
+    if (!decimator.push((int32_t) last_counts, out)) {
+      return;
+      // Not the last raw reading of this output reading yet
+    }
+    s.counts = (uint32_t) out;
+    s.time_us = sensor.time_us - PressureDecimator::delay() * sampler.period_us();
+    // The filter delays the signal; stamp the reading with the time it 
+    // actually describes
+  } else if (sensor.failed) {
+    return;
+  }
+
+  sample_ring.push(s);
+  // Queue the reading for main; it is dropped and counted if main has 
+  // fallen SAMPLE_RING_LEN readings behind
+}
+
+void setup_sensor(PressureBus * bus) {
+  // Attach the sensor to its bus and queue every reading for main
+
+  sensor.begin(bus);
+  sensor.on_reading(&publish_reading, NULL);
+}
+
+void start_acquisition(uint32_t rate_hz) {
+  // Starts a conversion on every tick of the sampler
+
+  oversampling = false;
+  sampler.on_tick_call(&acquire_on_tick, NULL);
+  sampler.start(rate_hz);
+}
+
+bool start_oversampled_acquisition(uint32_t rate_hz) {
+  // Samples at OVERSAMPLE_RATIO times rate_hz and decimates back down to
+  // rate_hz, so read_pressure still returns rate_hz readings per second,
+  // each one filtered from several raw readings
+  // Returns false if the raw rate is more than the sampler accepts
+
+  sampler.stop();
+  decimator.reset();
+  last_counts = CuffSensor::output_min;
+  oversampling = true;
+  sampler.on_tick_call(&acquire_on_tick, NULL);
+  if (!sampler.start(rate_hz * OVERSAMPLE_RATIO)) {
+    oversampling = false;
+    return false;
+  }
+  return true;
+}
+
+static uint32_t paused_period_us = 0;
+// The sampler's period before pause_acquisition, 0 if it wasn't running
+
+void pause_acquisition() {
+  paused_period_us = sampler.period_us();
+  sampler.stop();
+  while (sensor.busy()) {
+    platform_sleep_ms(1);
+    // A conversion takes a few milliseconds at most
+  }
+}
+
+void resume_acquisition() {
+  if (paused_period_us != 0) {
+    sampler.start(1000000 / paused_period_us);
+    paused_period_us = 0;
+  }
+}
+
+void read_pressure() {
+  // Take the next reading off the ring and copy it into the global 
+  // variables
+  // When the sampler is running, this just waits for its next reading, 
+  // so every reading is seen exactly once even if the caller was slow
+
+  PressureSample s;
+  while (!sample_ring.pop(s)) {
+    if (!sampler.running() && !sensor.busy()) {
+      sensor.request();
+      // Without the sampler, start the conversion here (again, if the 
+      // last one failed on the bus)
+    }
+    platform_wait_for_event();
+  }
+
+  sensor_status = s.status;
+  pressure_reading = s.counts;
+  sample_time_us = s.time_us;
+  calc_pressure(pressure_reading);
+  // Convert the raw data to a value in 1/256 mmHg
+  // Store it in the global variable
+}
+
+void sleep_and_update_pressure() {
+  // A function that changes the sleep duration once and for all so
+  // that you don't have to change the duration in every function
+  // that calls read_pressure
+
+  if (!sampler.running()) {
+    platform_sleep_ms(100);
+    // Sleep for 100 milliseconds before updating the pressure
+  }
+  read_pressure();
+  // Update the pressure
+}
@@ -0,0 +1,167 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stdint.h>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sample_ring.h"
+#include "pressure.h"
+#include "sensor_profile.h"
+#include "decimator.h"
+
+#define CONVERSION_TIME_US 5000
+// How long the sensor takes to convert a reading after the Output 
+// Measurement Command (about 5 ms according to the data sheet)
+#define STATUS_RETRY_US 500
+// How long to wait before asking again if the sensor is still busy
+#define SAMPLE_RING_LEN 64
+// Readings that can queue up while the UI is busy (2.5 s at 25 Hz)
+#define EOC_TIMEOUT_US (2 * CONVERSION_TIME_US)
+// How long to wait for the EOC edge before falling back to reading 
+// the status byte
+#define OVERSAMPLE_RATIO 7
+// Raw readings per output reading in oversampled acquisition
+// 7 x 25 Hz = 175 Hz, just under the most the sensor and bus can do
+#define CIC_STAGES 3
+// The order of the decimation filter
+
+typedef CicDecimator<OVERSAMPLE_RATIO, CIC_STAGES> PressureDecimator;
+
+enum AcquisitionMode {
+  ACQ_STATUS_THEN_DATA,
+  // Read the status byte first, then the status byte and the reading
+  ACQ_COMBINED
+  // Read the status byte and the reading in one transfer and retry 
+  // the whole read if the busy flag was set
+};
+
+struct BusCost {
+  uint32_t samples;
+  // Conversions that completed
+  uint32_t transactions;
+  // Transfers started on the bus
+  uint32_t bytes;
+  // Bytes moved on the bus, address bytes included
+  uint64_t bus_us;
+  // Time the transfers were in flight
+  uint64_t wait_us;
+  // Time spent waiting for conversions between the command and the read
+};
+
+enum SensorState {
+  SENSOR_IDLE,
+  // No conversion in progress
+  SENSOR_START,
+  // A conversion was requested; the command hasn't been sent yet
+  SENSOR_COMMAND,
+  // The Output Measurement Command is on the bus
+  SENSOR_CONVERTING,
+  // Waiting out the conversion time on a timer, or for the EOC edge
+  SENSOR_STATUS,
+  // The status byte is being read
+  SENSOR_DATA
+  // The status byte and the 24-bit reading are being read
+};
+
+uint32_t max_sample_rate_hz(const BusCost & cost);
+// The highest sample rate the measured bus and wait time per sample 
+// can sustain, assuming conversions run back to back
+
+// Drives one Honeywell sensor through command -> wait -> read without
+// blocking: every step is started by a bus or timer interrupt and runs on
+// the acquisition thread, so the UI keeps running while a conversion is
+// pending, and the status byte is only read once the conversion time has
+// passed instead of being polled in a loop
+class PressureSensor {
+public:
+  explicit PressureSensor(uint8_t addr_7bit);
+  void begin(PressureBus * bus);
+  bool request();
+  // Starts a conversion; safe to call from interrupts
+  // Returns false if a conversion is already in progress
+  bool busy() const { return state != SENSOR_IDLE; }
+  void set_mode(AcquisitionMode mode) { this->mode = mode; }
+  void use_eoc(bool enabled) { eoc_enabled = enabled; }
+  // Wait for end_of_conversion instead of a fixed conversion time
+  // Only enable this when the sensor's EOC output is wired to an interrupt
+  void end_of_conversion();
+  // Called from the EOC interrupt; reads the sample right away
+  BusCost cost() const { return bus_cost; }
+  // The bus cost accumulated since the last reset
+  void reset_cost();
+  void on_reading(platform_callback_t cb, void * ctx);
+  // Calls cb(ctx) on the acquisition thread after every conversion
+
+  volatile uint32_t completed;
+  // Incremented every time a conversion finishes (or fails)
+  volatile uint8_t status;
+  // The status byte of the latest reading
+  volatile uint32_t reading;
+  // The latest 24-bit reading
+  volatile uint32_t time_us;
+  // When the latest reading arrived
+  volatile bool failed;
+  // Whether the latest conversion failed on the bus
+  uint32_t errors;
+  // Transfers that failed
+  uint32_t busy_polls;
+  // Status reads that found the sensor still busy
+  uint32_t eoc_timeouts;
+  // Conversions whose EOC edge never came
+
+private:
+  static void on_transfer(void * ctx, int result);
+  static void on_timer(void * ctx);
+  static void wait_done(void * ctx);
+  static void step(void * ctx);
+  int start_transfer(uint8_t addr, const uint8_t * tx, int tx_len, uint8_t * rx, int rx_len);
+  void finish(int result);
+
+  PressureBus * bus;
+  uint8_t addr_7bit;
+  volatile SensorState state;
+  int last_result;
+  // The result of the last transfer
+  AcquisitionMode mode;
+  bool eoc_enabled;
+  volatile bool eoc_wait;
+  // Set while the timer is only a fallback for the EOC edge
+  BusCost bus_cost;
+  uint64_t transfer_start_us;
+  // When the transfer in flight was started
+  uint64_t command_done_us;
+  // When the command of the conversion in progress reached the sensor
+  PlatformTimer timer;
+  // Times the conversion
+  platform_callback_t reading_cb;
+  void * reading_ctx;
+  uint8_t command[3];
+  uint8_t buf[4];
+};
+
+extern PressureSensor sensor;
+// The sensor on the cuff
+extern SpscRing<PressureSample, SAMPLE_RING_LEN> sample_ring;
+// Every reading, in order, from the acquisition thread to main
+extern volatile uint8_t sensor_status;
+// The 8-bit sensor status
+extern volatile uint32_t pressure_reading;
+// The sensor's 24-bit pressure reading
+extern volatile pressure_t pressure;
+// The pressure calculated from the reading, in 1/256 mmHg
+extern volatile uint32_t sample_time_us;
+// When the latest reading was taken, in microseconds
+
+void calc_pressure(uint32_t);
+void setup_sensor(PressureBus * bus);
+void start_acquisition(uint32_t rate_hz);
+bool start_oversampled_acquisition(uint32_t rate_hz);
+void pause_acquisition();
+// Stops the sampler and waits for the conversion in progress, which
+// frees the I2C bus for the EEPROM
+void resume_acquisition();
+// Restarts the sampler at the rate it had before pause_acquisition
+void read_pressure();
+void sleep_and_update_pressure();
+
+#endif
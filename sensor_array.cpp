@@ -0,0 +1,108 @@
+#include "sensor_array.h"
+
+SensorArray::SensorArray() : count(0) {
+  int i;
+  for (i = 0; i < MAX_SENSORS; i++) {
+    channels[i].array = this;
+    channels[i].sensor = NULL;
+    channels[i].missed = 0;
+    channels[i].taken = 0;
+  }
+}
+
+int SensorArray::add(PressureSensor * sensor) {
+  if (count == MAX_SENSORS || running()) {
+    return -1;
+  }
+
+  Channel & c = channels[count];
+  c.sensor = sensor;
+  sensor->on_reading(&SensorArray::on_reading, &c);
+  return count++;
+}
+
+bool SensorArray::start(uint32_t rate_hz) {
+  if (count == 0) {
+    return false;
+  }
+
+  ticker.on_tick_call(&SensorArray::on_tick, this);
+  return ticker.start(rate_hz);
+}
+
+void SensorArray::stop() {
+  ticker.stop();
+}
+
+void SensorArray::on_tick(void * ctx) {
+  // Called from the sampler's timer interrupt
+  // Starts a conversion on every sensor; the commands themselves go out 
+  // from the acquisition thread, one after the other
+
+  SensorArray * a = (SensorArray *) ctx;
+  int i;
+  for (i = 0; i < a->count; i++) {
+    if (!a->channels[i].sensor->request()) {
+      a->channels[i].missed++;
+      // The previous conversion on this sensor is still in progress
+    }
+  }
+}
+
+void SensorArray::on_reading(void * ctx) {
+  // Called on the acquisition thread after every conversion on a channel
+
+  Channel * c = (Channel *) ctx;
+  PressureSensor * s = c->sensor;
+  if (s->failed) {
+    return;
+  }
+
+  PressureSample sample;
+  sample.time_us = s->time_us;
+  sample.counts = s->reading;
+  sample.status = s->status;
+  c->ring.push(sample);
+  c->taken++;
+}
+
+bool SensorArray::read(int channel, PressureSample & s) {
+  if (channel < 0 || channel >= count) {
+    return false;
+  }
+  return channels[channel].ring.pop(s);
+}
+
+uint32_t SensorArray::pending(int channel) const {
+  return channel >= 0 && channel < count ? channels[channel].ring.size() : 0;
+}
+
+uint32_t SensorArray::missed_ticks(int channel) const {
+  return channel >= 0 && channel < count ? channels[channel].missed : 0;
+}
+
+uint32_t SensorArray::overflows(int channel) const {
+  return channel >= 0 && channel < count ? channels[channel].ring.overflows() : 0;
+}
+
+uint32_t SensorArray::samples() const {
+  uint32_t total = 0;
+  int i;
+  for (i = 0; i < count; i++) {
+    total += channels[i].taken;
+  }
+  return total;
+}
+
+PressureSensor * SensorArray::sensor(int channel) const {
+  return channel >= 0 && channel < count ? channels[channel].sensor : NULL;
+}
+
+void SensorArray::clear() {
+  int i;
+  for (i = 0; i < count; i++) {
+    channels[i].ring.clear();
+    channels[i].missed = 0;
+    channels[i].taken = 0;
+  }
+}
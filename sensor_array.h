@@ -0,0 +1,69 @@
+#ifndef SENSOR_ARRAY_H
+#define SENSOR_ARRAY_H
+
+#include <stdint.h>
+#include "sensor.h"
+#include "sampler.h"
+#include "sample_ring.h"
+
+#define MAX_SENSORS 4
+// The most sensors one array can drive (two cuffs and a reference
+// transducer, with one to spare)
+
+// Samples several sensors at the same rate, on one bus or on several
+// Every tick of the array's sampler starts a conversion on each sensor at
+// once, so their 5 ms conversion times overlap and only the short status
+// and data reads take turns on a shared bus (see SharedBus). The aggregate
+// sample rate therefore grows with the number of sensors instead of each
+// sensor waiting for the one before it
+// Every sensor gets its own ring of timestamped readings
+class SensorArray {
+public:
+  SensorArray();
+  int add(PressureSensor * sensor);
+  // Adds a sensor that has already been attached to its bus with begin
+  // Returns the channel number of the sensor, or -1 if the array is full
+  // The array takes over the sensor's on_reading callback
+  bool start(uint32_t rate_hz);
+  // Starts sampling every sensor at rate_hz; returns false if the rate is 
+  // out of range or there are no sensors
+  void stop();
+  bool running() const { return ticker.running(); }
+  int size() const { return count; }
+  bool read(int channel, PressureSample & s);
+  // Takes the oldest reading of a channel off its ring; returns false if
+  // there is none yet
+  uint32_t pending(int channel) const;
+  // The readings queued on a channel
+  uint32_t missed_ticks(int channel) const;
+  // Ticks skipped on a channel because its previous conversion was still 
+  // in progress
+  uint32_t overflows(int channel) const;
+  // Readings dropped because the channel's ring was full
+  uint32_t samples() const;
+  // The readings taken on all channels since start
+  PressureSensor * sensor(int channel) const;
+  void clear();
+  // Drops every queued reading and resets the tick and sample counters;
+  // called by the consumer only
+
+private:
+  static void on_tick(void * ctx);
+  static void on_reading(void * ctx);
+
+  struct Channel {
+    SensorArray * array;
+    PressureSensor * sensor;
+    SpscRing<PressureSample, SAMPLE_RING_LEN> ring;
+    // Filled by the acquisition thread, emptied by the caller of read
+    volatile uint32_t missed;
+    volatile uint32_t taken;
+  };
+
+  FixedRateSampler ticker;
+  // Paces the array; separate from the sampler the cuff uses
+  Channel channels[MAX_SENSORS];
+  int count;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef SENSOR_PROFILE_H
+#define SENSOR_PROFILE_H
+
+#include <stdint.h>
+#include "pressure.h"
+
+// Describes a Honeywell MPR part at compile time: its transfer function,
+// its pressure range and the unit the range is given in
+// Everything is folded into two constants, so converting a reading is the
+// same multiply, shift and add for every part, with no branches. Supporting
+// another part number only takes another typedef below
+
+enum TransferFunction {
+  TRANSFER_A,
+  // Output from 10% to 90% of 2^24 counts
+  TRANSFER_B,
+  // Output from 2.5% to 22.5% of 2^24 counts
+  TRANSFER_C
+  // Output from 20% to 80% of 2^24 counts
+};
+
+enum PressureUnit {
+  UNIT_MMHG,
+  UNIT_KPA,
+  UNIT_PSI
+};
+
+constexpr int32_t transfer_min_counts(TransferFunction tf) {
+  return tf == TRANSFER_A ? 1677722 : tf == TRANSFER_B ? 419430 : 3355443;
+}
+
+constexpr int32_t transfer_max_counts(TransferFunction tf) {
+  return tf == TRANSFER_A ? 15099494 : tf == TRANSFER_B ? 3774873 : 13421773;
+}
+
+constexpr double unit_to_mmhg(PressureUnit unit) {
+  return unit == UNIT_MMHG ? 1.0 : unit == UNIT_KPA ? 7.500617 : 51.714932;
+}
+
+template <TransferFunction TF, int32_t RANGE_MIN, int32_t RANGE_MAX, PressureUnit UNIT,
+          uint8_t ADDR = 0x18>
+struct SensorProfile {
+  static constexpr uint8_t address = ADDR;
+  // The 7-bit I2C address
+  static constexpr int32_t output_min = transfer_min_counts(TF);
+  static constexpr int32_t output_max = transfer_max_counts(TF);
+  // The counts at the bottom and the top of the pressure range
+  static constexpr int64_t scale = (int64_t) (
+      (RANGE_MAX - RANGE_MIN) * unit_to_mmhg(UNIT) * (1 << PRESSURE_FRAC_BITS)
+      * 4294967296.0 / (output_max - output_min) + 0.5);
+  // 1/256 mmHg per count, scaled by 2^32 and rounded
+  // Worked out in double by the compiler; nothing here exists at run time
+  static constexpr pressure_t offset = (pressure_t) (
+      RANGE_MIN * unit_to_mmhg(UNIT) * (1 << PRESSURE_FRAC_BITS) + (RANGE_MIN < 0 ? -0.5 : 0.5));
+  // The bottom of the range in 1/256 mmHg
+
+  static_assert(RANGE_MAX > RANGE_MIN, "empty pressure range");
+  static_assert(scale < ((int64_t) 1 << 38), "counts * scale would overflow 64 bits");
+
+  static inline pressure_t convert(uint32_t counts) {
+    int64_t x = (int64_t) ((int32_t) counts - output_min) * scale;
+    return (pressure_t) ((x + ((int64_t) 1 << 31)) >> 32) + offset;
+  }
+};
+
+typedef SensorProfile<TRANSFER_B, 0, 300, UNIT_MMHG> MPRLS0300YG00001B;
+// 0 to 300 mmHg gauge, Transfer Function B: the sensor on the cuff
+typedef SensorProfile<TRANSFER_A, 0, 25, UNIT_PSI> MPRLS0025PA00001A;
+// 0 to 25 psi absolute, Transfer Function A
+typedef SensorProfile<TRANSFER_C, 0, 40, UNIT_KPA> MPRLS0040KG00001C;
+// 0 to 40 kPa gauge, Transfer Function C
+
+typedef MPRLS0300YG00001B CuffSensor;
+// The part fitted to the cuff; change this to ship another part number
+
+static inline pressure_t counts_to_pressure(uint32_t counts) {
+  // The formula on the data sheet as one 32x32->64 multiply and a shift
+  // (a single SMULL on the Cortex-M4); the result is rounded to nearest
+
+  return CuffSensor::convert(counts);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "serial_link.h"
+
+#ifdef __MBED__
+
+MbedSerialLink::MbedSerialLink(PinName tx, PinName rx, int baud)
+    : SerialBase(tx, rx, baud), sending(false), cb(NULL), ctx(NULL), rx_cb(NULL), rx_ctx(NULL) {
+  set_dma_usage_tx(DMA_USAGE_ALWAYS);
+}
+
+int MbedSerialLink::send(const uint8_t * data, int len, platform_callback_t cb, void * ctx) {
+  if (sending) {
+    return -1;
+  }
+
+  this->cb = cb;
+  this->ctx = ctx;
+  sending = true;
+  if (write(data, len, callback(this, &MbedSerialLink::on_event), SERIAL_EVENT_TX_COMPLETE) != 0) {
+    sending = false;
+    return -1;
+  }
+  return 0;
+}
+
+void MbedSerialLink::on_event(int event) {
+  // Called from the UART interrupt
+
+  (void) event;
+  sending = false;
+  cb(ctx);
+}
+
+void MbedSerialLink::on_receive(serial_rx_callback_t cb, void * ctx) {
+  rx_cb = cb;
+  rx_ctx = ctx;
+  attach(callback(this, &MbedSerialLink::on_rx), RxIrq);
+}
+
+void MbedSerialLink::on_rx() {
+  // Called from the UART interrupt when a byte has arrived
+
+  while (readable()) {
+    uint8_t byte = (uint8_t) _base_getc();
+    // Reading the data register clears the interrupt
+    rx_cb(rx_ctx, byte);
+  }
+}
+
+#else
+
+#include <errno.h>
+#include <unistd.h>
+
+FdSerialLink::FdSerialLink(int fd, uint32_t baud)
+    : fd(fd), baud(baud), sending(false), cb(NULL), ctx(NULL), failed(0) {}
+
+int FdSerialLink::send(const uint8_t * data, int len, platform_callback_t cb, void * ctx) {
+  if (sending) {
+    return -1;
+  }
+
+  int done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, data + done, len - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      failed++;
+      break;
+    }
+    done += (int) n;
+  }
+
+  this->cb = cb;
+  this->ctx = ctx;
+  sending = true;
+  timer.attach_once_us(&FdSerialLink::on_sent, this, (uint32_t) ((uint64_t) len * 10 * 1000000 / baud) + 1);
+  // A start bit, 8 data bits and a stop bit per byte
+  return 0;
+}
+
+void FdSerialLink::on_sent(void * ctx) {
+  FdSerialLink * link = (FdSerialLink *) ctx;
+  link->sending = false;
+  link->cb(link->ctx);
+}
+
+#endif
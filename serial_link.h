@@ -0,0 +1,90 @@
+#ifndef SERIAL_LINK_H
+#define SERIAL_LINK_H
+
+#include <stdint.h>
+#include "platform.h"
+
+#define EXPORT_BAUD 115200
+// The ST-LINK virtual COM port runs at any standard rate up to 115200
+
+typedef void (*serial_rx_callback_t)(void * ctx, uint8_t byte);
+// Called from an interrupt for every byte received
+
+// A serial port that sends a buffer in the background
+// The exporters only talk to this interface, so they run the same way
+// against the UART on the board and against a file or a pseudo-terminal
+// on the host
+class SerialLink {
+public:
+  virtual ~SerialLink() {}
+  virtual int send(const uint8_t * data, int len, platform_callback_t cb, void * ctx) = 0;
+  // Starts sending len bytes and returns right away; cb(ctx) is called
+  // from an interrupt once the last byte is out, and data must not change
+  // until then
+  // Returns non-zero if a send is already in progress
+  virtual bool busy() const = 0;
+  virtual void on_receive(serial_rx_callback_t cb, void * ctx) {
+    (void) cb;
+    (void) ctx;
+  }
+  // Calls cb(ctx, byte) from an interrupt for every byte that arrives
+  // A link that can't receive ignores it
+};
+
+#ifdef __MBED__
+
+#include <mbed.h>
+
+// Sends through a UART with mbed's asynchronous serial API
+// (DEVICE_SERIAL_ASYNCH): the bytes are moved by the UART's DMA stream
+// where the target supports it, by its interrupt otherwise, and the CPU
+// is free in the meantime
+// SerialBase is the only mbed serial class with the asynchronous write,
+// and it can't be constructed on its own
+class MbedSerialLink : public SerialLink, private SerialBase {
+public:
+  MbedSerialLink(PinName tx, PinName rx, int baud);
+  int send(const uint8_t * data, int len, platform_callback_t cb, void * ctx) override;
+  bool busy() const override { return sending; }
+  void on_receive(serial_rx_callback_t cb, void * ctx) override;
+
+private:
+  void on_event(int event);
+  void on_rx();
+
+  volatile bool sending;
+  platform_callback_t cb;
+  void * ctx;
+  serial_rx_callback_t rx_cb;
+  void * rx_ctx;
+};
+
+#else
+
+// Writes to a file descriptor: a file, a pipe or a pseudo-terminal
+// The write itself blocks, but the completion comes when the bytes would
+// have left a UART at baud, on the simulated clock, so the exporters see
+// the same pacing as on the board
+class FdSerialLink : public SerialLink {
+public:
+  FdSerialLink(int fd, uint32_t baud);
+  int send(const uint8_t * data, int len, platform_callback_t cb, void * ctx) override;
+  bool busy() const override { return sending; }
+  uint32_t errors() const { return failed; }
+  // Sends the descriptor didn't take in full
+
+private:
+  static void on_sent(void * ctx);
+
+  int fd;
+  uint32_t baud;
+  bool sending;
+  platform_callback_t cb;
+  void * ctx;
+  PlatformTimer timer;
+  uint32_t failed;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#include "session_export.h"
+#include "sampler.h"
+
+#define RETRY_US 1000
+
+SessionExporter::SessionExporter(SerialLink * link)
+    : link(link), stage(STAGE_IDLE), ready(0), fill(0), seq(0), total(0), sent(0),
+      dropped(0), exported(0), sent_frames(0) {}
+
+bool SessionExporter::start(const SessionRecorder & recorder, const SessionResults & results) {
+  if (stage != STAGE_IDLE) {
+    return false;
+  }
+
+  reader.open(recorder);
+  this->results = results;
+  total = recorder.size();
+  dropped = recorder.dropped();
+  sent = 0;
+  ready = 0;
+  exported++;
+  stage = STAGE_START;
+  platform_defer(&SessionExporter::next, this);
+  // Build and send from the acquisition thread, like every later frame
+  return true;
+}
+
+int SessionExporter::build(uint8_t * out) {
+  // Builds the frame for the current stage into out and moves on to the
+  // next stage; returns the frame size, or 0 once there is nothing left
+
+  uint8_t * p = out + EXPORT_HEADER_BYTES;
+  uint8_t type;
+  int len;
+
+  switch (stage) {
+  case STAGE_START:
+    p[0] = EXPORT_VERSION;
+    p[1] = 0;
+    put_u16(p + 2, SAMPLE_RATE_HZ);
+    put_u32(p + 4, exported);
+    put_u32(p + 8, total);
+    type = FRAME_SESSION_START;
+    len = 12;
+    stage = STAGE_SAMPLES;
+    break;
+
+  case STAGE_SAMPLES: {
+    encoder.reset();
+    // Every frame decodes on its own
+    len = 6;
+    int n = 0;
+    RecordedSample s;
+    while (n < EXPORT_SAMPLES_PER_FRAME && sent + n < total && reader.next(s)) {
+      len += encoder.encode(s, p + len);
+      n++;
+    }
+    if (n < EXPORT_SAMPLES_PER_FRAME || sent + n == total) {
+      stage = STAGE_RESULTS;
+      // Done, or the rest of the session can't be read
+    }
+    if (n == 0) {
+      return build(out);
+    }
+    put_u32(p, sent);
+    put_u16(p + 4, (uint16_t) n);
+    sent += n;
+    type = FRAME_SAMPLES;
+    break;
+  }
+
+  case STAGE_RESULTS:
+    put_u16(p, (uint16_t) results.heart_rate);
+    put_u16(p + 2, (uint16_t) results.systolic);
+    put_u16(p + 4, (uint16_t) results.diastolic);
+    put_u16(p + 6, results.valid ? EXPORT_RESULTS_VALID : 0);
+    type = FRAME_RESULTS;
+    len = 8;
+    stage = STAGE_END;
+    break;
+
+  case STAGE_END:
+    put_u32(p, sent);
+    put_u32(p + 4, dropped);
+    type = FRAME_SESSION_END;
+    len = 8;
+    stage = STAGE_DONE;
+    break;
+
+  default:
+    return 0;
+  }
+
+  return build_frame(out, type, seq++, p, len);
+}
+
+void SessionExporter::on_sent(void * ctx) {
+  // Called from the UART interrupt when a frame is out
+
+  SessionExporter * e = (SessionExporter *) ctx;
+  e->sent_frames++;
+  platform_defer(&SessionExporter::next, e);
+  // Reading the SDRAM and encoding take too long for an interrupt
+}
+
+void SessionExporter::on_retry(void * ctx) {
+  // Called from the timer interrupt
+
+  platform_defer(&SessionExporter::next, ctx);
+}
+
+void SessionExporter::next(void * ctx) {
+  // Sends the frame built last time and builds the one after it while
+  // this one is on the wire; runs on the acquisition thread
+
+  SessionExporter * e = (SessionExporter *) ctx;
+  if (e->ready == 0) {
+    e->ready = e->build(e->frame[e->fill]);
+  }
+  if (e->ready == 0) {
+    e->stage = STAGE_IDLE;
+    return;
+  }
+
+  if (e->link->send(e->frame[e->fill], e->ready, &SessionExporter::on_sent, e) != 0) {
+    e->retry.attach_once_us(&SessionExporter::on_retry, e, RETRY_US);
+    return;
+    // The link is sending something else; the frame keeps until then
+  }
+  e->fill ^= 1;
+  e->ready = e->build(e->frame[e->fill]);
+}
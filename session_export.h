@@ -0,0 +1,71 @@
+#ifndef SESSION_EXPORT_H
+#define SESSION_EXPORT_H
+
+#include <stdint.h>
+#include "export_protocol.h"
+#include "serial_link.h"
+#include "session_recorder.h"
+
+struct SessionResults {
+  int heart_rate;
+  int systolic;
+  int diastolic;
+  bool valid;
+  // False if the measurement timed out and there are no results
+};
+
+// Sends a recorded session to a computer (see export_protocol.h): a start
+// frame, the raw samples 64 to a frame, the results and an end frame
+// The export runs in the background on the acquisition thread. Each frame
+// is built while the one before it is on the wire, straight from the
+// session in SDRAM, so the export never holds up sampling and needs no
+// more memory than two frames
+class SessionExporter {
+public:
+  explicit SessionExporter(SerialLink * link);
+  bool start(const SessionRecorder & recorder, const SessionResults & results);
+  // Starts sending the session the recorder just finished; returns false
+  // if the last export is still running
+  // The recorder must not start a new session until busy() is false
+  bool busy() const { return stage != STAGE_IDLE; }
+  uint32_t sessions() const { return exported; }
+  // Exports started since boot
+  uint32_t frames() const { return sent_frames; }
+
+private:
+  static void on_sent(void * ctx);
+  static void on_retry(void * ctx);
+  static void next(void * ctx);
+  int build(uint8_t * out);
+
+  enum Stage {
+    STAGE_IDLE,
+    STAGE_START,
+    STAGE_SAMPLES,
+    STAGE_RESULTS,
+    STAGE_END,
+    STAGE_DONE
+    // Everything is built; waiting for the last frame to go out
+  };
+
+  SerialLink * link;
+  volatile Stage stage;
+  uint8_t frame[2][EXPORT_MAX_FRAME];
+  int ready;
+  // The size of the frame waiting in frame[fill], or 0
+  int fill;
+  uint8_t seq;
+  SessionReader reader;
+  SampleEncoder encoder;
+  SessionResults results;
+  uint32_t total;
+  // The samples the recorder holds
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t exported;
+  uint32_t sent_frames;
+  PlatformTimer retry;
+  // Tries again when the link is busy with something else
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "session_recorder.h"
+
+SessionRecorder recorder;
+
+static uint32_t block_bytes(uint32_t payload) {
+  // The SDRAM a block with this much encoded data takes
+
+  return 4 + ((payload + 3) & ~3U);
+}
+
+SessionRecorder::SessionRecorder()
+    : current(-1), seq(0), reserved_bytes(0), stored(0), stored_bytes(0), write_at(0), lost(0) {
+  region.addr = 0;
+  region.size = 0;
+  state[0] = state[1] = CHUNK_FREE;
+  fill[0] = fill[1] = 0;
+  used[0] = used[1] = 0;
+  ready_seq[0] = ready_seq[1] = 0;
+}
+
+bool SessionRecorder::begin(uint32_t max_samples) {
+  uint32_t blocks = (max_samples + RECORDER_CHUNK - 1) / RECORDER_CHUNK;
+  sdram_free(region);
+  region = sdram_alloc(blocks * RECORDER_BLOCK_WORDS * 4);
+  // Enough for max_samples even if none of them compressed
+  start();
+  return region.size != 0;
+}
+
+void SessionRecorder::start() {
+  finish();
+  current = -1;
+  reserved_bytes = 0;
+  stored = 0;
+  stored_bytes = 0;
+  write_at = 0;
+  lost = 0;
+}
+
+bool SessionRecorder::record(uint32_t time_us, uint32_t counts, uint8_t status, uint8_t phase) {
+  pump();
+
+  uint32_t pending = current >= 0 ? used[current] : 0;
+  if (reserved_bytes + block_bytes(pending + SAMPLE_MAX_ENCODED) > region.size) {
+    lost++;
+    return false;
+    // Not even one more sample is sure to fit
+  }
+
+  if (current < 0) {
+    if (state[0] == CHUNK_FREE) {
+      current = 0;
+    } else if (state[1] == CHUNK_FREE) {
+      current = 1;
+    } else {
+      lost++;
+      return false;
+      // Both blocks are still waiting for the DMA
+    }
+    state[current] = CHUNK_FILLING;
+    fill[current] = 0;
+    used[current] = 0;
+    encoder.reset();
+    // Every block can be decoded on its own
+  }
+
+  RecordedSample s;
+  s.time_us = time_us;
+  s.counts = counts;
+  s.status = status;
+  s.phase = phase;
+  s.reserved = 0;
+  uint8_t * out = (uint8_t *) &block[current][1];
+  used[current] += encoder.encode(s, out + used[current]);
+  fill[current]++;
+
+  if (fill[current] == RECORDER_CHUNK) {
+    close_block();
+    pump();
+  }
+  return true;
+}
+
+void SessionRecorder::close_block() {
+  // Hands the block being filled over to the DMA
+
+  int b = current;
+  uint32_t payload = used[b];
+  uint8_t * out = (uint8_t *) &block[b][1];
+  while (payload & 3U) {
+    out[payload++] = 0;
+  }
+  block[b][0] = used[b] | (fill[b] << 16U);
+  reserved_bytes += block_bytes(used[b]);
+  state[b] = CHUNK_READY;
+  ready_seq[b] = ++seq;
+  current = -1;
+}
+
+void SessionRecorder::pump() {
+  // Starts the DMA on the block that has waited longest, if the DMA is 
+  // free; blocks are written in the order they were filled
+
+  if (state[0] == CHUNK_WRITING || state[1] == CHUNK_WRITING) {
+    return;
+  }
+
+  int next = -1;
+  if (state[0] == CHUNK_READY && state[1] == CHUNK_READY) {
+    next = ready_seq[0] < ready_seq[1] ? 0 : 1;
+  } else if (state[0] == CHUNK_READY) {
+    next = 0;
+  } else if (state[1] == CHUNK_READY) {
+    next = 1;
+  }
+  if (next < 0) {
+    return;
+  }
+
+  state[next] = CHUNK_WRITING;
+  uint32_t size = block_bytes(used[next]);
+  if (sdram_write_async(region.addr + write_at, block[next], size / 4,
+                        &SessionRecorder::on_written, this) != 0) {
+    state[next] = CHUNK_READY;
+    // Someone else has the DMA; try again on the next sample
+    return;
+  }
+  write_at += size;
+}
+
+void SessionRecorder::on_written(void * ctx) {
+  // Called from the DMA interrupt
+
+  SessionRecorder * r = (SessionRecorder *) ctx;
+  int i;
+  for (i = 0; i < 2; i++) {
+    if (r->state[i] == CHUNK_WRITING) {
+      r->stored += r->fill[i];
+      r->stored_bytes += block_bytes(r->used[i]);
+      r->state[i] = CHUNK_FREE;
+    }
+  }
+  platform_wake();
+}
+
+void SessionRecorder::finish() {
+  if (current >= 0) {
+    if (fill[current] > 0) {
+      close_block();
+    } else {
+      state[current] = CHUNK_FREE;
+      current = -1;
+    }
+  }
+  pump();
+  while (state[0] != CHUNK_FREE || state[1] != CHUNK_FREE) {
+    platform_wait_for_event();
+    pump();
+  }
+}
+
+SessionReader::SessionReader() : end(0), pos(0), remaining(0), in(NULL), in_end(NULL) {
+  region.addr = 0;
+  region.size = 0;
+}
+
+SessionReader::SessionReader(const SessionRecorder & recorder) {
+  open(recorder);
+}
+
+void SessionReader::open(const SessionRecorder & recorder) {
+  region = recorder.memory();
+  end = recorder.bytes();
+  pos = 0;
+  remaining = 0;
+  in = NULL;
+  in_end = NULL;
+}
+
+bool SessionReader::load_block() {
+  if (pos + 4 > end || sdram_read(region.addr + pos, block, 1) != 0) {
+    return false;
+  }
+
+  uint32_t payload = block[0] & 0xFFFFU;
+  uint32_t samples = block[0] >> 16U;
+  uint32_t size = block_bytes(payload);
+  if (samples == 0 || samples > RECORDER_CHUNK || size > RECORDER_BLOCK_WORDS * 4
+      || pos + size > end || sdram_read(region.addr + pos + 4, block + 1, size / 4 - 1) != 0) {
+    return false;
+  }
+
+  pos += size;
+  remaining = samples;
+  in = (const uint8_t *) &block[1];
+  in_end = in + payload;
+  decoder.reset();
+  return true;
+}
+
+bool SessionReader::next(RecordedSample & s) {
+  if (remaining == 0 && !load_block()) {
+    return false;
+  }
+
+  int n = decoder.decode(in, in_end, s);
+  if (n == 0) {
+    remaining = 0;
+    pos = end;
+    return false;
+    // The block is damaged; nothing after it can be trusted either
+  }
+  in += n;
+  remaining--;
+  return true;
+}
@@ -0,0 +1,110 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <stdint.h>
+#include "sdram.h"
+#include "sampler.h"
+#include "sample_codec.h"
+
+#define SESSION_MAX_MINUTES 30
+// The longest session the recorder is guaranteed to keep, at the highest
+// sample rate; with the samples compressed it typically keeps 4 times more
+#define RECORDER_CHUNK 64
+// Samples per block: staged in SRAM, then copied to SDRAM in one DMA burst
+#define RECORDER_BLOCK_WORDS (1 + (RECORDER_CHUNK * SAMPLE_MAX_ENCODED + 3) / 4)
+// A block is a header word (payload bytes in the low half, samples in the
+// high half) and the encoded samples, padded to a whole word
+
+// Streams every raw sample of a session into SDRAM
+// Samples are encoded (see SampleEncoder) into two small SRAM blocks as
+// they arrive: while main fills one, the DMA copies the other into the
+// session's region, so recording costs a few bytes of encoding per sample
+// and never waits for the SDRAM. Every block starts the encoder over, so
+// each one can be decoded on its own. A session only stops growing when
+// the region is full
+class SessionRecorder {
+public:
+  SessionRecorder();
+  bool begin(uint32_t max_samples);
+  // Allocates a region that holds at least max_samples samples however 
+  // badly they compress; returns false if the SDRAM doesn't have the room
+  void start();
+  // Starts a new session, overwriting the previous one
+  bool record(uint32_t time_us, uint32_t counts, uint8_t status, uint8_t phase);
+  // Appends a sample; called by main only
+  // Returns false if it had to be dropped
+  void finish();
+  // Writes out the block still being filled and waits for the DMA
+  uint32_t size() const { return stored; }
+  // The samples that have reached the SDRAM
+  uint32_t bytes() const { return stored_bytes; }
+  // The SDRAM they take up
+  uint32_t dropped() const { return lost; }
+  // Samples lost because the session was full or the DMA fell behind
+  SdramRegion memory() const { return region; }
+
+private:
+  static void on_written(void * ctx);
+  void pump();
+  void close_block();
+
+  enum ChunkState {
+    CHUNK_FREE,
+    CHUNK_FILLING,
+    CHUNK_READY,
+    // Full (or finished) and waiting for the DMA
+    CHUNK_WRITING
+  };
+
+  uint32_t block[2][RECORDER_BLOCK_WORDS];
+  volatile ChunkState state[2];
+  uint32_t fill[2];
+  // The samples in each block
+  uint32_t used[2];
+  // The encoded bytes in each block
+  int current;
+  // The block main is filling, or -1
+  uint32_t ready_seq[2];
+  uint32_t seq;
+  // The order the blocks became ready in, so they are written in order
+  SampleEncoder encoder;
+  SdramRegion region;
+  uint32_t reserved_bytes;
+  // The SDRAM promised to the blocks closed so far
+  volatile uint32_t stored;
+  volatile uint32_t stored_bytes;
+  uint32_t write_at;
+  // Where the next block goes, in bytes from the start of the region
+  uint32_t lost;
+};
+
+// Reads a recorded session back from SDRAM, one sample at a time
+class SessionReader {
+public:
+  SessionReader();
+  explicit SessionReader(const SessionRecorder & recorder);
+  void open(const SessionRecorder & recorder);
+  // Starts over at the beginning of the recorder's session
+  bool next(RecordedSample & s);
+  // Returns false at the end of the session or at a damaged block
+
+private:
+  bool load_block();
+
+  SdramRegion region;
+  uint32_t end;
+  // The bytes the recorder had stored when the reader was made
+  uint32_t pos;
+  // The next block, in bytes from the start of the region
+  uint32_t block[RECORDER_BLOCK_WORDS];
+  uint32_t remaining;
+  // The samples of the current block not yet decoded
+  const uint8_t * in;
+  const uint8_t * in_end;
+  SampleDecoder decoder;
+};
+
+extern SessionRecorder recorder;
+// Keeps the full-resolution record of the current session
+
+#endif
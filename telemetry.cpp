@@ -0,0 +1,81 @@
+#include "telemetry.h"
+#include <string.h>
+
+#define PAYLOAD_OFFSET EXPORT_HEADER_BYTES
+#define BEATS_OFFSET (PAYLOAD_OFFSET + 10)
+
+Telemetry::Telemetry(SerialLink * link)
+    : link(link), fill(0), in_flight(false), seq(0), sample_bytes(0), count(0), beats(0),
+      index(0), sent_frames(0), lost_frames(0), lost_beats(0) {}
+
+void Telemetry::sample(uint32_t time_us, uint32_t counts, uint8_t status, uint8_t phase) {
+  RecordedSample s = {time_us, counts & 0xFFFFFFU, status, phase, 0};
+  if (count == 0) {
+    encoder.reset();
+    // Every frame decodes on its own
+  }
+  sample_bytes += encoder.encode(s, samples + sample_bytes);
+  count++;
+  if (count == TELEMETRY_BATCH) {
+    emit();
+  }
+}
+
+void Telemetry::beat(uint32_t time_us, pressure_t p) {
+  if (beats == TELEMETRY_MAX_BEATS) {
+    lost_beats++;
+    return;
+  }
+  uint8_t * b = frame[fill] + BEATS_OFFSET + beats * 8;
+  put_u32(b, time_us);
+  put_u32(b + 4, (uint32_t) p);
+  beats++;
+}
+
+void Telemetry::flush() {
+  if (count > 0 || beats > 0) {
+    emit();
+  }
+}
+
+void Telemetry::emit() {
+  // Closes the frame being filled and sends it, or drops it if the one
+  // before it is still going out
+
+  uint8_t * out = frame[fill];
+  uint8_t * p = out + PAYLOAD_OFFSET;
+  put_u32(p, index);
+  index += count;
+  // Dropped samples still use up their numbers, so the gap shows
+  if (in_flight) {
+    lost_frames++;
+  } else {
+    put_u32(p + 4, lost_frames);
+    p[8] = (uint8_t) count;
+    p[9] = (uint8_t) beats;
+    int len = 10 + beats * 8;
+    memcpy(p + len, samples, sample_bytes);
+    len += sample_bytes;
+    int size = build_frame(out, FRAME_TELEMETRY, seq, p, len);
+    in_flight = true;
+    if (link->send(out, size, &Telemetry::on_sent, this) == 0) {
+      seq++;
+      fill ^= 1;
+    } else {
+      in_flight = false;
+      lost_frames++;
+      // The link is taken by something else
+    }
+  }
+  count = 0;
+  beats = 0;
+  sample_bytes = 0;
+}
+
+void Telemetry::on_sent(void * ctx) {
+  // Called from the UART interrupt
+
+  Telemetry * t = (Telemetry *) ctx;
+  t->sent_frames++;
+  t->in_flight = false;
+}
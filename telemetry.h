@@ -0,0 +1,62 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "export_protocol.h"
+#include "serial_link.h"
+#include "pressure.h"
+
+#define TELEMETRY_BATCH 8
+// Samples per frame: a frame a third of a second at 25 Hz, and about 40 
+// bytes, so the framing costs little
+#define TELEMETRY_MAX_BEATS 4
+// A beat needs a rise and a fall, so a batch can't hold more than 
+// TELEMETRY_BATCH / 2; more are counted as lost
+#define TELEMETRY_MAX_PAYLOAD (10 + TELEMETRY_MAX_BEATS * 8 + TELEMETRY_BATCH * SAMPLE_MAX_ENCODED)
+
+// Streams every sample and every beat over the serial link while a
+// measurement runs, as FRAME_TELEMETRY frames (see export_protocol.h)
+// Samples are coded into the frame being filled as they arrive, and a
+// full frame is handed to the link right away. If the link is still busy
+// with the frame before, the new one is dropped and counted instead of
+// waited for, so a call never blocks and costs at most one frame's CRC
+// Called from main only
+class Telemetry {
+public:
+  explicit Telemetry(SerialLink * link);
+  void sample(uint32_t time_us, uint32_t counts, uint8_t status, uint8_t phase);
+  void beat(uint32_t time_us, pressure_t p);
+  // Adds a beat to the frame being filled
+  void flush();
+  // Sends the samples collected so far without waiting for a full batch
+  uint32_t frames() const { return sent_frames; }
+  uint32_t dropped() const { return lost_frames; }
+  // Frames dropped because the link was busy
+  uint32_t dropped_beats() const { return lost_beats; }
+  // Beats that didn't fit in their frame
+
+private:
+  static void on_sent(void * ctx);
+  void emit();
+
+  SerialLink * link;
+  uint8_t frame[2][EXPORT_HEADER_BYTES + TELEMETRY_MAX_PAYLOAD + 2];
+  // One frame being filled while the other is on the wire
+  int fill;
+  volatile bool in_flight;
+  uint8_t seq;
+  SampleEncoder encoder;
+  uint8_t samples[TELEMETRY_BATCH * SAMPLE_MAX_ENCODED];
+  // The coded samples of the frame being filled; they are moved in 
+  // behind the beats when the frame is closed
+  int sample_bytes;
+  int count;
+  int beats;
+  uint32_t index;
+  // The number of the next sample since boot
+  uint32_t sent_frames;
+  volatile uint32_t lost_frames;
+  uint32_t lost_beats;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef TOOLS_BENCH_H
+#define TOOLS_BENCH_H
+
+// What the host benchmarks and checks in tools/ share: timing a loop in
+// ns and TSC cycles per item, and a small random number generator that
+// gives the same numbers for the same seed on every host
+// Header-only, so each tool still builds from its own command line
+
+#include <math.h>
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static volatile int64_t sink;
+// Keeps the compiler from optimizing the timed loops away
+
+struct Timing {
+  double ns;
+  double cycles;
+  // Per item; cycles is 0 where there is no TSC
+};
+
+template <typename F>
+static Timing time_loop(F run, int repeats, double items) {
+  // Calls run() repeats times, each of which handles items items and
+  // returns something that depends on all of them
+
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+  uint64_t c0 = __rdtsc();
+#endif
+  int r;
+  for (r = 0; r < repeats; r++) {
+    sink += (int64_t) run();
+  }
+  double per = 1.0 / (repeats * items);
+  Timing t;
+#ifdef HAVE_TSC
+  t.cycles = (__rdtsc() - c0) * per;
+#else
+  t.cycles = 0;
+#endif
+  t.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() * per;
+  return t;
+}
+
+static uint64_t rng_state = 1;
+// xorshift64; never 0
+
+static inline void seed_random(uint64_t seed) {
+  rng_state = seed * 2654435761ULL + 12345;
+}
+
+static inline uint64_t next_random64() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static inline uint32_t next_random() {
+  return (uint32_t) (next_random64() >> 32);
+}
+
+static inline double uniform() {
+  // In [0, 1)
+
+  return (next_random64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double gaussian() {
+  // Mean 0 and standard deviation 1, from the Box-Muller transform
+
+  double u = uniform() + 1e-12;
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * uniform());
+}
+
+#endif
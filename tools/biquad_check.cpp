@@ -0,0 +1,320 @@
+// Checks and times the cascaded biquad filters in biquad.h
+// For each sample rate the firmware supports, runs the cuff band-pass
+// (CuffFilter) and a fourth-order low-pass over a synthetic deflation
+// (a falling cuff pressure with heart beats, sensor noise and 50 Hz hum),
+// an impulse, steps and full-scale noise, and checks that:
+//  - the fixed-point filters match, to the bit, a reference written out
+//    here from the difference equation with its own coefficient rounding
+//  - a steady pressure settles to within a count of the DC gain, and
+//    the band-pass takes a steady deflation out to within two
+//  - fixed and float stay close to the same filter in double
+// Then prints the gain of the band-pass at a few frequencies, and the time
+// per sample of each type with 1, 2 and 4 stages
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/biquad_check.cpp biquad.cpp -o biquad_check
+// Usage:
+//   ./biquad_check
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "pressure.h"
+#include "sampler.h"
+#include "biquad.h"
+#include "bench.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char * what, uint32_t rate_hz) {
+  if (!ok) {
+    printf("FAILED at %u Hz: %s\n", (unsigned) rate_hz, what);
+    failures++;
+  }
+}
+
+static int32_t round_q29(double x) {
+  double r = floor(x * 536870912.0 + 0.5);
+  return (int32_t) r;
+}
+
+// The fixed-point filter written out the long way: every output computed
+// from the whole input and output arrays, with the remainders carried in
+// an array too
+struct Reference {
+  int32_t c[8][5];
+  int stages;
+
+  void design(const BiquadDesign * d, int n) {
+    stages = n;
+    int s;
+    for (s = 0; s < n; s++) {
+      c[s][0] = round_q29(d[s].b0);
+      c[s][2] = round_q29(d[s].b2);
+      c[s][3] = round_q29(d[s].a1);
+      c[s][4] = round_q29(d[s].a2);
+      double gain = (d[s].b0 + d[s].b1 + d[s].b2) / (1 + d[s].a1 + d[s].a2);
+      int64_t den = 536870912LL + c[s][3] + c[s][4];
+      c[s][1] = (int32_t) ((int64_t) floor(gain * (double) den + 0.5) - c[s][0] - c[s][2]);
+    }
+  }
+
+  std::vector<int32_t> run(const std::vector<int32_t> & in) const {
+    std::vector<int32_t> x = in;
+    int s;
+    for (s = 0; s < stages; s++) {
+      std::vector<int32_t> y(x.size());
+      std::vector<int64_t> rem(x.size());
+      size_t i;
+      for (i = 0; i < x.size(); i++) {
+        int64_t acc = (int64_t) c[s][0] * x[i];
+        if (i >= 1) {
+          acc += (int64_t) c[s][1] * x[i - 1] - (int64_t) c[s][3] * y[i - 1] + 2 * rem[i - 1];
+        }
+        if (i >= 2) {
+          acc += (int64_t) c[s][2] * x[i - 2] - (int64_t) c[s][4] * y[i - 2] - rem[i - 2];
+        }
+        int64_t q = acc / 536870912LL;
+        if (acc % 536870912LL < 0) {
+          q--;
+          // Round towards minus infinity
+        }
+        y[i] = (int32_t) q;
+        rem[i] = acc - q * 536870912LL;
+      }
+      x = y;
+    }
+    return x;
+  }
+};
+
+static std::vector<double> run_double(const BiquadDesign * d, int n, const std::vector<int32_t> & in) {
+  std::vector<double> x(in.begin(), in.end());
+  int s;
+  for (s = 0; s < n; s++) {
+    double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    size_t i;
+    for (i = 0; i < x.size(); i++) {
+      double y = d[s].b0 * x[i] + d[s].b1 * x1 + d[s].b2 * x2 - d[s].a1 * y1 - d[s].a2 * y2;
+      x2 = x1;
+      x1 = x[i];
+      y2 = y1;
+      y1 = y;
+      x[i] = y;
+    }
+  }
+  return x;
+}
+
+static std::vector<int32_t> deflation(uint32_t rate_hz) {
+  std::vector<int32_t> v;
+  int n = (int) (40 * rate_hz);
+  int i;
+  for (i = 0; i < n; i++) {
+    double t = (double) i / rate_hz;
+    double beat = fmod(t * 1.2, 1.0);
+    double p = 150 - 3 * t + 2 * exp(-beat / 0.3) * (beat > 0.1 ? 1 : beat / 0.1)
+               + 0.2 * (uniform() - 0.5) + 0.3 * sin(2 * M_PI * 50 * t);
+    v.push_back((int32_t) lround(p * 256));
+  }
+  return v;
+}
+
+template <int N>
+static std::vector<int32_t> run_fixed(const BiquadDesign * d, const std::vector<int32_t> & in) {
+  BiquadCascade<int32_t, N> f;
+  int s;
+  for (s = 0; s < N; s++) {
+    f.set(s, d[s]);
+  }
+  std::vector<int32_t> out(in.size());
+  f.run(in.data(), out.data(), (int) in.size());
+  return out;
+}
+
+template <int N>
+static std::vector<float> run_float(const BiquadDesign * d, const std::vector<int32_t> & in) {
+  BiquadCascade<float, N> f;
+  int s;
+  for (s = 0; s < N; s++) {
+    f.set(s, d[s]);
+  }
+  std::vector<float> out(in.size());
+  size_t i;
+  for (i = 0; i < in.size(); i++) {
+    out[i] = f.push((float) in[i]);
+  }
+  return out;
+}
+
+template <int N>
+static void check_filter(const char * name, const BiquadDesign * d, uint32_t rate_hz) {
+  Reference ref;
+  ref.design(d, N);
+  BiquadCascade<int32_t, N> f;
+  bool same = true;
+  int s, k;
+  for (s = 0; s < N; s++) {
+    f.set(s, d[s]);
+    for (k = 0; k < 5; k++) {
+      same = same && f.at(s).coefficient(k) == ref.c[s][k];
+    }
+  }
+  check(same, "the coefficients match the reference", rate_hz);
+
+  std::vector<std::vector<int32_t>> inputs;
+  inputs.push_back(deflation(rate_hz));
+  std::vector<int32_t> v(rate_hz * 20, 0);
+  v[0] = MMHG(10);
+  inputs.push_back(v);
+  // An impulse
+  v.assign(rate_hz * 20, MMHG(150));
+  inputs.push_back(v);
+  v.assign(rate_hz * 20, -(1 << 23) + 1);
+  inputs.push_back(v);
+  v.clear();
+  int i;
+  for (i = 0; i < (int) rate_hz * 20; i++) {
+    v.push_back((int32_t) ((uniform() * 2 - 1) * ((1 << 22) - 1)));
+  }
+  inputs.push_back(v);
+  // Full-scale noise; the filters gain less than 2 at any frequency
+
+  double gain = 1;
+  for (s = 0; s < N; s++) {
+    gain *= biquad_dc_gain(d[s]);
+  }
+  // 0 or 1 for these filters
+  size_t n;
+  double worst_fixed = 0, worst_float = 0;
+  for (n = 0; n < inputs.size(); n++) {
+    std::vector<int32_t> a = run_fixed<N>(d, inputs[n]);
+    std::vector<int32_t> b = ref.run(inputs[n]);
+    check(a == b, "the output matches the reference to the bit", rate_hz);
+    if (n == 0) {
+      std::vector<double> exact = run_double(d, N, inputs[n]);
+      std::vector<float> fl = run_float<N>(d, inputs[n]);
+      for (i = 0; i < (int) exact.size(); i++) {
+        worst_fixed = fmax(worst_fixed, fabs(a[i] - exact[i]) / 256);
+        worst_float = fmax(worst_float, fabs(fl[i] - exact[i]) / 256);
+      }
+    }
+    if (n == 2) {
+      int32_t want = (int32_t) lround(MMHG(150) * gain);
+      int worst = 0;
+      for (i = (int) a.size() - (int) rate_hz; i < (int) a.size(); i++) {
+        worst = abs(a[i] - want) > worst ? abs(a[i] - want) : worst;
+      }
+      printf("  %-22s steady pressure settles within %d counts\n", name, worst);
+      check(worst <= 1, "a steady pressure settles to the DC gain", rate_hz);
+    }
+  }
+  check(worst_fixed < 0.05 && worst_float < 0.05, "fixed and float within 0.05 mmHg of double",
+        rate_hz);
+
+  BiquadCascade<int32_t, N> primed;
+  for (s = 0; s < N; s++) {
+    primed.set(s, d[s]);
+  }
+  primed.prime(MMHG(150));
+  int32_t first = primed.push(MMHG(150));
+  check(first == (int32_t) lround(MMHG(150) * gain), "a primed filter starts at its steady output",
+        rate_hz);
+
+  printf("  %-22s max error against double: fixed %.4f mmHg, float %.4f mmHg\n",
+         name, worst_fixed, worst_float);
+}
+
+static void check_ramp(uint32_t rate_hz) {
+  CuffFilter f;
+  design_cuff_filter(f, rate_hz);
+  f.prime(MMHG(150));
+  int worst = 0;
+  int i;
+  for (i = 0; i < (int) rate_hz * 60; i++) {
+    int32_t y = f.push(MMHG(150) - (int32_t) ((int64_t) i * MMHG(4) / rate_hz));
+    if (i >= (int) rate_hz * 10 && abs(y) > worst) {
+      worst = abs(y);
+    }
+  }
+  printf("  a 4 mmHg/s deflation comes out of the band-pass within %d counts of 0\n", worst);
+  check(worst <= 2, "the band-pass takes out a steady deflation", rate_hz);
+}
+
+static void print_response(uint32_t rate_hz) {
+  static const double freqs[] = {0.1, 0.5, 1.2, 3.0, 8.0};
+  CuffFilter f;
+  design_cuff_filter(f, rate_hz);
+  printf("  band-pass gain:");
+  size_t k;
+  for (k = 0; k < sizeof(freqs) / sizeof(freqs[0]); k++) {
+    if (freqs[k] >= rate_hz / 2.0) {
+      continue;
+    }
+    f.reset();
+    int n = (int) (rate_hz * (40 + 20 / freqs[k]));
+    double peak = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+      int32_t y = f.push((int32_t) lround(MMHG(10) * sin(2 * M_PI * freqs[k] * i / rate_hz)));
+      if (i > n / 2) {
+        peak = fmax(peak, fabs((double) y));
+      }
+    }
+    printf("  %.1f Hz %+.1f dB", freqs[k], 20 * log10(peak / MMHG(10)));
+  }
+  printf("\n");
+}
+
+template <typename T, int N>
+static void time_cascade(const char * name, const std::vector<int32_t> & in, uint32_t rate_hz) {
+  std::vector<T> x(in.begin(), in.end());
+  BiquadCascade<T, N> f;
+  int s;
+  for (s = 0; s < N; s++) {
+    f.set(s, biquad_lowpass(CUFF_LOWPASS_HZ, rate_hz, BIQUAD_BUTTERWORTH));
+  }
+  Timing t = time_loop([&]() {
+    T sum = 0;
+    size_t i;
+    for (i = 0; i < x.size(); i++) {
+      sum += f.push(x[i]);
+    }
+    return sum;
+  }, 200, x.size());
+  printf("  %-6s %d stage%s  %6.2f ns  %6.2f TSC cycles per sample\n",
+         name, N, N > 1 ? "s" : " ",
+         t.ns, t.cycles);
+}
+
+int main() {
+  static const uint32_t rates[] = {25, 100, 200};
+  size_t r;
+  for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+    uint32_t rate = rates[r];
+    printf("%u Hz:\n", (unsigned) rate);
+    BiquadDesign band[2] = {biquad_highpass(CUFF_HIGHPASS_HZ, rate, BIQUAD_BUTTERWORTH),
+                            biquad_lowpass(CUFF_LOWPASS_HZ, rate, BIQUAD_BUTTERWORTH)};
+    check_filter<2>("cuff band-pass", band, rate);
+    BiquadDesign low[2] = {biquad_lowpass(5, rate, 0.5412), biquad_lowpass(5, rate, 1.3066)};
+    // A fourth-order Butterworth at 5 Hz
+    check_filter<2>("4th-order low-pass", low, rate);
+    BiquadDesign high[1] = {biquad_highpass(0.3, rate, BIQUAD_BUTTERWORTH)};
+    check_filter<1>("high-pass", high, rate);
+    check_ramp(rate);
+    print_response(rate);
+  }
+
+  std::vector<int32_t> in = deflation(SAMPLE_RATE_HZ);
+  printf("time per sample:\n");
+  time_cascade<int32_t, 1>("fixed", in, SAMPLE_RATE_HZ);
+  time_cascade<int32_t, 2>("fixed", in, SAMPLE_RATE_HZ);
+  time_cascade<int32_t, 4>("fixed", in, SAMPLE_RATE_HZ);
+  time_cascade<float, 1>("float", in, SAMPLE_RATE_HZ);
+  time_cascade<float, 2>("float", in, SAMPLE_RATE_HZ);
+  time_cascade<float, 4>("float", in, SAMPLE_RATE_HZ);
+
+  printf(failures ? "%d checks FAILED\n" : "all checks passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+// Measures the sample codec in sample_codec.h on recorded sessions:
+// the compression ratio against the 12-byte RecordedSample and the 8-byte
+// CaptureSample (timestamp and pressure), and the encode and decode
+// throughput. Samples are encoded in blocks of RECORDER_CHUNK, with the
+// encoder started over on every block as the session recorder does, and
+// every block is decoded and compared with the original
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/codec_bench.cpp sample_codec.cpp -o codec_bench
+// Usage:
+//   ./codec_bench [--every n] session1.trace [session2.trace ...]
+// --every n keeps every nth entry of the trace, e.g. 8 turns a 200 Hz
+// trace into the 25 Hz stream the firmware records by default
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "sample_codec.h"
+#include "session_recorder.h"
+
+static bool load(const char * path, int every, std::vector<RecordedSample> & out) {
+  FILE * f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+  char line[128];
+  int n = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long t;
+    unsigned int status;
+    unsigned long counts;
+    if (line[0] != '#' && sscanf(line, "%lu %u %lu", &t, &status, &counts) == 3 && n++ % every == 0) {
+      RecordedSample s;
+      s.time_us = (uint32_t) t;
+      s.counts = (uint32_t) counts & 0xFFFFFFU;
+      s.status = (uint8_t) status;
+      s.phase = PHASE_DEFLATE;
+      s.reserved = 0;
+      out.push_back(s);
+    }
+  }
+  fclose(f);
+  return !out.empty();
+}
+
+static uint32_t encode_all(const std::vector<RecordedSample> & in, std::vector<uint8_t> & out,
+                           std::vector<uint32_t> & block_starts) {
+  SampleEncoder enc;
+  uint32_t used = 0;
+  size_t i;
+  for (i = 0; i < in.size(); i++) {
+    if (i % RECORDER_CHUNK == 0) {
+      enc.reset();
+      block_starts.push_back(used);
+    }
+    used += enc.encode(in[i], &out[used]);
+  }
+  return used;
+}
+
+static bool decode_all(const std::vector<uint8_t> & data, uint32_t used,
+                       const std::vector<uint32_t> & block_starts,
+                       std::vector<RecordedSample> & out) {
+  SampleDecoder dec;
+  const uint8_t * p = data.data();
+  const uint8_t * end = p + used;
+  size_t i;
+  for (i = 0; i < out.size(); i++) {
+    if (i % RECORDER_CHUNK == 0) {
+      dec.reset();
+      p = data.data() + block_starts[i / RECORDER_CHUNK];
+    }
+    int n = dec.decode(p, end, out[i]);
+    if (n == 0) {
+      return false;
+    }
+    p += n;
+  }
+  return true;
+}
+
+int main(int argc, char ** argv) {
+  int arg = 1;
+  int every = 1;
+  if (argc > 2 && strcmp(argv[1], "--every") == 0) {
+    every = atoi(argv[2]);
+    arg = 3;
+  }
+  if (arg >= argc || every < 1) {
+    fprintf(stderr, "usage: %s [--every n] session.trace [...]\n", argv[0]);
+    return 2;
+  }
+
+  int failed = 0;
+  for (; arg < argc; arg++) {
+    std::vector<RecordedSample> samples;
+    if (!load(argv[arg], every, samples)) {
+      fprintf(stderr, "%s: cannot load trace\n", argv[arg]);
+      failed++;
+      continue;
+    }
+
+    size_t n = samples.size();
+    std::vector<uint8_t> data(n * SAMPLE_MAX_ENCODED);
+    std::vector<uint32_t> starts;
+    std::vector<RecordedSample> decoded(n);
+    const int repeats = 200;
+
+    uint32_t used = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    int r;
+    for (r = 0; r < repeats; r++) {
+      starts.clear();
+      used = encode_all(samples, data, starts);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (r = 0; r < repeats; r++) {
+      ok = decode_all(data, used, starts, decoded) && ok;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; i < n && ok; i++) {
+      ok = decoded[i].time_us == samples[i].time_us && decoded[i].counts == samples[i].counts
+           && decoded[i].status == samples[i].status && decoded[i].phase == samples[i].phase;
+    }
+    if (!ok) {
+      failed++;
+    }
+
+    uint32_t stored = used + (uint32_t) starts.size() * 4;
+    // With the recorder's block headers (padding left out)
+    double enc_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double) n * repeats);
+    double dec_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / ((double) n * repeats);
+    printf("%s: %zu samples, %.2f bytes per sample, %.1fx vs RecordedSample, %.1fx vs CaptureSample%s\n",
+           argv[arg], n, (double) stored / n, 12.0 * n / stored, 8.0 * n / stored,
+           ok ? "" : "  ROUND TRIP FAILED");
+    printf("  encode %.1f ns/sample (%.0f MB/s of samples), decode %.1f ns/sample (%.0f MB/s)\n",
+           enc_ns, sizeof(RecordedSample) * 1e3 / enc_ns, dec_ns, sizeof(RecordedSample) * 1e3 / dec_ns);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+// Checks and times the oversampling decimator in decimator.h
+// Feeds it a synthetic deflation at the oversampled rate: a falling cuff
+// pressure with a 1.2 Hz oscillation on top, white sensor noise, and a
+// 24 Hz interference tone that would fold down to 1 Hz if every 7th
+// reading were simply kept. Reports the error of the decimated stream and
+// of plain 1-in-7 sampling against the clean signal, the DC gain, and the
+// time per input sample
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/decimate_bench.cpp -o decimate_bench
+// Usage:
+//   ./decimate_bench [noise_mmhg] [tone_mmhg]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "sensor_profile.h"
+#include "decimator.h"
+#include "sampler.h"
+#include "bench.h"
+
+#define RATIO 7
+#define STAGES 3
+// The same filter the firmware uses (see sensor.h)
+
+static const double COUNTS_PER_MMHG =
+    (CuffSensor::output_max - CuffSensor::output_min) / 300.0;
+
+static double clean_mmhg(double t) {
+  return 150.0 - 3.0 * t + 2.0 * sin(2 * M_PI * 1.2 * t);
+  // Deflating at 3 mmHg/s with 2 mmHg oscillations at 72 bpm
+}
+
+int main(int argc, char ** argv) {
+  double sigma = argc > 1 ? atof(argv[1]) : 0.3;
+  double tone = argc > 2 ? atof(argv[2]) : 0.5;
+  const double in_rate = SAMPLE_RATE_HZ * RATIO;
+  const int n = (int) (40 * in_rate);
+  // 40 s of deflation
+
+  std::vector<int32_t> input(n);
+  int i;
+  seed_random(1);
+  for (i = 0; i < n; i++) {
+    double t = i / in_rate;
+    double p = clean_mmhg(t) + sigma * gaussian() + tone * sin(2 * M_PI * 24.0 * t);
+    input[i] = CuffSensor::output_min + (int32_t) lround(p * COUNTS_PER_MMHG);
+  }
+
+  CicDecimator<RATIO, STAGES> cic;
+  double err_cic = 0, err_plain = 0, max_cic = 0;
+  int outputs = 0;
+  for (i = 0; i < n; i++) {
+    int32_t y;
+    if (cic.push(input[i], y)) {
+      double t = (i - (double) CicDecimator<RATIO, STAGES>::delay()) / in_rate;
+      double e = (y - CuffSensor::output_min) / COUNTS_PER_MMHG - clean_mmhg(t);
+      err_cic += e * e;
+      max_cic = fmax(max_cic, fabs(e));
+      outputs++;
+    }
+    if (i % RATIO == 0) {
+      double e = (input[i] - CuffSensor::output_min) / COUNTS_PER_MMHG - clean_mmhg(i / in_rate);
+      err_plain += e * e;
+    }
+  }
+
+  CicDecimator<RATIO, STAGES> dc;
+  int32_t level = 1234567, y = 0;
+  bool exact = true;
+  for (i = 0; i < 20 * RATIO; i++) {
+    if (dc.push(level, y) && y != level) {
+      exact = false;
+    }
+  }
+
+  Timing timing = time_loop([&]() {
+    CicDecimator<RATIO, STAGES> d;
+    int64_t sum = 0;
+    int k;
+    for (k = 0; k < n; k++) {
+      int32_t out;
+      if (d.push(input[k], out)) {
+        sum += out;
+      }
+    }
+    return sum;
+  }, 20, n);
+
+  printf("input %.0f Hz, output %d Hz, noise %.2f mmHg rms, %.2f mmHg tone at 24 Hz\n",
+         in_rate, SAMPLE_RATE_HZ, sigma, tone);
+  printf("1-in-%d sampling  rms error %.3f mmHg\n", RATIO, sqrt(err_plain / (n / RATIO)));
+  printf("CIC R=%d N=%d     rms error %.3f mmHg, max %.3f mmHg, delay %u input samples\n",
+         RATIO, STAGES, sqrt(err_cic / outputs), max_cic,
+         (unsigned) CicDecimator<RATIO, STAGES>::delay());
+  printf("DC gain %s\n", exact ? "exact" : "NOT exact");
+  printf("%.2f ns  %.2f TSC cycles per input sample\n", timing.ns, timing.cycles);
+  return exact ? 0 : 1;
+}
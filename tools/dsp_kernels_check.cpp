@@ -0,0 +1,134 @@
+// Checks the kernels in dsp_kernels.h against their plain C versions and
+// times both
+// Every kernel is run over random blocks of every length from 0 to 70, at
+// every offset from 0 to 3 so the loads are unaligned, with random
+// samples, full-scale ones that make the differences saturate, and runs of
+// equal values for the peak search; the outputs must match exactly
+// Then prints a table of the time per sample of each kernel over a 4096
+// sample block, plain C against the version this build uses
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/dsp_kernels_check.cpp dsp_kernels.cpp -o dsp_kernels_check
+// Usage:
+//   ./dsp_kernels_check
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "dsp_kernels.h"
+#include "bench.h"
+
+static int16_t sample(int kind) {
+  switch (kind) {
+  case 0:
+    return (int16_t) next_random();
+  case 1:
+    return next_random() & 1 ? 32767 : -32768;
+    // Differences of these saturate both ways
+  case 2:
+    return (int16_t) (next_random() % 4);
+    // Many equal values, so the first peak has to be found
+  default:
+    return (int16_t) ((int32_t) (next_random() % 2001) - 1000);
+  }
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char * kernel, int n, int offset, int kind) {
+  if (!ok && failures++ < 10) {
+    printf("FAILED: %s differs for n=%d offset=%d kind=%d\n", kernel, n, offset, kind);
+  }
+}
+
+static void check_all() {
+  int16_t in[80];
+  int16_t a[80], b[80];
+  int32_t sa[80], sb[80];
+  int kind, n, offset, w;
+  for (kind = 0; kind < 4; kind++) {
+    for (n = 0; n <= 70; n++) {
+      for (offset = 0; offset < 4; offset++) {
+        int i;
+        for (i = 0; i < 80; i++) {
+          in[i] = sample(kind);
+        }
+        const int16_t * x = in + offset;
+        int16_t prev = sample(kind);
+
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        dsp_diff16(x, a + offset, n, prev);
+        dsp_diff16_scalar(x, b + offset, n, prev);
+        check(memcmp(a, b, sizeof(a)) == 0, "dsp_diff16", n, offset, kind);
+        int16_t copy[80];
+        memcpy(copy, in, sizeof(in));
+        dsp_diff16(copy + offset, copy + offset, n, prev);
+        check(memcmp(copy + offset, b + offset, n * sizeof(int16_t)) == 0, "dsp_diff16 in place",
+              n, offset, kind);
+
+        check(dsp_sum16(x, n) == dsp_sum16_scalar(x, n), "dsp_sum16", n, offset, kind);
+
+        for (w = 1; w <= n && w <= 9; w++) {
+          memset(sa, 0, sizeof(sa));
+          memset(sb, 0, sizeof(sb));
+          dsp_moving_sum16(x, sa, n, w);
+          dsp_moving_sum16_scalar(x, sb, n, w);
+          check(memcmp(sa, sb, sizeof(sa)) == 0, "dsp_moving_sum16", n, offset, kind);
+        }
+
+        check(dsp_peak16(x, n) == dsp_peak16_scalar(x, n), "dsp_peak16", n, offset, kind);
+
+        int16_t e = (int16_t) (next_random() % 32768);
+        int16_t decay = (int16_t) (next_random() % 300);
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        int16_t ea = dsp_envelope16(x, a, n, e, decay);
+        int16_t eb = dsp_envelope16_scalar(x, b, n, e, decay);
+        check(ea == eb && memcmp(a, b, sizeof(a)) == 0, "dsp_envelope16", n, offset, kind);
+      }
+    }
+  }
+}
+
+static void row(const char * name, Timing plain, Timing fast) {
+  printf("%-18s %7.3f %7.2f   %7.3f %7.2f   %5.1fx\n", name, plain.ns, plain.cycles,
+         fast.ns, fast.cycles, fast.ns > 0 ? plain.ns / fast.ns : 0);
+}
+
+int main() {
+  check_all();
+  printf("equivalence: %s\n", failures ? "FAILED" : "every kernel matches plain C");
+
+  const int n = 4096;
+  const int repeats = 2000;
+  const int w = 25;
+  // A second of samples at 25 Hz, the moving sum's window
+  std::vector<int16_t> x(n + 1), d(n);
+  std::vector<int32_t> s(n);
+  int i;
+  for (i = 0; i <= n; i++) {
+    x[i] = sample(3);
+  }
+  const int16_t * in = x.data() + 1;
+  // Off by one sample, as a block in the middle of a buffer would be
+
+  printf("\n%s kernels, ns and TSC cycles per sample over %d samples\n", dsp_kernel_flavour(), n);
+  printf("%-18s %15s   %15s\n", "", "plain C", "this build");
+  row("difference",
+      time_loop([&]() { dsp_diff16_scalar(in, d.data(), n, 0); return d[n - 1]; }, repeats, n),
+      time_loop([&]() { dsp_diff16(in, d.data(), n, 0); return d[n - 1]; }, repeats, n));
+  row("sum",
+      time_loop([&]() { return dsp_sum16_scalar(in, n); }, repeats, n),
+      time_loop([&]() { return dsp_sum16(in, n); }, repeats, n));
+  row("moving sum (25)",
+      time_loop([&]() { dsp_moving_sum16_scalar(in, s.data(), n, w); return s[n - w]; }, repeats, n),
+      time_loop([&]() { dsp_moving_sum16(in, s.data(), n, w); return s[n - w]; }, repeats, n));
+  row("peak search",
+      time_loop([&]() { return dsp_peak16_scalar(in, n); }, repeats, n),
+      time_loop([&]() { return dsp_peak16(in, n); }, repeats, n));
+  row("envelope",
+      time_loop([&]() { return dsp_envelope16_scalar(in, d.data(), n, 0, 4); }, repeats, n),
+      time_loop([&]() { return dsp_envelope16(in, d.data(), n, 0, 4); }, repeats, n));
+  return failures ? 1 : 0;
+}
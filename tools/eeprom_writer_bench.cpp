@@ -0,0 +1,209 @@
+// Replays a recorded cuff session with the pressure sensor and the EEPROM
+// stand-in on one shared bus, appending a history record to the log every
+// second the way main does after a measurement, and reports how the
+// sampling held up: the longest gap between samples main saw and the
+// sampler's jitter and missed ticks. By default the appends go through
+// EepromWriter and the queue depth, latency and merged page writes are
+// reported too; --blocking appends with eeprom_write inside
+// pause_acquisition instead, as main used to
+// Then checks that merging rewrites of one page saves write cycles, and
+// reboots and reads every record back
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/eeprom_writer_bench.cpp $(ls *.cpp | grep -v main.cpp) -o eeprom_writer_bench
+// Usage:
+//   ./eeprom_writer_bench [--blocking] [--burst n] session.trace [eeprom_file]
+// --burst appends n records at a time instead of one
+// The file (eeprom_writer_bench.eeprom by default) is erased first
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sensor.h"
+#include "sampler.h"
+#include "eeprom.h"
+#include "eeprom_writer.h"
+#include "history.h"
+
+// Routes each transfer to the sensor or the EEPROM by address, like two
+// devices on one physical bus
+class BusMux : public PressureBus {
+public:
+  BusMux(PressureBus * sensor_bus, PressureBus * eeprom_bus)
+      : sensor_bus(sensor_bus), eeprom_bus(eeprom_bus) {}
+  int write(uint8_t addr, const uint8_t * data, int len) override {
+    return route(addr)->write(addr, data, len);
+  }
+  int read(uint8_t addr, uint8_t * data, int len) override {
+    return route(addr)->read(addr, data, len);
+  }
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override {
+    return route(addr)->transfer(addr, tx, tx_len, rx, rx_len, cb, ctx);
+  }
+
+private:
+  PressureBus * route(uint8_t addr) {
+    return (addr & ~1U) == eeprom_address() ? eeprom_bus : sensor_bus;
+  }
+
+  PressureBus * sensor_bus;
+  PressureBus * eeprom_bus;
+};
+
+static HistoryRecord make(uint32_t seq) {
+  HistoryRecord r;
+  r.seq = 0;
+  r.time = 1700000000U + seq * 60U;
+  r.systolic = (uint16_t) (100 + seq % 60);
+  r.diastolic = (uint16_t) (60 + seq % 30);
+  r.heart_rate = (uint8_t) (50 + seq % 70);
+  r.flags = HISTORY_CLOCK_SET;
+  return r;
+}
+
+int main(int argc, char ** argv) {
+  bool blocking = false;
+  int burst = 1;
+  int arg = 1;
+  while (arg < argc && argv[arg][0] == '-') {
+    if (strcmp(argv[arg], "--blocking") == 0) {
+      blocking = true;
+    } else if (strcmp(argv[arg], "--burst") == 0 && arg + 1 < argc) {
+      burst = atoi(argv[++arg]);
+    }
+    arg++;
+  }
+  if (arg >= argc || burst < 1) {
+    fprintf(stderr, "usage: %s [--blocking] [--burst n] session.trace [eeprom_file]\n", argv[0]);
+    return 2;
+  }
+  const char * path = arg + 1 < argc ? argv[arg + 1] : "eeprom_writer_bench.eeprom";
+  if (!eeprom_use_file(path)) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return 1;
+  }
+
+  TraceReplayBus trace(CuffSensor::address);
+  if (!trace.load(argv[arg])) {
+    fprintf(stderr, "%s: cannot load trace\n", argv[arg]);
+    return 1;
+  }
+  BusMux mux(&trace, eeprom_host_bus());
+  SharedBus bus(&mux);
+  EepromWriter writer(&bus);
+
+  host_clock_reset();
+  eeprom_host_erase();
+  eeprom_init();
+  history.begin();
+  writer.begin(eeprom_address());
+  if (!blocking) {
+    history.use_writer(&writer);
+  }
+  setup_sensor(&bus);
+  start_acquisition(SAMPLE_RATE_HZ);
+
+  uint32_t samples = 0;
+  uint32_t max_gap_us = 0;
+  uint32_t last_us = 0;
+  uint32_t refused = 0;
+  read_pressure();
+  last_us = sample_time_us;
+  while (!trace.finished()) {
+    sleep_and_update_pressure();
+    samples++;
+    if (sample_time_us - last_us > max_gap_us) {
+      max_gap_us = sample_time_us - last_us;
+    }
+    last_us = sample_time_us;
+
+    if (samples % SAMPLE_RATE_HZ == 0) {
+      int i;
+      for (i = 0; i < burst; i++) {
+        HistoryRecord r = make(history.next());
+        if (blocking) {
+          pause_acquisition();
+          history.append(r);
+          resume_acquisition();
+        } else if (!history.append(r)) {
+          refused++;
+        }
+      }
+    }
+  }
+  while (!writer.idle()) {
+    platform_wait_for_event();
+    // Let the last writes finish
+  }
+  sampler.stop();
+
+  SamplerStats st = sampler.stats();
+  printf("%s: %u samples, %u records, longest gap between samples %.1f ms\n",
+         blocking ? "blocking writes" : "queued writes", (unsigned) samples,
+         (unsigned) history.size(), max_gap_us / 1000.0);
+  printf("sampler: %u missed ticks, jitter mean %u us max %u us, %u ring overflows\n",
+         (unsigned) st.missed_ticks, (unsigned) st.mean_jitter_us, (unsigned) st.max_jitter_us,
+         (unsigned) sample_ring.overflows());
+  if (!blocking) {
+    printf("writer: %u writes, %u page writes, %u merged, %u errors, %u refused, "
+           "depth max %u, latency mean %.1f ms max %.1f ms, %u transfers waited for the bus\n",
+           (unsigned) writer.writes(), (unsigned) writer.page_writes(), (unsigned) writer.merged(),
+           (unsigned) writer.errors(), (unsigned) refused, (unsigned) writer.max_depth(),
+           writer.mean_latency_us() / 1000.0, writer.max_latency_us() / 1000.0,
+           (unsigned) bus.waits());
+  }
+
+  int failures = 0;
+  uint16_t scratch = EEPROM_BYTES - 16;
+  // The last record slot; the log above only used the first slots
+  uint32_t before = 0;
+  uint32_t page;
+  for (page = scratch / EEPROM_PAGE_BYTES; page < EEPROM_BYTES / EEPROM_PAGE_BYTES; page++) {
+    before += eeprom_host_page_writes(page);
+  }
+  uint8_t bytes[16];
+  int i;
+  for (i = 0; i < 16; i++) {
+    bytes[i] = (uint8_t) (i * 17);
+    writer.write((uint16_t) (scratch + i), bytes + i, 1, NULL, NULL);
+    // Sixteen one-byte writes, queued faster than a page is programmed
+  }
+  while (!writer.idle()) {
+    platform_wait_for_event();
+  }
+  uint32_t cycles = 0;
+  for (page = scratch / EEPROM_PAGE_BYTES; page < EEPROM_BYTES / EEPROM_PAGE_BYTES; page++) {
+    cycles += eeprom_host_page_writes(page);
+  }
+  cycles -= before;
+  uint8_t back[16];
+  eeprom_read(scratch, back, sizeof(back));
+  printf("16 one-byte writes took %u write cycles\n", (unsigned) cycles);
+  if (memcmp(back, bytes, sizeof(back)) != 0 || cycles >= 16) {
+    printf("FAILED: one-byte writes to one page are merged\n");
+    failures++;
+  }
+
+  uint32_t kept = history.size();
+  eeprom_init();
+  history.begin();
+  uint32_t bad = 0;
+  uint32_t seq;
+  for (seq = history.first(); seq < history.next(); seq++) {
+    HistoryRecord r;
+    HistoryRecord want = make(seq);
+    if (!history.read(seq, r) || r.time != want.time || r.systolic != want.systolic
+        || r.diastolic != want.diastolic || r.heart_rate != want.heart_rate) {
+      bad++;
+    }
+  }
+  printf("after a reboot: %u records, %u bad\n", (unsigned) history.size(), (unsigned) bad);
+  if (history.size() != kept || bad != 0 || history.write_errors() != 0) {
+    printf("FAILED: every record reads back after a reboot\n");
+    failures++;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+// Reads a session exported by the board (see export_protocol.h) from its
+// virtual COM port, a pseudo-terminal, a file or a pipe, checks every
+// frame, and prints the session's results and samples
+// Stops at the end of the first complete session, or at the end of the
+// input. Exits with 1 if frames were lost or damaged
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/export_decode.cpp export_protocol.cpp crc.cpp sample_codec.cpp -o export_decode
+// Usage:
+//   ./export_decode [--csv] /dev/ttyACM0|file|-
+//   ./export_decode --selftest
+// --csv prints every sample as "time_us,counts,status,phase" on stdout;
+// the summary always goes to stderr
+// --selftest checks that the parser finds a good frame that starts inside
+// a damaged one: one cut short, one with a bad CRC, and sync bytes in the
+// data before it
+// Set the port to 115200 baud first (stty -F /dev/ttyACM0 115200 raw)
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "export_protocol.h"
+#include "sample_codec.h"
+
+static int feed_all(FrameParser & parser, const uint8_t * data, int len, uint8_t * seqs) {
+  // Returns how many frames came out, and their seq numbers in seqs
+
+  int frames = 0;
+  int i;
+  for (i = 0; i < len; i++) {
+    if (parser.feed(data[i])) {
+      seqs[frames++] = parser.seq();
+    }
+  }
+  return frames;
+}
+
+static bool selftest() {
+  uint8_t payload[40];
+  int i;
+  for (i = 0; i < (int) sizeof(payload); i++) {
+    payload[i] = (uint8_t) (i * 7);
+  }
+  uint8_t good[2][EXPORT_HEADER_BYTES + sizeof(payload) + 2];
+  int size = build_frame(good[0], FRAME_SAMPLES, 1, payload, sizeof(payload));
+  build_frame(good[1], FRAME_SAMPLES, 2, payload, sizeof(payload));
+
+  const char * const names[] = {
+    "a frame cut short", "a bad CRC", "sync bytes and a length in the data",
+    "sync bytes and a length no frame has"
+  };
+  bool ok = true;
+  int c;
+  for (c = 0; c < 4; c++) {
+    uint8_t stream[3 * sizeof(good[0])];
+    int len = build_frame(stream, FRAME_SAMPLES, 9, payload, sizeof(payload));
+    // The damaged frame, and then the two good ones, which start inside
+    // the bytes it claims
+    if (c == 0) {
+      len = 20;
+    } else if (c == 1) {
+      stream[len - 1] ^= 0x01;
+    } else {
+      put_u16(stream + 4, c == 2 ? 60 : EXPORT_MAX_PAYLOAD + 1);
+      len = EXPORT_HEADER_BYTES;
+    }
+    memcpy(stream + len, good[0], size);
+    len += size;
+    memcpy(stream + len, good[1], size);
+    len += size;
+
+    FrameParser parser;
+    uint8_t seqs[4];
+    int frames = feed_all(parser, stream, len, seqs);
+    bool pass = frames == 2 && seqs[0] == 1 && seqs[1] == 2 && parser.crc_errors() == 1;
+    fprintf(stderr, "%s: %d frames, %u bad CRCs, %u bytes skipped%s\n", names[c], frames,
+            (unsigned) parser.crc_errors(), (unsigned) parser.skipped(), pass ? "" : " FAILED");
+    ok &= pass;
+  }
+  return ok;
+}
+
+int main(int argc, char ** argv) {
+  if (argc == 2 && strcmp(argv[1], "--selftest") == 0) {
+    return selftest() ? 0 : 1;
+  }
+  bool csv = argc == 3 && strcmp(argv[1], "--csv") == 0;
+  if (argc != 2 && !csv) {
+    fprintf(stderr, "usage: %s [--csv] port|file|-\n", argv[0]);
+    return 2;
+  }
+
+  const char * path = argv[argc - 1];
+  int fd = STDIN_FILENO;
+  if (strcmp(path, "-") != 0) {
+    fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(path);
+      return 1;
+    }
+  }
+  if (isatty(fd)) {
+    struct termios t;
+    if (tcgetattr(fd, &t) == 0) {
+      cfmakeraw(&t);
+      tcsetattr(fd, TCSANOW, &t);
+      // Without this the terminal would eat or translate some bytes
+    }
+  }
+
+  FrameParser parser;
+  SampleDecoder decoder;
+  bool started = false;
+  bool ended = false;
+  uint8_t expected_seq = 0;
+  uint32_t lost_frames = 0;
+  uint32_t bad_samples = 0;
+  uint32_t announced = 0;
+  uint32_t received = 0;
+  uint32_t next_index = 0;
+  uint32_t inflate = 0;
+  uint32_t deflate = 0;
+  uint32_t first_us = 0;
+  uint32_t last_us = 0;
+
+  uint8_t buf[256];
+  while (!ended) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+
+    ssize_t i;
+    for (i = 0; i < n && !ended; i++) {
+      if (!parser.feed(buf[i])) {
+        continue;
+      }
+      const uint8_t * p = parser.payload();
+      int len = parser.length();
+      if (parser.type() == FRAME_SESSION_START) {
+        if (len < 12 || p[0] != EXPORT_VERSION) {
+          fprintf(stderr, "unsupported export version %u\n", len ? p[0] : 0);
+          return 1;
+        }
+        started = true;
+        expected_seq = parser.seq();
+        announced = get_u32(p + 8);
+        fprintf(stderr, "session %u: %u samples at %u Hz\n",
+                (unsigned) get_u32(p + 4), (unsigned) announced, (unsigned) get_u16(p + 2));
+      }
+      if (!started || parser.type() > FRAME_SESSION_END) {
+        continue;
+        // Joined in the middle of a session (wait for the next one), or
+        // a live telemetry frame, which has its own seq
+      }
+      if (parser.seq() != expected_seq) {
+        lost_frames += (uint8_t) (parser.seq() - expected_seq);
+      }
+      expected_seq = (uint8_t) (parser.seq() + 1);
+
+      if (parser.type() == FRAME_SAMPLES && len >= 6) {
+        uint32_t index = get_u32(p);
+        int count = get_u16(p + 4);
+        if (index != next_index) {
+          fprintf(stderr, "samples %u to %u missing\n", (unsigned) next_index, (unsigned) index - 1);
+        }
+        next_index = index + count;
+        decoder.reset();
+        const uint8_t * in = p + 6;
+        const uint8_t * end = p + len;
+        int k;
+        for (k = 0; k < count; k++) {
+          RecordedSample s;
+          int used = decoder.decode(in, end, s);
+          if (used == 0) {
+            bad_samples += count - k;
+            break;
+          }
+          in += used;
+          if (received == 0) {
+            first_us = s.time_us;
+          }
+          last_us = s.time_us;
+          received++;
+          if (s.phase == PHASE_INFLATE) {
+            inflate++;
+          } else {
+            deflate++;
+          }
+          if (csv) {
+            printf("%u,%u,%u,%u\n", (unsigned) s.time_us, (unsigned) s.counts,
+                   (unsigned) s.status, (unsigned) s.phase);
+          }
+        }
+      } else if (parser.type() == FRAME_RESULTS && len >= 8) {
+        if (get_u16(p + 6) & EXPORT_RESULTS_VALID) {
+          fprintf(stderr, "heart rate %d bpm, %d/%d mmHg\n", (int16_t) get_u16(p),
+                  (int16_t) get_u16(p + 2), (int16_t) get_u16(p + 4));
+        } else {
+          fprintf(stderr, "no results: the measurement timed out\n");
+        }
+      } else if (parser.type() == FRAME_SESSION_END && len >= 8) {
+        fprintf(stderr, "end: %u samples sent, %u dropped by the recorder\n",
+                (unsigned) get_u32(p), (unsigned) get_u32(p + 4));
+        ended = true;
+      }
+    }
+  }
+
+  fprintf(stderr, "received %u of %u samples (%u inflating, %u deflating) over %.2f s; "
+          "%u frames lost, %u bad CRCs, %u bytes skipped, %u undecodable samples\n",
+          (unsigned) received, (unsigned) announced, (unsigned) inflate, (unsigned) deflate,
+          (last_us - first_us) / 1e6, (unsigned) lost_frames, (unsigned) parser.crc_errors(),
+          (unsigned) parser.skipped(), (unsigned) bad_samples);
+  bool ok = ended && received == announced && lost_frames == 0 && parser.crc_errors() == 0
+            && bad_samples == 0;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// Checks the heart rate estimator in heart_rate.h on synthetic beat
+// sequences with a known rate: 60 s of beats between 45 and 150 bpm with
+// 3% beat-to-beat variation, timed to the 40 ms sample period, with and
+// without missed beats, extra beats, a burst of noise at the end (as the
+// oscillations die out at a low cuff pressure) and a change of rate
+// halfway through. Compares it with the count of beats over the time
+// between the first and the last, and prints the mean and worst error of
+// both and the mean confidence for each kind of sequence
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/heart_rate_check.cpp heart_rate.cpp -o heart_rate_check
+// Usage:
+//   ./heart_rate_check [sequences] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "heart_rate.h"
+#include "bench.h"
+
+#define PERIOD_US 40000
+// Beats are found at sample times, 25 Hz
+
+enum Kind {
+  CLEAN,
+  MISSED,
+  EXTRA,
+  MISSED_AND_EXTRA,
+  NOISY_END,
+  RATE_CHANGE,
+  KINDS
+};
+
+static const char * const names[KINDS] = {
+  "clean", "10% missed", "10% extra", "both", "noisy end", "rate change"
+};
+
+static uint32_t quantize(double t) {
+  return (uint32_t) (lround(t * 1e6 / PERIOD_US) * PERIOD_US);
+}
+
+static double make(Kind kind, std::vector<uint32_t> & beats) {
+  // Returns the rate at the end of the sequence
+
+  double bpm = 45 + 105 * uniform();
+  double end_bpm = kind == RATE_CHANGE ? bpm * (uniform() < 0.5 ? 0.8 : 1.25) : bpm;
+  beats.clear();
+  double t = uniform();
+  while (t < 60) {
+    double rate = t < 30 ? bpm : end_bpm;
+    double interval = 60 / rate * (1 + 0.03 * gaussian());
+    bool missed = (kind == MISSED || kind == MISSED_AND_EXTRA) && uniform() < 0.1;
+    bool extra = (kind == EXTRA || kind == MISSED_AND_EXTRA) && uniform() < 0.1;
+    if (!missed) {
+      beats.push_back(quantize(t));
+    }
+    if (extra) {
+      beats.push_back(quantize(t + interval * (0.2 + 0.6 * uniform())));
+    }
+    t += interval;
+  }
+  if (kind == NOISY_END) {
+    int i;
+    for (i = 0; i < 6; i++) {
+      t += 0.3 + 2 * uniform();
+      beats.push_back(quantize(t));
+      // The last few beats are noise
+    }
+  }
+  return end_bpm;
+}
+
+struct Errors {
+  double sum[2];
+  double worst[2];
+  double confidence;
+};
+
+int main(int argc, char ** argv) {
+  int sequences = argc > 1 ? atoi(argv[1]) : 500;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+  if (sequences < 1) {
+    fprintf(stderr, "usage: %s [sequences] [seed]\n", argv[0]);
+    return 2;
+  }
+  seed_random(seed);
+
+  std::vector<uint32_t> beats;
+  HeartRateEstimator estimator;
+  bool ok = true;
+  double clean_confidence = 0;
+  printf("%d sequences each; mean/worst error in bpm and the mean confidence\n", sequences);
+  printf("%-12s %17s %17s %11s\n", "", "estimator", "beat count", "confidence");
+  int k;
+  for (k = 0; k < KINDS; k++) {
+    Errors e = {{0, 0}, {0, 0}, 0};
+    int i;
+    for (i = 0; i < sequences; i++) {
+      double truth = make((Kind) k, beats);
+      estimator.reset();
+      for (uint32_t b : beats) {
+        estimator.beat(b);
+      }
+      double err[2];
+      err[0] = fabs(estimator.bpm() - truth);
+      err[1] = fabs((beats.size() - 1) * 60e6 / (beats.back() - beats.front()) - truth);
+      int j;
+      for (j = 0; j < 2; j++) {
+        e.sum[j] += err[j];
+        e.worst[j] = err[j] > e.worst[j] ? err[j] : e.worst[j];
+      }
+      e.confidence += estimator.confidence();
+    }
+    double mean = e.sum[0] / sequences;
+    printf("%-12s %7.1f / %7.1f %7.1f / %7.1f %11.0f\n", names[k], mean, e.worst[0],
+           e.sum[1] / sequences, e.worst[1], e.confidence / sequences);
+    if (k == CLEAN) {
+      clean_confidence = e.confidence / sequences;
+    } else if (k != RATE_CHANGE && e.confidence / sequences >= clean_confidence) {
+      printf("FAILED: %s sequences get less confidence than clean ones\n", names[k]);
+      ok = false;
+    }
+    if (mean > 2) {
+      printf("FAILED: %s sequences are off by more than 2 bpm on average\n", names[k]);
+      ok = false;
+    }
+  }
+
+  estimator.reset();
+  estimator.beat(0);
+  estimator.beat(6 * PERIOD_US);
+  if (estimator.bpm() != 0 || estimator.confidence() != 0) {
+    printf("FAILED: an interval under 300 ms gives no rate\n");
+    ok = false;
+  }
+  estimator.reset();
+  estimator.beat(0xFFFFFFFFU - 400000);
+  estimator.beat(400000);
+  if (estimator.bpm() != 75) {
+    printf("FAILED: intervals across the wrap of the microsecond clock\n");
+    ok = false;
+  }
+  printf(ok ? "all checks passed\n" : "some checks FAILED\n");
+  return ok ? 0 : 1;
+}
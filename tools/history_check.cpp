@@ -0,0 +1,273 @@
+// Exercises the measurement history log against the file-backed EEPROM
+// stand-in: appends, reboots (the file is reread and the index rebuilt),
+// wrapping round the ring, writes cut off by a power loss, and how evenly
+// the pages wear. Prints how many records each boot scan read and how
+// long an append takes on the simulated clock
+// Also checks every query of the history index, built at boot and kept up
+// to date by appends, against the same stats worked out from the records
+// read back one by one
+// Last, checks that EepromWriter's merging of writes waiting for the same
+// page never lets an older one put back stale bytes
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/history_check.cpp $(ls *.cpp | grep -v main.cpp) -o history_check
+// Usage:
+//   ./history_check [eeprom_file]
+// The file (history_check.eeprom by default) is erased first
+
+#include <stdio.h>
+#include "platform.h"
+#include <string.h>
+#include "eeprom.h"
+#include "eeprom_writer.h"
+#include "history.h"
+#include "history_index.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char * what) {
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+static HistoryRecord make(uint32_t i) {
+  HistoryRecord r;
+  r.seq = 0;
+  r.time = 1700000000U + i * 3600U;
+  r.systolic = (uint16_t) (100 + i % 60);
+  r.diastolic = (uint16_t) (60 + i % 30);
+  r.heart_rate = (uint8_t) (50 + i % 70);
+  r.flags = HISTORY_CLOCK_SET;
+  if (i % 17 == 0) {
+    r.flags |= HISTORY_TIMED_OUT;
+  }
+  if (i % 29 == 0) {
+    r.time = i;
+    r.flags = 0;
+    // Taken before the clock was set
+  }
+  return r;
+}
+
+static void reboot() {
+  eeprom_init();
+  check(history.begin(), "the log can be scanned");
+  printf("boot: %u records (seq %u to %u) found with %u record reads\n",
+         (unsigned) history.size(), (unsigned) history.first(),
+         (unsigned) history.next(), (unsigned) history.scan_reads());
+  history_index.build(history);
+  history.use_index(&history_index);
+}
+
+static bool same(const HistoryStats & a, const HistoryStats & b) {
+  return a.count == b.count && a.min_systolic == b.min_systolic && a.max_systolic == b.max_systolic
+         && a.min_diastolic == b.min_diastolic && a.max_diastolic == b.max_diastolic
+         && a.min_heart_rate == b.min_heart_rate && a.max_heart_rate == b.max_heart_rate
+         && a.mean_systolic == b.mean_systolic && a.mean_diastolic == b.mean_diastolic
+         && a.mean_heart_rate == b.mean_heart_rate && a.day == b.day;
+}
+
+static HistoryStats scan(uint32_t from, uint32_t to, bool by_day) {
+  // Works out what range_stats (or, by_day, day_stats for the day from)
+  // should return from the records themselves
+
+  HistoryStats s = {0, 255, 0, 255, 0, 255, 0, 0, 0, 0, 0};
+  uint32_t sums[3] = {0, 0, 0};
+  uint32_t t = 0;
+  uint32_t seq;
+  for (seq = history.first(); seq < history.next(); seq++) {
+    HistoryRecord r;
+    if (!history.read(seq, r)) {
+      continue;
+    }
+    if ((r.flags & HISTORY_CLOCK_SET) && r.time > t) {
+      t = r.time;
+    }
+    // The index's non-decreasing time
+    bool in = by_day ? t / SECONDS_PER_DAY == from : t >= from && t < to;
+    if (!in || (r.flags & (HISTORY_CLOCK_SET | HISTORY_TIMED_OUT)) != HISTORY_CLOCK_SET) {
+      continue;
+    }
+    s.count++;
+    s.min_systolic = r.systolic < s.min_systolic ? (uint8_t) r.systolic : s.min_systolic;
+    s.max_systolic = r.systolic > s.max_systolic ? (uint8_t) r.systolic : s.max_systolic;
+    s.min_diastolic = r.diastolic < s.min_diastolic ? (uint8_t) r.diastolic : s.min_diastolic;
+    s.max_diastolic = r.diastolic > s.max_diastolic ? (uint8_t) r.diastolic : s.max_diastolic;
+    s.min_heart_rate = r.heart_rate < s.min_heart_rate ? r.heart_rate : s.min_heart_rate;
+    s.max_heart_rate = r.heart_rate > s.max_heart_rate ? r.heart_rate : s.max_heart_rate;
+    sums[0] += r.systolic;
+    sums[1] += r.diastolic;
+    sums[2] += r.heart_rate;
+  }
+  if (s.count == 0) {
+    s.min_systolic = s.min_diastolic = s.min_heart_rate = 0;
+  } else if (by_day) {
+    s.mean_systolic = (uint8_t) ((sums[0] + s.count / 2) / s.count);
+    s.mean_diastolic = (uint8_t) ((sums[1] + s.count / 2) / s.count);
+    s.mean_heart_rate = (uint8_t) ((sums[2] + s.count / 2) / s.count);
+    s.day = from;
+  }
+  return s;
+}
+
+static void check_index() {
+  check(history_index.size() == history.size(), "the index holds every record");
+  HistoryEntry newest[5];
+  uint32_t n = history_index.last(newest, 5);
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    HistoryRecord r;
+    check(newest[i].seq == history.next() - 1 - i && history.read(newest[i].seq, r)
+          && newest[i].systolic == r.systolic && newest[i].heart_rate == r.heart_rate,
+          "last returns the newest records, newest first");
+  }
+
+  HistoryStats days[HISTORY_INDEX_DAYS];
+  uint32_t d = history_index.recent_days(days, HISTORY_INDEX_DAYS);
+  for (i = 0; i < d; i++) {
+    HistoryStats s;
+    check(history_index.day_stats(days[i].day, s) && same(s, days[i]), "day_stats finds every day");
+    check(same(s, scan(days[i].day, 0, true)), "the per-day stats match the records");
+    check(i == 0 || days[i].day < days[i - 1].day, "recent_days lists the days newest first");
+  }
+  HistoryStats none;
+  check(!history_index.day_stats(1, none), "a day without measurements isn't found");
+
+  uint32_t from = 1700000000U;
+  HistoryRecord first;
+  if (history.read(history.first(), first)) {
+    from = first.time;
+  }
+  uint32_t span;
+  for (span = 3600; span < 40 * SECONDS_PER_DAY; span = span * 3 + 1234) {
+    uint32_t t;
+    for (t = from; t < from + 30 * SECONDS_PER_DAY; t += span / 2 + 777) {
+      check(same(history_index.range_stats(t, t + span), scan(t, t + span, false)),
+            "range_stats matches the records");
+    }
+  }
+  printf("index: %u records, %u days checked\n", (unsigned) history_index.size(), (unsigned) d);
+}
+
+static void append(uint32_t n) {
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    HistoryRecord r = make(history.next());
+    uint64_t start = platform_now_us();
+    check(history.append(r), "append succeeds");
+    check(platform_now_us() - start == 4 * EEPROM_PAGE_WRITE_US, "an append is four page writes");
+  }
+}
+
+static uint32_t verify() {
+  // Returns the records that read back wrong or not at all
+
+  uint32_t bad = 0;
+  uint32_t seq;
+  for (seq = history.first(); seq < history.next(); seq++) {
+    HistoryRecord r;
+    HistoryRecord want = make(seq);
+    if (!history.read(seq, r) || r.time != want.time || r.systolic != want.systolic
+        || r.diastolic != want.diastolic || r.heart_rate != want.heart_rate) {
+      bad++;
+    }
+  }
+  return bad;
+}
+
+static void check_merging() {
+  // A and B wait for the same page with a gap between them, then C
+  // touches both: C must end up after B, or B's stale byte wins
+
+  EepromWriter writer(eeprom_host_bus());
+  writer.begin(eeprom_address());
+  uint16_t page = EEPROM_BYTES - EEPROM_PAGE_BYTES;
+  uint8_t busy[EEPROM_PAGE_BYTES] = {0};
+  writer.write((uint16_t) (page - EEPROM_PAGE_BYTES), busy, sizeof(busy), NULL, NULL);
+  // Starts at once, so the writes after it wait
+  const uint8_t a[] = {0xA0};
+  const uint8_t b[] = {0xB2, 0xB3};
+  const uint8_t c[] = {0xC1, 0xC2};
+  writer.write(page, a, sizeof(a), NULL, NULL);
+  writer.write((uint16_t) (page + 2), b, sizeof(b), NULL, NULL);
+  writer.write((uint16_t) (page + 1), c, sizeof(c), NULL, NULL);
+  while (!writer.idle()) {
+    platform_wait_for_event();
+  }
+  uint8_t back[EEPROM_PAGE_BYTES];
+  eeprom_read(page, back, sizeof(back));
+  const uint8_t want[EEPROM_PAGE_BYTES] = {0xA0, 0xC1, 0xC2, 0xB3};
+  check(memcmp(back, want, sizeof(want)) == 0,
+        "a write merged into a waiting one isn't overwritten by an older one");
+  check(writer.merged() == 1, "the write is merged into the newest waiting one");
+}
+
+int main(int argc, char ** argv) {
+  const char * path = argc > 1 ? argv[1] : "history_check.eeprom";
+  if (!eeprom_use_file(path)) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return 1;
+  }
+  eeprom_host_erase();
+  host_clock_reset();
+
+  reboot();
+  check(history.size() == 0, "an erased EEPROM holds no records");
+
+  append(100);
+  reboot();
+  check(history.first() == 0 && history.next() == 100, "100 records survive a reboot");
+  check(verify() == 0, "they read back intact");
+
+  check_index();
+  append(1000);
+  check_index();
+  // Kept up to date by the appends
+  uint32_t p;
+  uint32_t least = 0xFFFFFFFFU;
+  uint32_t most = 0;
+  for (p = 0; p < EEPROM_BYTES / EEPROM_PAGE_BYTES; p++) {
+    uint32_t w = eeprom_host_page_writes(p);
+    least = w < least ? w : least;
+    most = w > most ? w : most;
+  }
+  printf("wear over 1000 appends: every page written %u to %u times\n",
+         (unsigned) least, (unsigned) most);
+  check(most - least <= 1, "every page wears at the same rate");
+  reboot();
+  check(history.size() == HISTORY_SLOTS && history.next() == 1100,
+        "a wrapped log keeps the newest HISTORY_SLOTS records");
+  check(verify() == 0, "they read back intact");
+  check_index();
+
+  eeprom_host_fail_after(2);
+  HistoryRecord torn = make(history.next());
+  history.append(torn);
+  // Power goes after half the record
+  reboot();
+  check(history.next() == 1100, "a cut-off record is not found");
+  check(verify() == 1, "only the oldest record, which it overwrote, is lost");
+  append(1);
+  reboot();
+  check(history.next() == 1101 && verify() == 0, "the next append goes where the cut-off one was");
+
+  append(HISTORY_SLOTS - history.next() % HISTORY_SLOTS);
+  check(history.next() % HISTORY_SLOTS == 0, "the next append goes to slot 0");
+  eeprom_host_fail_after(1);
+  torn = make(history.next());
+  history.append(torn);
+  reboot();
+  check(history.next() % HISTORY_SLOTS == 0, "a cut-off write to slot 0 is found from the last slot");
+  check(verify() == 1, "only the record in slot 0 is lost");
+  append(3);
+  reboot();
+  check(verify() == 0, "the log carries on");
+  check_index();
+
+  check_merging();
+
+  printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+  return failures ? 1 : 0;
+}
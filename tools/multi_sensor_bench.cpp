@@ -0,0 +1,138 @@
+// Replays one recorded session on several simulated sensors at once through
+// SensorArray and reports the aggregate sample rate, with every sensor on a
+// bus of its own or all of them sharing one bus through SharedBus
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/multi_sensor_bench.cpp $(ls *.cpp | grep -v main.cpp) -o multi_sensor_bench
+// Usage:
+//   ./multi_sensor_bench [--shared] session.trace [sensors] [rate_hz]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sensor.h"
+#include "sensor_array.h"
+
+// Routes each transfer to the emulated sensor that answers on its address,
+// like several devices on one physical bus
+// It doesn't arbitrate: overlapping transfers are what SharedBus prevents
+class BusMux : public PressureBus {
+public:
+  BusMux() : n(0) {}
+  void attach(TraceReplayBus * bus, uint8_t addr_7bit) {
+    buses[n] = bus;
+    addrs[n] = addr_7bit;
+    n++;
+  }
+  int write(uint8_t addr, const uint8_t * data, int len) override {
+    PressureBus * b = route(addr);
+    return b ? b->write(addr, data, len) : -1;
+  }
+  int read(uint8_t addr, uint8_t * data, int len) override {
+    PressureBus * b = route(addr);
+    return b ? b->read(addr, data, len) : -1;
+  }
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override {
+    PressureBus * b = route(addr);
+    return b ? b->transfer(addr, tx, tx_len, rx, rx_len, cb, ctx) : -1;
+  }
+
+private:
+  PressureBus * route(uint8_t addr) {
+    int i;
+    for (i = 0; i < n; i++) {
+      if (addrs[i] == (addr >> 1U)) {
+        return buses[i];
+      }
+    }
+    return NULL;
+  }
+
+  TraceReplayBus * buses[MAX_SENSORS];
+  uint8_t addrs[MAX_SENSORS];
+  int n;
+};
+
+int main(int argc, char ** argv) {
+  int arg = 1;
+  bool shared = false;
+  if (argc > 1 && strcmp(argv[1], "--shared") == 0) {
+    shared = true;
+    arg++;
+  }
+  if (arg >= argc) {
+    fprintf(stderr, "usage: %s [--shared] session.trace [sensors] [rate_hz]\n", argv[0]);
+    return 2;
+  }
+  const char * path = argv[arg];
+  int n = arg + 1 < argc ? atoi(argv[arg + 1]) : MAX_SENSORS;
+  uint32_t rate_hz = arg + 2 < argc ? (uint32_t) strtoul(argv[arg + 2], NULL, 10) : 150;
+  if (n < 1 || n > MAX_SENSORS) {
+    fprintf(stderr, "sensors must be 1 to %d\n", MAX_SENSORS);
+    return 2;
+  }
+
+  TraceReplayBus * buses[MAX_SENSORS];
+  PressureSensor * sensors[MAX_SENSORS];
+  BusMux mux;
+  SharedBus shared_bus(&mux);
+  SensorArray array;
+  int i;
+  for (i = 0; i < n; i++) {
+    uint8_t addr = (uint8_t) (CuffSensor::address + i);
+    // Parts are available with different addresses, so several can share
+    // one bus
+    buses[i] = new TraceReplayBus(addr);
+    if (!buses[i]->load(path)) {
+      fprintf(stderr, "%s: cannot load trace\n", path);
+      return 1;
+    }
+    mux.attach(buses[i], addr);
+    sensors[i] = new PressureSensor(addr);
+    sensors[i]->begin(shared ? (PressureBus *) &shared_bus : (PressureBus *) buses[i]);
+    array.add(sensors[i]);
+  }
+
+  host_clock_reset();
+  if (!array.start(rate_hz)) {
+    fprintf(stderr, "rate must be %d to %d Hz\n", MIN_SAMPLE_RATE_HZ, MAX_SAMPLE_RATE_HZ);
+    return 2;
+  }
+
+  uint32_t read_back[MAX_SENSORS] = {0};
+  uint32_t out_of_order = 0;
+  uint32_t last_us[MAX_SENSORS] = {0};
+  while (!buses[0]->finished()) {
+    platform_wait_for_event();
+    for (i = 0; i < n; i++) {
+      PressureSample s;
+      while (array.read(i, s)) {
+        if (read_back[i] > 0 && s.time_us <= last_us[i]) {
+          out_of_order++;
+        }
+        last_us[i] = s.time_us;
+        read_back[i]++;
+      }
+    }
+  }
+  array.stop();
+
+  double sim_s = platform_now_us() / 1e6;
+  printf("%d sensor(s) on %s at %u Hz for %.1f s\n", n, shared ? "one shared bus" : "separate buses",
+         (unsigned) rate_hz, sim_s);
+  for (i = 0; i < n; i++) {
+    BusCost cost = sensors[i]->cost();
+    printf("  channel %d: %u readings, %u missed ticks, %u overflows, %u bus errors, %.0f us waiting per sample\n",
+           i, (unsigned) read_back[i], (unsigned) array.missed_ticks(i), (unsigned) array.overflows(i),
+           (unsigned) sensors[i]->errors, cost.samples ? (double) cost.wait_us / cost.samples : 0.0);
+  }
+  printf("aggregate %.1f samples/s", array.samples() / sim_s);
+  if (shared) {
+    printf(", %u transfers waited for the bus", (unsigned) shared_bus.waits());
+  }
+  printf(", %u out of order\n", (unsigned) out_of_order);
+  return out_of_order ? 1 : 0;
+}
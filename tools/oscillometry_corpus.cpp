@@ -0,0 +1,223 @@
+// Validates the oscillometric engine against a corpus of synthetic cuff
+// deflations whose blood pressure and heart rate are known, and compares
+// it with the rules the firmware used before (DeflationAnalyzer)
+// Each session deflates the cuff from 160 mmHg at 2 to 5 mmHg/s with a
+// pulse of 1 to 3 mmHg on top. The size of the pulse follows an envelope
+// that peaks at the mean arterial pressure and falls to the
+// characteristic ratios at the systolic and diastolic pressures, and the
+// session adds beat-to-beat variation of the heart rate, breathing, sensor
+// noise and the Q24.8 rounding. Each is also run with a squeezed start:
+// the deflation starts at 150 mmHg and the bulb is squeezed a few more
+// times, up to 160 to 170 mmHg, before the pressure is left to fall. The
+// same sessions are run at several sample rates. Prints the mean and
+// worst error of each engine, the share of sessions within 5 mmHg, and
+// the time per sample on this computer
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/oscillometry_corpus.cpp $(ls *.cpp | grep -v main.cpp) -o oscillometry_corpus
+// Usage:
+//   ./oscillometry_corpus [sessions] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "pressure.h"
+#include "analysis.h"
+#include "oscillometry.h"
+#include "bench.h"
+
+struct Truth {
+  double systolic;
+  double diastolic;
+  double mean_arterial;
+  double heart_rate;
+};
+
+struct Sample {
+  uint32_t time_us;
+  pressure_t p;
+};
+
+static double pulse(double phase) {
+  // One beat of the pulse, from 0 to 1 and back, over phase 0 to 1: a
+  // quick rise, then a slower fall
+
+  const double rise = 0.15;
+  const double tau = 0.3;
+  if (phase < rise) {
+    return 0.5 - 0.5 * cos(M_PI * phase / rise);
+  }
+  double end = exp(-(1 - rise) / tau);
+  return (exp(-(phase - rise) / tau) - end) / (1 - end);
+}
+
+static Truth make_session(uint32_t rate_hz, std::vector<Sample> & out, uint64_t seed,
+                          bool squeezed) {
+  seed_random(seed);
+  Truth t;
+  t.systolic = 100 + 45 * uniform();
+  t.diastolic = 55 + 35 * uniform();
+  if (t.diastolic > t.systolic - 25) {
+    t.diastolic = t.systolic - 25;
+  }
+  t.mean_arterial = t.diastolic + (t.systolic - t.diastolic) / 3;
+  t.heart_rate = 50 + 60 * uniform();
+  double amplitude = 1 + 2 * uniform();
+  double deflate = 2 + 3 * uniform();
+  double noise = 0.03 + 0.1 * uniform();
+  double breathing = 0.3 * uniform();
+  double sigma_s = (t.systolic - t.mean_arterial) / sqrt(-2 * log(SYSTOLIC_RATIO / 256.0));
+  double sigma_d = (t.mean_arterial - t.diastolic) / sqrt(-2 * log(DIASTOLIC_RATIO / 256.0));
+  // Gaussian sides that reach the characteristic ratios at the systolic
+  // and diastolic pressures
+
+  out.clear();
+  double beat_start = 0.2 * uniform();
+  double interval = 60 / t.heart_rate;
+  double beat_amp = 0;
+  double time = 0;
+  double cuff = 160;
+  double released = 0;
+  // When the squeezing stopped
+  double next_squeeze = 0;
+  double squeeze = 0;
+  double squeeze_end = 0;
+  // The rise of the last squeeze, in mmHg/s, and when it stops
+  double top = 160;
+  if (squeezed) {
+    cuff = 150;
+    top = 160 + 10 * uniform();
+    released = -1;
+  }
+  while (cuff > 30) {
+    if (time >= beat_start + interval) {
+      beat_start += interval;
+      interval = 60 / t.heart_rate * (1 + 0.03 * gaussian());
+    }
+    double d = cuff - t.mean_arterial;
+    double sigma = d > 0 ? sigma_s : sigma_d;
+    if (time >= beat_start && time - beat_start < 1.0 / rate_hz) {
+      beat_amp = amplitude * exp(-d * d / (2 * sigma * sigma));
+      // The size of this beat, set by the cuff pressure as it starts
+    }
+    double p = cuff + beat_amp * pulse((time - beat_start) / interval)
+               + breathing * sin(2 * M_PI * 0.25 * time) + noise * gaussian();
+    Sample s = {(uint32_t) (time * 1e6), (pressure_t) lround(p * 256)};
+    out.push_back(s);
+    time += 1.0 / rate_hz;
+    if (released < 0) {
+      if (time >= next_squeeze) {
+        squeeze = (3 + 4 * uniform()) / 0.25;
+        squeeze_end = time + 0.25;
+        next_squeeze = time + 0.6 + 0.6 * uniform();
+        // A squeeze of 3 to 7 mmHg over a quarter of a second
+      }
+      cuff += ((time < squeeze_end ? squeeze : 0) - deflate) / rate_hz;
+      if (cuff >= top) {
+        top = cuff;
+        released = time;
+        // The valve is left to let the air out from here
+      }
+    } else {
+      cuff = top - deflate * (time - released);
+    }
+  }
+  return t;
+}
+
+struct Errors {
+  double sum[3];
+  double worst[3];
+  int within[3];
+  int failed;
+};
+
+static void add(Errors & e, int i, double err) {
+  err = fabs(err);
+  e.sum[i] += err;
+  e.worst[i] = err > e.worst[i] ? err : e.worst[i];
+  e.within[i] += err <= 5;
+}
+
+static void print(const char * name, const Errors & e, int n, double ns) {
+  printf("  %-14s sys %5.1f/%5.1f %3d%%  dia %5.1f/%5.1f %3d%%  hr %5.1f/%5.1f %3d%%  "
+         "no result %d  %6.1f ns/sample\n", name,
+         e.sum[0] / n, e.worst[0], e.within[0] * 100 / n,
+         e.sum[1] / n, e.worst[1], e.within[1] * 100 / n,
+         e.sum[2] / n, e.worst[2], e.within[2] * 100 / n, e.failed, ns);
+}
+
+int main(int argc, char ** argv) {
+  int sessions = argc > 1 ? atoi(argv[1]) : 200;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+  if (sessions < 1) {
+    fprintf(stderr, "usage: %s [sessions] [seed]\n", argv[0]);
+    return 2;
+  }
+
+  static const uint32_t rates[] = {25, 100, 200};
+  static const char * const starts[] = {"clean start", "squeezed start"};
+  std::vector<Sample> samples;
+  static OscillometricAnalyzer envelope;
+  DeflationAnalyzer legacy;
+  bool ok = true;
+  printf("%d sessions; mean/worst error in mmHg (bpm) and the share within 5\n", sessions);
+  int r;
+  for (r = 0; r < 3; r++) {
+    int squeezed;
+    for (squeezed = 0; squeezed < 2; squeezed++) {
+      Errors osc = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, 0};
+      Errors old = osc;
+      double osc_s = 0;
+      double old_s = 0;
+      uint64_t total = 0;
+      int i;
+      envelope.set_sample_rate(rates[r]);
+      for (i = 0; i < sessions; i++) {
+        Truth t = make_session(rates[r], samples, seed + i, squeezed);
+        total += samples.size();
+
+        auto start = std::chrono::steady_clock::now();
+        envelope.reset();
+        for (const Sample & s : samples) {
+          envelope.update(s.time_us, s.p);
+        }
+        OscillometryResult res = envelope.result();
+        osc_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (res.flags & OSC_TOO_FEW_BEATS) {
+          osc.failed++;
+        } else {
+          add(osc, 0, res.systolic / 256.0 - t.systolic);
+          add(osc, 1, res.diastolic / 256.0 - t.diastolic);
+          add(osc, 2, res.heart_rate - t.heart_rate);
+        }
+
+        start = std::chrono::steady_clock::now();
+        legacy.reset();
+        for (const Sample & s : samples) {
+          legacy.update(s.time_us, s.p);
+        }
+        legacy.finish();
+        old_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (legacy.beats() < 2) {
+          old.failed++;
+        } else {
+          add(old, 0, systolic - t.systolic);
+          add(old, 1, diastolic - t.diastolic);
+          add(old, 2, heart_rate - t.heart_rate);
+        }
+      }
+      printf("%u Hz, %s:\n", (unsigned) rates[r], starts[squeezed]);
+      print("envelope", osc, sessions - osc.failed ? sessions - osc.failed : 1, osc_s * 1e9 / total);
+      print("legacy", old, sessions - old.failed ? sessions - old.failed : 1, old_s * 1e9 / total);
+      if (osc.failed > 0 || osc.sum[0] / sessions > 5 || osc.sum[1] / sessions > 5) {
+        ok = false;
+      }
+    }
+  }
+  printf(ok ? "envelope engine within 5 mmHg on average at every rate\n"
+            : "FAILED: envelope engine off by more than 5 mmHg on average\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// Compares the three ways of turning a raw reading into a pressure:
+// the original whole-mmHg integer formula, single-precision float, and the
+// Q24.8 fixed-point conversion in sensor_profile.h. Sweeps every count of the
+// sensor's output range and reports the worst error of each against a
+// double-precision reference, and the time per conversion
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/pressure_bench.cpp -o pressure_bench
+// Usage:
+//   ./pressure_bench
+
+#include <math.h>
+#include <stdio.h>
+#include "sensor_profile.h"
+#include "bench.h"
+
+static int legacy_mmhg(int output) {
+  // The conversion the firmware used before pressure.h
+  return (output - CuffSensor::output_min) * 300 / (CuffSensor::output_max - CuffSensor::output_min);
+}
+
+static float float_mmhg(uint32_t counts) {
+  return (float) ((int32_t) counts - CuffSensor::output_min) * (float) 300
+         / (float) (CuffSensor::output_max - CuffSensor::output_min);
+}
+
+static double reference_mmhg(uint32_t counts) {
+  return ((double) counts - CuffSensor::output_min) * 300 / (CuffSensor::output_max - CuffSensor::output_min);
+}
+
+template <typename F>
+static void time_path(const char * name, F convert, double max_err) {
+  uint32_t r = 0;
+  Timing t = time_loop([&]() {
+    int64_t sum = 0;
+    uint32_t c;
+    for (c = (uint32_t) CuffSensor::output_min; c <= (uint32_t) CuffSensor::output_max; c++) {
+      sum += (int64_t) convert(c + r);
+    }
+    r++;
+    return sum;
+  }, 8, CuffSensor::output_max - CuffSensor::output_min + 1);
+  printf("%-12s max error %8.4f mmHg  %6.2f ns  %6.2f TSC cycles per conversion\n",
+         name, max_err, t.ns, t.cycles);
+}
+
+int main() {
+  double err_legacy = 0, err_float = 0, err_fixed = 0;
+  uint32_t c;
+  for (c = (uint32_t) CuffSensor::output_min; c <= (uint32_t) CuffSensor::output_max; c++) {
+    double ref = reference_mmhg(c);
+    err_legacy = fmax(err_legacy, fabs(legacy_mmhg((int) c) - ref));
+    err_float = fmax(err_float, fabs(float_mmhg(c) - ref));
+    err_fixed = fmax(err_fixed, fabs(counts_to_pressure(c) / 256.0 - ref));
+  }
+
+  time_path("integer", [](uint32_t x) { return legacy_mmhg((int) x); }, err_legacy);
+  time_path("float", [](uint32_t x) { return (int) (float_mmhg(x) * 256.0f); }, err_float);
+  time_path("fixed Q24.8", [](uint32_t x) { return counts_to_pressure(x); }, err_fixed);
+  printf("fixed-point resolution is %.4f mmHg\n", 1.0 / (1 << PRESSURE_FRAC_BITS));
+  return 0;
+}
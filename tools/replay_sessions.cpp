@@ -0,0 +1,139 @@
+// Replays recorded cuff sessions through the acquisition and analysis code
+// on Linux, against the simulated clock, and prints the results of each
+// session along with how much faster than real time the replay ran
+// The results come from an OscillometricAnalyzer fed as the samples
+// arrive, as on the board, and are checked against calc_stats on the
+// capture
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/replay_sessions.cpp $(ls *.cpp | grep -v main.cpp) -o replay_sessions
+// Usage:
+//   ./replay_sessions [--eoc] [--oversample] session1.trace [session2.trace ...]
+// --eoc reads each sample on a simulated EOC edge instead of after a
+// fixed conversion time
+// --oversample samples at OVERSAMPLE_RATIO times the rate and decimates
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sensor.h"
+#include "analysis.h"
+#include "oscillometry.h"
+#include "sampler.h"
+
+static void on_eoc(void * ctx) {
+  // The simulated EOC edge
+
+  (void) ctx;
+  sensor.end_of_conversion();
+}
+
+static OscillometricAnalyzer analyzer;
+
+static int replay(TraceReplayBus & bus) {
+  // Runs one session the same way main does: wait for the cuff to be
+  // pumped up to 150 mmHg, then record the deflation until 30 mmHg
+  // Returns the number of deflation samples recorded
+
+  capture.reset();
+  read_pressure();
+  while (pressure < MMHG(150) && !bus.finished()) {
+    sleep_and_update_pressure();
+    capture.append(sample_time_us, pressure);
+  }
+  capture.start_deflation();
+  analyzer.reset();
+
+  while (pressure > MMHG(30) && !capture.full() && !bus.finished()) {
+    sleep_and_update_pressure();
+    capture.append(sample_time_us, pressure);
+    analyzer.update(sample_time_us, pressure);
+  }
+
+  calc_stats();
+  int hr = heart_rate, sys = systolic, dia = diastolic;
+  analyzer.finish();
+  if (hr != heart_rate || sys != systolic || dia != diastolic) {
+    printf("  streaming results differ: calc_stats gave hr=%d sys=%d dia=%d\n", hr, sys, dia);
+    return -1;
+  }
+  calc_inflation_stats();
+  return (int) capture.deflation_size();
+}
+
+int main(int argc, char ** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s [--eoc] [--oversample] session.trace [...]\n", argv[0]);
+    return 2;
+  }
+
+  TraceReplayBus bus(CuffSensor::address);
+  setup_sensor(&bus);
+  set_max_deflate_seconds(MAX_DEFLATE_SECONDS);
+  int first = 1;
+  bool oversample = false;
+  while (first < argc - 1 && argv[first][0] == '-') {
+    if (strcmp(argv[first], "--eoc") == 0) {
+      bus.on_eoc(&on_eoc, NULL);
+      sensor.use_eoc(true);
+    } else if (strcmp(argv[first], "--oversample") == 0) {
+      oversample = true;
+    }
+    first++;
+  }
+  uint64_t simulated_us = 0;
+  int failed = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  int i;
+  for (i = first; i < argc; i++) {
+    if (!bus.load(argv[i])) {
+      fprintf(stderr, "%s: cannot load trace\n", argv[i]);
+      failed++;
+      continue;
+    }
+
+    host_clock_reset();
+    sample_ring.clear();
+    sensor.reset_cost();
+    sensor.busy_polls = 0;
+    if (oversample) {
+      start_oversampled_acquisition(SAMPLE_RATE_HZ);
+    } else {
+      start_acquisition(SAMPLE_RATE_HZ);
+    }
+    int n = replay(bus);
+    sampler.stop();
+    if (n < 0) {
+      failed++;
+    }
+    simulated_us += platform_now_us();
+    SamplerStats st = sampler.stats();
+    BusCost cost = sensor.cost();
+    double per = cost.samples ? 1.0 / cost.samples : 0.0;
+    printf("%s samples=%d hr=%d (%d%%) sys=%d dia=%d missed=%u jitter_max=%uus ring_overflows=%u\n",
+           argv[i], n, heart_rate, heart_rate_confidence, systolic, diastolic,
+           (unsigned) st.missed_ticks, (unsigned) st.max_jitter_us,
+           (unsigned) sample_ring.overflows());
+    printf("  inflation: %.1f s, %d strokes, %.1f mmHg/s average, %.1f mmHg/s peak, "
+           "leak %.2f mmHg/s\n", inflation.duration_ms / 1e3, inflation.strokes,
+           inflation.pump_rate / 256.0, inflation.peak_pump_rate / 256.0,
+           inflation.leak_rate / 256.0);
+    printf("  per sample: %.2f transactions, %.1f bytes, %.0f us on the bus, "
+           "%.0f us waiting; busy_polls=%u eoc_timeouts=%u max_rate=%u Hz\n",
+           cost.transactions * per, cost.bytes * per, cost.bus_us * per,
+           cost.wait_us * per, (unsigned) sensor.busy_polls,
+           (unsigned) sensor.eoc_timeouts, (unsigned) max_sample_rate_hz(cost));
+  }
+
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double sim_s = simulated_us / 1e6;
+  printf("replayed %.1f s of sessions in %.3f s (%.0fx real time)\n",
+         sim_s, wall_s, wall_s > 0 ? sim_s / wall_s : 0.0);
+  printf("measurement arena: %u of %u bytes at the peak, %u failed allocations\n",
+         (unsigned) measurement_arena.high_water(), (unsigned) measurement_arena.capacity(),
+         (unsigned) measurement_arena.failures());
+  return failed ? 1 : 0;
+}
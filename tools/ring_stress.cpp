@@ -0,0 +1,86 @@
+// Stress benchmark for SpscRing: one thread pushes timestamped samples while
+// another pops them, optionally with a stall every so often to imitate a
+// slow consumer (a full-screen redraw). Checks that samples come out in
+// order and intact, and reports the throughput and the number of samples
+// dropped because the ring was full
+// With gap_ns 0 the producer waits for room instead of dropping, which
+// measures the raw throughput; otherwise it pushes one sample every gap_ns
+// like the acquisition thread does, and drops what doesn't fit
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/ring_stress.cpp -o ring_stress -lpthread
+// Usage:
+//   ./ring_stress [samples] [gap_ns] [stall_every] [stall_us]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "sample_ring.h"
+
+static SpscRing<PressureSample, 64> ring;
+// The same size the firmware uses
+static std::atomic<bool> done(false);
+
+int main(int argc, char ** argv) {
+  uint32_t total = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 10000000U;
+  uint32_t gap_ns = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 0;
+  uint32_t stall_every = argc > 3 ? (uint32_t) strtoul(argv[3], NULL, 10) : 0;
+  uint32_t stall_us = argc > 4 ? (uint32_t) strtoul(argv[4], NULL, 10) : 0;
+
+  uint32_t popped = 0;
+  uint32_t out_of_order = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread consumer([&]() {
+    uint32_t expected = 0;
+    PressureSample s;
+    while (true) {
+      if (!ring.pop(s)) {
+        if (done.load(std::memory_order_acquire) && ring.size() == 0) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      if (s.time_us < expected || s.counts != (s.time_us & 0xFFFFFFU)) {
+        out_of_order++;
+        // Samples must come out in order and intact; gaps are the drops
+      }
+      expected = s.time_us + 1;
+      popped++;
+      if (stall_every && popped % stall_every == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(stall_us));
+      }
+    }
+  });
+
+  uint32_t i;
+  auto next = std::chrono::steady_clock::now();
+  for (i = 0; i < total; i++) {
+    PressureSample s;
+    s.time_us = i;
+    s.counts = i & 0xFFFFFFU;
+    s.status = 0x40;
+    if (gap_ns == 0) {
+      while (ring.size() == 64) {
+        std::this_thread::yield();
+        // Wait for room
+      }
+    } else {
+      next += std::chrono::nanoseconds(gap_ns);
+      while (std::chrono::steady_clock::now() < next) {
+        // Pace the producer
+      }
+    }
+    ring.push(s);
+  }
+  done.store(true, std::memory_order_release);
+  consumer.join();
+
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("pushed %u popped %u dropped %u corrupted %u in %.3f s (%.1f M samples/s)\n",
+         total, popped, ring.overflows(), out_of_order, s, popped / s / 1e6);
+  return (popped + ring.overflows() == total && out_of_order == 0) ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+// Exercises the SDRAM region allocator and the session recorder against the
+// memory-backed SDRAM stand-in: allocation, coalescing and exhaustion of
+// the free list, then a long session streamed through the recorder at the
+// highest sample rate, compressed, and read back sample by sample
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/sdram_session_check.cpp $(ls *.cpp | grep -v main.cpp) -o sdram_session_check
+// Usage:
+//   ./sdram_session_check [minutes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+#include "sdram.h"
+#include "sampler.h"
+#include "session_recorder.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char * what) {
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+static void check_allocator() {
+  sdram_init();
+  uint32_t total = sdram_free_bytes();
+  check(total == SDRAM_BYTES - 2 * (LCD_LAYER_BYTES + LCD_GUARD_BYTES),
+        "everything but the two LCD layers and their guards is free");
+
+  SdramRegion a = sdram_alloc(100000);
+  SdramRegion b = sdram_alloc(1);
+  SdramRegion c = sdram_alloc(1000000);
+  check(a.size >= 100000 && b.size == SDRAM_ALIGN && c.size >= 1000000, "allocations succeed");
+  check(a.addr % SDRAM_ALIGN == 0 && b.addr % SDRAM_ALIGN == 0, "regions are aligned");
+  check(b.addr >= a.addr + a.size || b.addr + b.size <= a.addr, "regions don't overlap");
+  check(c.addr >= SDRAM_ADDR + LCD_LAYER0_OFFSET + LCD_LAYER_BYTES + LCD_GUARD_BYTES,
+        "a region too large for the first gap goes after layer 0");
+
+  sdram_free(b);
+  sdram_free(a);
+  SdramRegion d = sdram_alloc(100000 + SDRAM_ALIGN);
+  check(d.addr == a.addr, "freed neighbours merge");
+  sdram_free(d);
+  sdram_free(c);
+  check(sdram_free_bytes() == total, "freeing everything restores the free space");
+
+  SdramRegion e = sdram_alloc(SDRAM_BYTES);
+  check(e.size == 0, "a request larger than any gap fails");
+  SdramRegion f = sdram_alloc(sdram_largest_free());
+  check(f.size != 0 && sdram_largest_free() < f.size, "the largest gap can be taken whole");
+  sdram_free(f);
+  check(sdram_free_bytes() == total, "the largest gap comes back");
+}
+
+static uint32_t counts_at(uint32_t i) {
+  return (419430U + i * 7U) & 0xFFFFFFU;
+}
+
+static void check_recorder(uint32_t minutes) {
+  host_clock_reset();
+  uint32_t n = minutes * 60 * MAX_SAMPLE_RATE_HZ;
+  uint32_t period_us = 1000000 / MAX_SAMPLE_RATE_HZ;
+  check(recorder.begin(SESSION_MAX_MINUTES * 60 * MAX_SAMPLE_RATE_HZ), "the session region fits");
+
+  recorder.start();
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    recorder.record(i * period_us, counts_at(i), 0x40, i < n / 4 ? PHASE_INFLATE : PHASE_DEFLATE);
+    host_clock_advance_us(period_us);
+  }
+  recorder.finish();
+  check(recorder.size() == n && recorder.dropped() == 0, "every sample reaches the SDRAM");
+
+  uint32_t bad = 0;
+  SessionReader reader(recorder);
+  RecordedSample s;
+  for (i = 0; reader.next(s); i++) {
+    if (s.time_us != i * period_us || s.counts != counts_at(i)
+        || s.status != 0x40 || s.phase != (i < n / 4 ? PHASE_INFLATE : PHASE_DEFLATE)) {
+      bad++;
+    }
+  }
+  check(bad == 0 && i == n, "every sample reads back intact and in order");
+  printf("recorded %u samples (%u min at %d Hz) in %u bytes of SDRAM, %.2f bytes per sample\n",
+         (unsigned) recorder.size(), (unsigned) minutes, MAX_SAMPLE_RATE_HZ,
+         (unsigned) recorder.bytes(), (double) recorder.bytes() / recorder.size());
+
+  recorder.start();
+  for (i = 0; i < 3 * RECORDER_CHUNK; i++) {
+    recorder.record(i, counts_at(i), 0x40, PHASE_DEFLATE);
+    // The clock stands still, so the DMA never completes
+  }
+  check(recorder.dropped() == RECORDER_CHUNK, "samples are dropped, not overwritten, when the DMA falls behind");
+  recorder.finish();
+  check(recorder.size() == 2 * RECORDER_CHUNK, "the staged chunks are written on finish");
+
+  recorder.begin(10);
+  recorder.start();
+  for (i = 0; i < 1000; i++) {
+    recorder.record(i * period_us, counts_at(i), 0x40, PHASE_DEFLATE);
+    host_clock_advance_us(period_us);
+  }
+  recorder.finish();
+  check(recorder.size() >= 10 && recorder.dropped() > 0 && recorder.size() + recorder.dropped() == 1000,
+        "a full session keeps at least what it promised and counts the rest");
+  check(recorder.bytes() <= recorder.memory().size, "a full session stays inside its region");
+}
+
+int main(int argc, char ** argv) {
+  uint32_t minutes = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 10;
+  check_allocator();
+  check_recorder(minutes);
+  printf("%s\n", failures ? "some checks failed" : "all checks passed");
+  return failures ? 1 : 0;
+}
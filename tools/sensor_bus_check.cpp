@@ -0,0 +1,244 @@
+// Checks how PressureSensor uses the bus, without a trace file: a mock
+// PressureBus plays the sensor on the simulated clock, answers the status
+// byte with the busy flag set until the conversion is done, and logs
+// every transfer the sensor starts and when
+// For each way of reading the sensor it takes a run of samples and checks
+// the transfers per sample (the command, then 2 reads with the status
+// byte first and 1 read in combined mode), that nothing is started on the
+// bus while a conversion is pending, and that every reading arrives. A
+// sensor slower than CONVERSION_TIME_US may be asked again, but not in a
+// loop: no sooner than BUSY_WAIT_US after the last time
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/sensor_bus_check.cpp $(ls *.cpp | grep -v main.cpp) -o sensor_bus_check
+// Usage:
+//   ./sensor_bus_check
+
+#include <stdio.h>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sensor.h"
+
+#define MOCK_ADDRESS 0x18
+#define MOCK_BYTE_US 25
+// About a byte and its acknowledge at 400 kHz
+#define SAMPLES 200
+#define BUSY_WAIT_US 250
+// Asking a busy sensor again sooner than this is polling it in a loop:
+// the 5-byte combined read alone would keep the bus busy half the time
+
+// The sensor, as far as the bus can tell
+// A transfer's data moves when it is started and the callback comes
+// once its bytes would have crossed the bus. The Output Measurement
+// Command starts a conversion that ends conversion_us after the command
+// is through; every transfer started before that is counted as early
+class MockBus : public PressureBus {
+public:
+  explicit MockBus(uint32_t conversion_us)
+      : writes(0), reads(0), early(0), overlapping(0), min_gap_us(0xFFFFFFFFU),
+        conversion_us(conversion_us), converting(false), done_us(0), last_early_us(0),
+        command(false), counts(0), cb(NULL), ctx(NULL), result(0), eoc_cb(NULL),
+        eoc_ctx(NULL) {}
+
+  int write(uint8_t addr, const uint8_t * data, int len) override {
+    (void) addr;
+    (void) data;
+    (void) len;
+    return -1;
+    // PressureSensor only uses transfer
+  }
+  int read(uint8_t addr, uint8_t * data, int len) override {
+    (void) addr;
+    (void) data;
+    (void) len;
+    return -1;
+  }
+  int transfer(uint8_t addr, const uint8_t * tx, int tx_len,
+               uint8_t * rx, int rx_len, bus_callback_t cb, void * ctx) override {
+    uint64_t now = platform_now_us();
+    if (this->cb != NULL) {
+      overlapping++;
+      return -1;
+    }
+    if (converting && now < done_us) {
+      if (early > 0 && now - last_early_us < min_gap_us) {
+        min_gap_us = (uint32_t) (now - last_early_us);
+      }
+      early++;
+      last_early_us = now;
+    }
+
+    int result = (addr >> 1U) == MOCK_ADDRESS ? 0 : -1;
+    if (tx_len > 0) {
+      writes++;
+      command = result == 0 && tx_len == 3 && tx[0] == 0xAA;
+    } else {
+      reads++;
+      command = false;
+      bool busy = converting && now < done_us;
+      if (result == 0 && rx_len > 0) {
+        rx[0] = busy ? 0x60 : 0x40;
+        // Powered, and bit 5 while the conversion is running
+        int i;
+        for (i = 1; i < rx_len; i++) {
+          rx[i] = (uint8_t) (counts >> (8 * (3 - i)));
+        }
+      }
+    }
+    this->cb = cb;
+    this->ctx = ctx;
+    this->result = result;
+    timer.attach_once_us(&MockBus::on_done, this, (1 + tx_len + rx_len) * MOCK_BYTE_US);
+    return 0;
+  }
+  void on_eoc(platform_callback_t cb, void * ctx) {
+    eoc_cb = cb;
+    eoc_ctx = ctx;
+  }
+  uint32_t expected() const { return counts; }
+  // The reading the last conversion gave
+
+  uint32_t writes;
+  uint32_t reads;
+  uint32_t early;
+  // Transfers started while a conversion was pending
+  uint32_t overlapping;
+  // Transfers started while another was in flight
+  uint32_t min_gap_us;
+  // The shortest time between two early transfers
+
+private:
+  static void on_done(void * ctx) {
+    MockBus * bus = (MockBus *) ctx;
+    if (bus->command) {
+      bus->converting = true;
+      bus->done_us = platform_now_us() + bus->conversion_us;
+      bus->counts = 0x200000U + bus->writes * 37;
+      bus->eoc_timer.attach_once_us(&MockBus::on_conversion_done, bus, bus->conversion_us);
+    }
+    bus_callback_t cb = bus->cb;
+    bus->cb = NULL;
+    // Cleared first so the callback can start the next transfer
+    cb(bus->ctx, bus->result);
+  }
+  static void on_conversion_done(void * ctx) {
+    MockBus * bus = (MockBus *) ctx;
+    if (bus->eoc_cb != NULL) {
+      bus->eoc_cb(bus->eoc_ctx);
+    }
+  }
+
+  uint32_t conversion_us;
+  bool converting;
+  uint64_t done_us;
+  uint64_t last_early_us;
+  bool command;
+  // The transfer in flight is the Output Measurement Command
+  uint32_t counts;
+  PlatformTimer timer;
+  bus_callback_t cb;
+  void * ctx;
+  int result;
+  PlatformTimer eoc_timer;
+  platform_callback_t eoc_cb;
+  void * eoc_ctx;
+};
+
+static void eoc(void * ctx) {
+  ((PressureSensor *) ctx)->end_of_conversion();
+}
+
+static bool run(const char * name, AcquisitionMode mode, bool use_eoc, uint32_t conversion_us,
+                uint32_t reads_per_sample) {
+  // Takes SAMPLES samples and checks the bus traffic; reads_per_sample
+  // leaves out the status reads that find a slow sensor busy
+
+  host_clock_reset();
+  MockBus bus(conversion_us);
+  PressureSensor s(MOCK_ADDRESS);
+  s.begin(&bus);
+  s.set_mode(mode);
+  s.use_eoc(use_eoc);
+  if (use_eoc) {
+    bus.on_eoc(eoc, &s);
+  }
+
+  bool ok = true;
+  int i;
+  for (i = 0; i < SAMPLES; i++) {
+    uint32_t before = s.completed;
+    if (!s.request()) {
+      printf("FAILED: %s: the sensor was still busy before sample %d\n", name, i);
+      return false;
+    }
+    while (s.busy()) {
+      platform_wait_for_event();
+      // Jumps the simulated clock to the next bus or timer interrupt
+    }
+    if (s.completed != before + 1 || s.failed || s.reading != bus.expected()) {
+      printf("FAILED: %s: sample %d didn't read the conversion\n", name, i);
+      ok = false;
+      break;
+    }
+    host_clock_advance_us(40000);
+    // The next sample period
+  }
+
+  double writes = (double) bus.writes / SAMPLES;
+  double reads = (double) (bus.reads - s.busy_polls) / SAMPLES;
+  double polls = (double) s.busy_polls / SAMPLES;
+  char gap[12] = "-";
+  if (bus.early > 1) {
+    snprintf(gap, sizeof(gap), "%u", (unsigned) bus.min_gap_us);
+  }
+  printf("%-28s %6.2f %6.2f %6.2f %6u %6u %8s\n", name, writes, reads, polls,
+         (unsigned) bus.early, (unsigned) bus.overlapping, gap);
+  if (bus.writes != SAMPLES || bus.reads - s.busy_polls != SAMPLES * reads_per_sample) {
+    printf("FAILED: %s: expected 1 command and %u reads per sample\n", name,
+           (unsigned) reads_per_sample);
+    ok = false;
+  }
+  if (bus.overlapping > 0) {
+    printf("FAILED: %s: a transfer was started while another was in flight\n", name);
+    ok = false;
+  }
+  if (conversion_us <= CONVERSION_TIME_US && (bus.early > 0 || s.busy_polls > 0)) {
+    printf("FAILED: %s: the bus was used while the conversion was pending\n", name);
+    ok = false;
+  }
+  if (bus.early != s.busy_polls) {
+    printf("FAILED: %s: a transfer other than a status read went out during a conversion\n",
+           name);
+    ok = false;
+  }
+  if (s.busy_polls > 0 && bus.min_gap_us < BUSY_WAIT_US) {
+    printf("FAILED: %s: a busy sensor was asked again after %u us\n", name,
+           (unsigned) bus.min_gap_us);
+    ok = false;
+  }
+  uint32_t late_us = conversion_us > CONVERSION_TIME_US ? conversion_us - CONVERSION_TIME_US : 0;
+  if (s.busy_polls > SAMPLES * (late_us / BUSY_WAIT_US + 1)) {
+    printf("FAILED: %s: a busy sensor was asked more than once every %d us\n", name,
+           BUSY_WAIT_US);
+    ok = false;
+  }
+  return ok;
+}
+
+int main() {
+  printf("%d samples each: commands, reads and busy status reads per sample, then the\n"
+         "transfers started during a conversion or another transfer, and the shortest time\n"
+         "between two started during a conversion\n", SAMPLES);
+  printf("%-28s %6s %6s %6s %6s %6s %8s\n", "", "cmds", "reads", "busy", "early", "overlap",
+         "gap us");
+  bool ok = true;
+  ok &= run("status then data", ACQ_STATUS_THEN_DATA, false, CONVERSION_TIME_US, 2);
+  ok &= run("combined", ACQ_COMBINED, false, CONVERSION_TIME_US, 1);
+  ok &= run("combined, EOC", ACQ_COMBINED, true, CONVERSION_TIME_US, 1);
+  ok &= run("status then data, EOC", ACQ_STATUS_THEN_DATA, true, CONVERSION_TIME_US, 2);
+  ok &= run("status then data, fast", ACQ_STATUS_THEN_DATA, false, CONVERSION_TIME_US / 2, 2);
+  ok &= run("status then data, slow", ACQ_STATUS_THEN_DATA, false, CONVERSION_TIME_US + 1200, 2);
+  ok &= run("combined, slow", ACQ_COMBINED, false, CONVERSION_TIME_US + 1200, 1);
+  printf(ok ? "all checks passed\n" : "some checks FAILED\n");
+  return ok ? 0 : 1;
+}
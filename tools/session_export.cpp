@@ -0,0 +1,195 @@
+// Replays a recorded cuff session through the acquisition, recording and
+// analysis code on the simulated clock, then exports it the way the board
+// does over its virtual COM port, into a file, a pipe or a pseudo-terminal
+// With --pty it makes a pseudo-terminal, prints the name of its terminal
+// end, and writes into it; start export_decode or telemetry_monitor on 
+// that name to read it
+// With --live the samples and beats are also streamed as telemetry while
+// the session runs, like a board built with -DLIVE_TELEMETRY; a low
+// --baud (the default is EXPORT_BAUD) shows how frames get dropped when
+// the link can't keep up
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/session_export.cpp $(ls *.cpp | grep -v main.cpp) -o session_export
+// Usage:
+//   ./session_export [--live] [--baud n] session.trace out_path|-
+//   ./session_export [--live] [--baud n] --pty session.trace
+// Then, for example:
+//   ./session_export session.trace - | ./export_decode -
+//   ./session_export --live --baud 2400 session.trace - | ./telemetry_monitor -
+
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "platform.h"
+#include "pressure_bus.h"
+#include "sensor.h"
+#include "analysis.h"
+#include "oscillometry.h"
+#include "sampler.h"
+#include "session_recorder.h"
+#include "session_export.h"
+#include "telemetry.h"
+
+static Telemetry * telemetry = NULL;
+// Set with --live
+static OscillometricAnalyzer live_beats;
+// Finds the beats for the telemetry, as main's analyzer does
+
+static void make_raw(int fd) {
+  // Turns off every translation the terminal would make to the bytes
+
+  struct termios t;
+  if (tcgetattr(fd, &t) == 0) {
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+}
+
+static void sample_and_record(uint8_t phase) {
+  // The same as main's
+
+  sleep_and_update_pressure();
+  recorder.record(sample_time_us, pressure_reading, sensor_status, phase);
+  if (telemetry != NULL) {
+    telemetry->sample(sample_time_us, pressure_reading, sensor_status, phase);
+    if (phase == PHASE_DEFLATE) {
+      live_beats.update(sample_time_us, pressure);
+    }
+  }
+}
+
+static void send_beat(void *, uint32_t time_us, pressure_t p) {
+  telemetry->beat(time_us, p);
+}
+
+static void record_session(TraceReplayBus & bus) {
+  // Runs one session the same way main does
+
+  recorder.start();
+  capture.reset();
+  live_beats.reset();
+  read_pressure();
+  while (pressure < MMHG(150) && !bus.finished()) {
+    sample_and_record(PHASE_INFLATE);
+    capture.append(sample_time_us, pressure);
+  }
+  capture.start_deflation();
+  while (pressure > MMHG(30) && !capture.full() && !bus.finished()) {
+    sample_and_record(PHASE_DEFLATE);
+    capture.append(sample_time_us, pressure);
+  }
+  recorder.finish();
+  if (telemetry != NULL) {
+    live_beats.end_deflation();
+    telemetry->flush();
+  }
+  calc_stats();
+}
+
+int main(int argc, char ** argv) {
+  bool pty = false;
+  bool live = false;
+  uint32_t baud = EXPORT_BAUD;
+  int first = 1;
+  while (first < argc && argv[first][0] == '-' && argv[first][1] == '-') {
+    if (strcmp(argv[first], "--pty") == 0) {
+      pty = true;
+    } else if (strcmp(argv[first], "--live") == 0) {
+      live = true;
+    } else if (strcmp(argv[first], "--baud") == 0 && first + 1 < argc) {
+      baud = (uint32_t) strtoul(argv[++first], NULL, 10);
+    }
+    first++;
+  }
+  if (argc - first != (pty ? 1 : 2) || baud == 0) {
+    fprintf(stderr, "usage: %s [--live] [--baud n] session.trace out_path|-\n"
+            "       %s [--live] [--baud n] --pty session.trace\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  int fd;
+  int slave = -1;
+  if (pty) {
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+      perror("posix_openpt");
+      return 1;
+    }
+    slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    // Keep the terminal end open, so the bytes wait there until the 
+    // decoder opens it too
+    make_raw(slave);
+    printf("%s\n", ptsname(fd));
+    fflush(stdout);
+  } else if (strcmp(argv[first + 1], "-") == 0) {
+    fd = STDOUT_FILENO;
+  } else {
+    fd = open(argv[first + 1], O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY, 0644);
+    if (fd < 0) {
+      perror(argv[first + 1]);
+      return 1;
+    }
+    if (isatty(fd)) {
+      make_raw(fd);
+    }
+  }
+
+  TraceReplayBus bus(CuffSensor::address);
+  if (!bus.load(argv[first])) {
+    fprintf(stderr, "%s: cannot load trace\n", argv[first]);
+    return 1;
+  }
+  setup_sensor(&bus);
+  set_max_deflate_seconds(MAX_DEFLATE_SECONDS);
+  sdram_init();
+  recorder.begin(SESSION_MAX_MINUTES * 60 * MAX_SAMPLE_RATE_HZ);
+
+  FdSerialLink link(fd, baud);
+  Telemetry live_link(&link);
+  if (live) {
+    telemetry = &live_link;
+    live_beats.on_beat(send_beat, NULL);
+  }
+  host_clock_reset();
+  start_acquisition(SAMPLE_RATE_HZ);
+  record_session(bus);
+  sampler.stop();
+  while (link.busy()) {
+    platform_wait_for_event();
+    // Let the last telemetry frame out
+  }
+  if (live) {
+    fprintf(stderr, "telemetry: %u frames sent, %u dropped, %u beats lost at %u baud\n",
+            (unsigned) live_link.frames(), (unsigned) live_link.dropped(),
+            (unsigned) live_link.dropped_beats(), (unsigned) baud);
+  }
+
+  SessionExporter exporter(&link);
+  SessionResults results = {heart_rate, systolic, diastolic, true};
+  uint64_t begin_us = platform_now_us();
+  exporter.start(recorder, results);
+  while (exporter.busy()) {
+    platform_wait_for_event();
+  }
+
+  fprintf(stderr, "exported %u samples (%u bytes in SDRAM) in %u frames, %.2f s at %u baud%s\n",
+          (unsigned) recorder.size(), (unsigned) recorder.bytes(), (unsigned) exporter.frames(),
+          (platform_now_us() - begin_us) / 1e6, (unsigned) baud,
+          link.errors() ? ", WRITE ERRORS" : "");
+  if (pty) {
+    int pending = 1;
+    while (ioctl(slave, FIONREAD, &pending) == 0 && pending > 0) {
+      usleep(10000);
+      // Wait for the reader to take everything before the terminal goes
+    }
+    close(slave);
+    close(fd);
+  }
+  return link.errors() ? 1 : 0;
+}
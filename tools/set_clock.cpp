@@ -0,0 +1,62 @@
+// Sets the board's real-time clock over its virtual COM port: sends a
+// FRAME_SET_CLOCK (see export_protocol.h) with the computer's time, or
+// with the seconds since 1970 given, to a port, a file or a pipe
+// The board takes it over at the end of the next measurement, which is
+// the first one the trends count. Its RTC has no backup battery, so the
+// clock has to be set again after every power-up
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/set_clock.cpp export_protocol.cpp crc.cpp -o set_clock
+// Usage:
+//   ./set_clock /dev/ttyACM0|file|- [seconds]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "export_protocol.h"
+
+int main(int argc, char ** argv) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "usage: %s port|file|- [seconds]\n", argv[0]);
+    return 2;
+  }
+  uint32_t now = argc == 3 ? (uint32_t) strtoul(argv[2], NULL, 10) : (uint32_t) time(NULL);
+
+  const char * path = argv[1];
+  int fd = STDOUT_FILENO;
+  if (strcmp(path, "-") != 0) {
+    fd = open(path, O_WRONLY | O_NOCTTY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      perror(path);
+      return 1;
+    }
+  }
+  if (isatty(fd)) {
+    struct termios t;
+    if (tcgetattr(fd, &t) == 0) {
+      cfmakeraw(&t);
+      cfsetspeed(&t, B115200);
+      // EXPORT_BAUD
+      tcsetattr(fd, TCSANOW, &t);
+    }
+  }
+
+  uint8_t payload[4];
+  put_u32(payload, now);
+  uint8_t frame[EXPORT_HEADER_BYTES + sizeof(payload) + 2];
+  int len = build_frame(frame, FRAME_SET_CLOCK, 0, payload, sizeof(payload));
+  if (write(fd, frame, len) != len) {
+    perror(path);
+    return 1;
+  }
+  if (isatty(fd)) {
+    tcdrain(fd);
+  }
+  time_t t = (time_t) now;
+  fprintf(stderr, "sent %s", asctime(gmtime(&t)));
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Watches the live telemetry a board built with -DLIVE_TELEMETRY sends
+// while it measures (see telemetry.h), from its virtual COM port, a
+// pseudo-terminal, a file or a pipe
+// Prints a line per frame with the latest pressure and every beat with
+// the heart rate since the beat before, then a summary of what was lost:
+// frames the board dropped because the link was busy, frames lost on the
+// way (seq gaps), and damaged frames. Runs until the input ends
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -I. tools/telemetry_monitor.cpp export_protocol.cpp crc.cpp sample_codec.cpp -o telemetry_monitor
+// Usage:
+//   ./telemetry_monitor [--csv] /dev/ttyACM0|file|-
+// --csv prints every sample as "time_us,counts,status,phase" on stdout
+// instead of a line per frame; the summary always goes to stderr
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "export_protocol.h"
+#include "sample_codec.h"
+#include "sensor_profile.h"
+
+int main(int argc, char ** argv) {
+  bool csv = argc == 3 && strcmp(argv[1], "--csv") == 0;
+  if (argc != 2 && !csv) {
+    fprintf(stderr, "usage: %s [--csv] port|file|-\n", argv[0]);
+    return 2;
+  }
+
+  const char * path = argv[argc - 1];
+  int fd = STDIN_FILENO;
+  if (strcmp(path, "-") != 0) {
+    fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(path);
+      return 1;
+    }
+  }
+  if (isatty(fd)) {
+    struct termios t;
+    if (tcgetattr(fd, &t) == 0) {
+      cfmakeraw(&t);
+      tcsetattr(fd, TCSANOW, &t);
+    }
+  }
+
+  FrameParser parser;
+  SampleDecoder decoder;
+  bool started = false;
+  uint8_t expected_seq = 0;
+  uint32_t frames = 0;
+  uint32_t lost_frames = 0;
+  uint32_t device_dropped = 0;
+  uint32_t next_index = 0;
+  uint32_t samples = 0;
+  uint32_t missing_samples = 0;
+  uint32_t beats = 0;
+  uint32_t last_beat_us = 0;
+  uint32_t bad_samples = 0;
+
+  uint8_t buf[256];
+  while (true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+
+    ssize_t i;
+    for (i = 0; i < n; i++) {
+      if (!parser.feed(buf[i]) || parser.type() != FRAME_TELEMETRY || parser.length() < 10) {
+        continue;
+        // Export frames share the port
+      }
+      const uint8_t * p = parser.payload();
+      const uint8_t * end = p + parser.length();
+      uint32_t index = get_u32(p);
+      device_dropped = get_u32(p + 4);
+      int count = p[8];
+      int nbeats = p[9];
+      if (started) {
+        lost_frames += (uint8_t) (parser.seq() - expected_seq);
+        if (index > next_index) {
+          missing_samples += index - next_index;
+        }
+      }
+      started = true;
+      expected_seq = (uint8_t) (parser.seq() + 1);
+      next_index = index + count;
+      frames++;
+
+      const uint8_t * b = p + 10;
+      int k;
+      for (k = 0; k < nbeats && b + 8 <= end; k++, b += 8) {
+        uint32_t t = get_u32(b);
+        char text[32];
+        format_pressure(text, sizeof(text), (pressure_t) get_u32(b + 4));
+        if (!csv) {
+          if (beats > 0 && t > last_beat_us) {
+            printf("%9.3f s  beat at %s, %.0f bpm\n", t / 1e6, text, 60e6 / (t - last_beat_us));
+          } else {
+            printf("%9.3f s  beat at %s\n", t / 1e6, text);
+          }
+        }
+        last_beat_us = t;
+        beats++;
+      }
+
+      decoder.reset();
+      RecordedSample s = {0, 0, 0, 0, 0};
+      for (k = 0; k < count; k++) {
+        int used = decoder.decode(b, end, s);
+        if (used == 0) {
+          bad_samples += count - k;
+          break;
+        }
+        b += used;
+        samples++;
+        if (csv) {
+          printf("%u,%u,%u,%u\n", (unsigned) s.time_us, (unsigned) s.counts,
+                 (unsigned) s.status, (unsigned) s.phase);
+        }
+      }
+      if (!csv && count > 0) {
+        char text[32];
+        format_pressure(text, sizeof(text), counts_to_pressure(s.counts));
+        printf("%9.3f s  %s  %s\n", s.time_us / 1e6,
+               s.phase == PHASE_INFLATE ? "inflating" : "deflating", text);
+      }
+      fflush(stdout);
+    }
+  }
+
+  fprintf(stderr, "%u frames, %u samples, %u beats; %u frames dropped by the board, "
+          "%u lost on the way, %u samples missing, %u bad CRCs, %u undecodable samples\n",
+          (unsigned) frames, (unsigned) samples, (unsigned) beats, (unsigned) device_dropped,
+          (unsigned) lost_frames, (unsigned) missing_samples, (unsigned) parser.crc_errors(),
+          (unsigned) bad_samples);
+  return 0;
+}